@@ -0,0 +1,335 @@
+#pragma once
+#include <atomic>
+#include <new>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "utils.hpp"
+
+#define FRAME_ARENA_MAX_THREADS     64
+#define FRAME_ARENA_BLOCK_SIZE      (256*1024)      // First block of each thread arena
+
+// Bump allocator. Reset() drops everything at once; if the last round did not
+// fit in the block, the block is regrown to the high-water mark so the next
+// round allocates nothing from the heap.
+class LinearArena
+{
+    public:
+    explicit LinearArena(size_t capacity = FRAME_ARENA_BLOCK_SIZE)
+    {
+        m_base = nullptr;
+        m_capacity = 0;
+        m_offset = 0;
+        m_overflow = 0;
+        m_highWater = 0;
+        m_initial = capacity;
+    }
+    ~LinearArena()
+    {
+        for (void *block : m_blocks)
+            free(block);
+        free(m_base);
+    }
+
+    LinearArena(const LinearArena&) = delete;
+    LinearArena &operator=(const LinearArena&) = delete;
+
+    // align must be a power of two
+    void *Allocate(size_t size, size_t align = alignof(std::max_align_t))
+    {
+        uintptr_t start = (uintptr_t)m_base + m_offset;
+        uintptr_t address = (start + align - 1) & ~(uintptr_t)(align - 1);
+        size_t end = (size_t)(address - (uintptr_t)m_base) + size;
+        if (m_base && end <= m_capacity)
+        {
+            m_offset = end;
+            return (void*)address;
+        }
+        return AllocateSlow(size, align);
+    }
+
+    template<typename T>
+    T *Allocate(size_t count)
+    {
+        return (T*)Allocate(sizeof(T) * count, alignof(T));
+    }
+
+    void Reset()
+    {
+        size_t used = GetUsed();
+        if (used > m_highWater) m_highWater = used;
+        for (void *block : m_blocks)
+            free(block);
+        m_blocks.clear();
+        if (m_overflow > 0)
+        {
+            free(m_base);
+            m_capacity = m_highWater + m_highWater / 2;
+            m_base = (char*)malloc(m_capacity);
+            Log(1, "ARENA: Grew block to %zu KB", m_capacity / 1024);
+        }
+        m_offset = 0;
+        m_overflow = 0;
+    }
+
+    // Bytes handed out since the last Reset(), overflow included
+    size_t GetUsed() const
+    {
+        return m_offset + m_overflow;
+    }
+
+    size_t GetCapacity() const
+    {
+        return m_capacity;
+    }
+
+    size_t GetHighWater() const
+    {
+        return m_highWater > GetUsed() ? m_highWater : GetUsed();
+    }
+
+    private:
+        char *m_base;
+        size_t m_capacity;
+        size_t m_offset;
+        size_t m_overflow;
+        size_t m_highWater;
+        size_t m_initial;
+        std::vector<void*> m_blocks;    // overflow allocations, freed on Reset()
+
+        void *AllocateSlow(size_t size, size_t align)
+        {
+            if (!m_base)
+            {
+                m_capacity = m_initial > size + align ? m_initial : size + align;
+                m_base = (char*)malloc(m_capacity);
+                return Allocate(size, align);
+            }
+            // Out of room: serve from the heap until the next Reset() regrows the block
+            char *block = (char*)malloc(size + align);
+            m_blocks.push_back(block);
+            m_overflow += size + align;
+            uintptr_t address = ((uintptr_t)block + align - 1) & ~(uintptr_t)(align - 1);
+            return (void*)address;
+        }
+};
+
+// STL allocator on a given arena; deallocate is a no-op, the arena frees on Reset()
+template<typename T>
+class ArenaAllocator
+{
+    public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(LinearArena *arena) : m_arena(arena) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : m_arena(other.GetArena()) {}
+
+    T *allocate(size_t count)
+    {
+        return m_arena->Allocate<T>(count);
+    }
+    void deallocate(T*, size_t) {}
+
+    LinearArena *GetArena() const
+    {
+        return m_arena;
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U> &other) const { return m_arena == other.GetArena(); }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return m_arena != other.GetArena(); }
+
+    private:
+        LinearArena *m_arena;
+};
+
+// Transient memory for one frame. Every thread (main, workers, render thread)
+// gets its own pair of arenas, so allocating takes no lock. App::Swap() starts
+// a new frame; a thread's arena is reset the first time that thread allocates
+// in it, two frames after it was filled. So frame data stays valid through the
+// next frame: enough for the render thread with 2 packets, not with 3.
+class FrameArena
+{
+    public:
+    static void *Allocate(size_t size, size_t align = alignof(std::max_align_t))
+    {
+        return GetArena().Allocate(size, align);
+    }
+
+    template<typename T>
+    static T *Allocate(size_t count)
+    {
+        return GetArena().Allocate<T>(count);
+    }
+
+    // Copies a string into the frame, for names and labels built per frame
+    static const char *Copy(const char *text)
+    {
+        size_t length = strlen(text) + 1;
+        char *copy = (char*)Allocate(length, 1);
+        memcpy(copy, text, length);
+        return copy;
+    }
+
+    // The calling thread's arena for the current frame
+    static LinearArena &GetArena()
+    {
+        Slot &slot = GetSlot();
+        long long frame = m_frame.load(std::memory_order_acquire);
+        LinearArena &arena = slot.arenas[frame & 1];
+        if (slot.frame != frame)
+        {
+            size_t used = arena.GetUsed();
+            size_t peak = m_peak.load(std::memory_order_relaxed);
+            while (used > peak && !m_peak.compare_exchange_weak(peak, used, std::memory_order_relaxed))
+                ;
+            arena.Reset();
+            slot.frame = frame;
+        }
+        return arena;
+    }
+
+    // Called once per frame by App::Swap()
+    static void NewFrame()
+    {
+        long long heap = m_heapAllocations.load(std::memory_order_relaxed);
+        m_frameHeapAllocations = heap - m_heapMark;
+        m_heapMark = heap;
+        m_frame.fetch_add(1, std::memory_order_release);
+    }
+
+    static long long GetFrame()
+    {
+        return m_frame.load(std::memory_order_relaxed);
+    }
+
+    // Most bytes one thread used in a frame
+    static size_t GetPeakBytes()
+    {
+        return m_peak.load(std::memory_order_relaxed);
+    }
+
+    // operator new calls during the last frame, all threads; -1 unless
+    // FRAME_ARENA_COUNT_HEAP() is compiled in
+    static long long GetFrameHeapAllocations()
+    {
+        return m_heapCounting ? m_frameHeapAllocations : -1;
+    }
+
+    static bool EnableHeapCounting()
+    {
+        m_heapCounting = true;
+        return true;
+    }
+
+    static void CountHeapAllocation()
+    {
+        m_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void LogStats()
+    {
+        Log(0, "ARENA: frame %lld  peak %zu KB per thread  heap allocations last frame %lld", GetFrame(),
+            GetPeakBytes() / 1024, GetFrameHeapAllocations());
+    }
+
+    private:
+        struct Slot
+        {
+            Slot() : frame(-1), used(false) {}
+
+            LinearArena arenas[2];
+            long long frame;
+            std::atomic<bool> used;
+        };
+
+        // Gives the slot back when its thread exits; the memory stays for the next thread
+        struct SlotOwner
+        {
+            Slot *slot = nullptr;
+            std::unique_ptr<Slot> own;
+            ~SlotOwner()
+            {
+                if (slot && !own)
+                    slot->used.store(false, std::memory_order_release);
+            }
+        };
+
+        inline static Slot m_slots[FRAME_ARENA_MAX_THREADS];
+        inline static std::atomic<long long> m_frame{0};
+        inline static std::atomic<size_t> m_peak{0};
+        inline static std::atomic<long long> m_heapAllocations{0};
+        inline static long long m_heapMark = 0;
+        inline static long long m_frameHeapAllocations = 0;
+        inline static bool m_heapCounting = false;
+
+        static Slot &GetSlot()
+        {
+            thread_local SlotOwner owner;
+            if (!owner.slot)
+            {
+                for (int i = 0; i < FRAME_ARENA_MAX_THREADS && !owner.slot; i++)
+                {
+                    bool expected = false;
+                    if (m_slots[i].used.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                        owner.slot = &m_slots[i];
+                }
+                if (!owner.slot)
+                {
+                    Log(1, "ARENA: More than %d threads, giving this one a private arena", FRAME_ARENA_MAX_THREADS);
+                    owner.own.reset(new Slot());
+                    owner.slot = owner.own.get();
+                }
+            }
+            return *owner.slot;
+        }
+};
+
+// STL allocator on the calling thread's frame arena
+template<typename T>
+class FrameAllocator
+{
+    public:
+    typedef T value_type;
+
+    FrameAllocator() {}
+    template<typename U>
+    FrameAllocator(const FrameAllocator<U>&) {}
+
+    T *allocate(size_t count)
+    {
+        return FrameArena::Allocate<T>(count);
+    }
+    void deallocate(T*, size_t) {}
+
+    template<typename U>
+    bool operator==(const FrameAllocator<U>&) const { return true; }
+    template<typename U>
+    bool operator!=(const FrameAllocator<U>&) const { return false; }
+};
+
+template<typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+// Counts every operator new into FrameArena::GetFrameHeapAllocations().
+// Opt in by writing FRAME_ARENA_COUNT_HEAP() at file scope in exactly one .cpp.
+// The hooks stay out of line, or GCC warns about free() on operator new memory.
+#define FRAME_ARENA_COUNT_HEAP() \
+    __attribute__((noinline)) void *operator new(size_t size) \
+    { \
+        FrameArena::CountHeapAllocation(); \
+        void *p = malloc(size ? size : 1); \
+        if (!p) throw std::bad_alloc(); \
+        return p; \
+    } \
+    void *operator new[](size_t size) { return operator new(size); } \
+    __attribute__((noinline)) void operator delete(void *p) noexcept { free(p); } \
+    __attribute__((noinline)) void operator delete[](void *p) noexcept { free(p); } \
+    __attribute__((noinline)) void operator delete(void *p, size_t) noexcept { free(p); } \
+    __attribute__((noinline)) void operator delete[](void *p, size_t) noexcept { free(p); } \
+    static const bool frameArenaHeapCounting = FrameArena::EnableHeapCounting();
@@ -0,0 +1,364 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "utils.hpp"
+#include "render.hpp"
+
+// Packs many small images into a few large textures so objects using
+// different images can be drawn without rebinding. Each image is surrounded
+// by a gutter of repeated edge pixels and placed on a grid of the gutter size
+// (rounded up to a power of two), so the first log2(gutter) mip levels never
+// blend neighbours together.
+
+struct AtlasRegion
+{
+    int page = -1;
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    float u0 = 0.0f;
+    float v0 = 0.0f;
+    float u1 = 0.0f;
+    float v1 = 0.0f;
+};
+
+// Skyline bottom-left packer: keeps the top edge of the packed area as a list
+// of horizontal segments and drops each rectangle where it ends lowest.
+class SkylinePacker
+{
+    public:
+    SkylinePacker()
+    {
+        m_width = 0;
+        m_height = 0;
+        m_used = 0;
+    }
+
+    void Init(int width, int height)
+    {
+        m_width = width;
+        m_height = height;
+        m_used = 0;
+        m_nodes.clear();
+        m_nodes.push_back({ 0, 0, width });
+    }
+
+    bool Pack(int w, int h, int &x, int &y)
+    {
+        int bestIndex = -1;
+        int bestTop = m_height + 1;
+        int bestWidth = m_width + 1;
+        for (int i = 0; i < (int)m_nodes.size(); i++)
+        {
+            int top = Fit(i, w, h);
+            if (top < 0)
+                continue;
+            if (top + h < bestTop || (top + h == bestTop && m_nodes[i].width < bestWidth))
+            {
+                bestIndex = i;
+                bestTop = top + h;
+                bestWidth = m_nodes[i].width;
+                y = top;
+            }
+        }
+        if (bestIndex < 0)
+            return false;
+
+        x = m_nodes[bestIndex].x;
+        m_nodes.insert(m_nodes.begin() + bestIndex, { x, y + h, w });
+
+        // Trim or drop the segments now covered by the new one
+        for (int i = bestIndex + 1; i < (int)m_nodes.size(); i++)
+        {
+            Node &previous = m_nodes[i - 1];
+            Node &node = m_nodes[i];
+            int overlap = previous.x + previous.width - node.x;
+            if (overlap <= 0)
+                break;
+            node.x += overlap;
+            node.width -= overlap;
+            if (node.width > 0)
+                break;
+            m_nodes.erase(m_nodes.begin() + i);
+            i--;
+        }
+
+        // Merge neighbours at the same height
+        for (int i = 0; i + 1 < (int)m_nodes.size(); i++)
+        {
+            if (m_nodes[i].y == m_nodes[i + 1].y)
+            {
+                m_nodes[i].width += m_nodes[i + 1].width;
+                m_nodes.erase(m_nodes.begin() + i + 1);
+                i--;
+            }
+        }
+
+        m_used += (long)w * h;
+        return true;
+    }
+
+    // Fraction of the page covered by packed rectangles
+    float GetOccupancy() const
+    {
+        return (m_width > 0 && m_height > 0) ? (float)m_used / ((float)m_width * m_height) : 0.0f;
+    }
+
+    private:
+        struct Node
+        {
+            int x;
+            int y;
+            int width;
+        };
+        std::vector<Node> m_nodes;
+        int m_width;
+        int m_height;
+        long m_used;
+
+        // Height the rectangle would rest at when its left edge is on node 'index', -1 if it does not fit
+        int Fit(int index, int w, int h) const
+        {
+            int x = m_nodes[index].x;
+            if (x + w > m_width)
+                return -1;
+            int y = 0;
+            int remaining = w;
+            for (int i = index; remaining > 0; i++)
+            {
+                if (i >= (int)m_nodes.size())
+                    return -1;
+                y = std::max(y, m_nodes[i].y);
+                if (y + h > m_height)
+                    return -1;
+                remaining -= m_nodes[i].width;
+            }
+            return y;
+        }
+};
+
+class TextureAtlas
+{
+    public:
+    TextureAtlas(int pageSize = 2048, int gutter = 4)
+    {
+        m_pageSize = pageSize;
+        m_gutter = gutter;
+        m_align = 1;
+        while (m_align < gutter)
+            m_align <<= 1;
+    }
+
+    // Queues an image for the next Build(); returns its region id or -1
+    int Add(const std::string &file_name)
+    {
+        Image image;
+        if (!LoadImage(file_name, image))
+            return -1;
+        int id = Add(image);
+        UnloadImage(image);
+        return id;
+    }
+
+    // Copies the pixels, so the image can be freed right away
+    int Add(const Image &image)
+    {
+        if (image.data == nullptr || image.components < 1 || image.components > 4)
+            return -1;
+
+        Entry entry;
+        entry.width = image.width;
+        entry.height = image.height;
+        entry.pixels.resize((size_t)image.width * image.height * 4);
+        for (size_t i = 0; i < (size_t)image.width * image.height; i++)
+        {
+            const unsigned char *src = image.data + i * image.components;
+            unsigned char *dst = &entry.pixels[i * 4];
+            if (image.components < 3)
+            {
+                dst[0] = dst[1] = dst[2] = src[0];
+                dst[3] = image.components == 2 ? src[1] : 255;
+            }
+            else
+            {
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst[2] = src[2];
+                dst[3] = image.components == 4 ? src[3] : 255;
+            }
+        }
+        m_entries.push_back(std::move(entry));
+        m_regions.push_back(AtlasRegion());
+        return (int)m_regions.size() - 1;
+    }
+
+    // Packs everything added so far into RGBA pages and uploads them. The
+    // staged pixels are released; regions stay valid until the next Build().
+    bool Build(bool mipmaps = true)
+    {
+        m_pages.clear();
+        m_packers.clear();
+
+        // Tallest first keeps the skyline flat
+        std::vector<int> order;
+        for (int i = 0; i < (int)m_entries.size(); i++)
+            if (!m_entries[i].pixels.empty())
+                order.push_back(i);
+        std::sort(order.begin(), order.end(), [this](int a, int b)
+        {
+            if (m_entries[a].height != m_entries[b].height)
+                return m_entries[a].height > m_entries[b].height;
+            return m_entries[a].width > m_entries[b].width;
+        });
+
+        bool result = true;
+        for (int id : order)
+        {
+            const Entry &entry = m_entries[id];
+            int w = AlignUp(entry.width + m_gutter * 2);
+            int h = AlignUp(entry.height + m_gutter * 2);
+            AtlasRegion &region = m_regions[id];
+            region.page = -1;
+            if (w > m_pageSize || h > m_pageSize)
+            {
+                Log(1, "ATLAS: image %d (%dx%d) is larger than a page", id, entry.width, entry.height);
+                result = false;
+                continue;
+            }
+
+            int x = 0, y = 0;
+            int page = 0;
+            for (; page < (int)m_packers.size(); page++)
+                if (m_packers[page].Pack(w, h, x, y))
+                    break;
+            if (page == (int)m_packers.size())
+            {
+                m_packers.push_back(SkylinePacker());
+                m_packers.back().Init(m_pageSize, m_pageSize);
+                m_packers.back().Pack(w, h, x, y);
+            }
+
+            region.page = page;
+            region.x = x + m_gutter;
+            region.y = y + m_gutter;
+            region.width = entry.width;
+            region.height = entry.height;
+            region.u0 = (float)region.x / m_pageSize;
+            region.v0 = (float)region.y / m_pageSize;
+            region.u1 = (float)(region.x + region.width) / m_pageSize;
+            region.v1 = (float)(region.y + region.height) / m_pageSize;
+        }
+
+        std::vector<unsigned char> pixels((size_t)m_pageSize * m_pageSize * 4);
+        m_pages.resize(m_packers.size());
+        for (int page = 0; page < (int)m_packers.size(); page++)
+        {
+            std::fill(pixels.begin(), pixels.end(), 0);
+            for (int id : order)
+                if (m_regions[id].page == page)
+                    Blit(m_entries[id], m_regions[id], pixels.data());
+
+            Image image;
+            image.data = pixels.data();
+            image.width = m_pageSize;
+            image.height = m_pageSize;
+            image.components = 4;
+            result = m_pages[page].Upload(image, mipmaps) && result;
+        }
+
+        m_entries.clear();
+        m_entries.resize(m_regions.size());
+        return result;
+    }
+
+    // Maps the surface's 0..1 texture coordinates into the region and uploads
+    // them again if the surface was built. Tiling (coordinates outside 0..1)
+    // cannot be expressed inside an atlas and is clamped.
+    void RemapUV(Surface &surface, int id) const
+    {
+        const AtlasRegion &region = m_regions[id];
+        if (!surface.HasCPUData())
+        {
+            Log(2, "ATLAS: cannot remap a surface whose CPU data was released");
+            return;
+        }
+        bool clamped = false;
+        for (int i = 0; i < surface.CountVertices(); i++)
+        {
+            Vec2 uv = surface.GetVertex(i).coord;
+            if (uv.x < 0.0f || uv.x > 1.0f || uv.y < 0.0f || uv.y > 1.0f)
+                clamped = true;
+            float u = std::min(std::max(uv.x, 0.0f), 1.0f);
+            float v = std::min(std::max(uv.y, 0.0f), 1.0f);
+            surface.VertexTexCoords(i, region.u0 + u * (region.u1 - region.u0), region.v0 + v * (region.v1 - region.v0));
+        }
+        if (clamped)
+            Log(1, "ATLAS: texture coordinates outside 0..1 were clamped for region %d", id);
+        surface.Update();
+    }
+
+    const AtlasRegion &GetRegion(int id) const { return m_regions[id]; }
+    Texture2D &GetPage(int page) { return m_pages[page]; }
+    int GetPageCount() const { return (int)m_pages.size(); }
+    int GetCount() const { return (int)m_regions.size(); }
+
+    float GetOccupancy(int page) const
+    {
+        return m_packers[page].GetOccupancy();
+    }
+
+    // Drawing every packed image once costs one bind per page instead of one per image
+    void LogStats() const
+    {
+        int packed = 0;
+        for (const AtlasRegion &region : m_regions)
+            if (region.page >= 0)
+                packed++;
+        Log(0, "ATLAS: %d images in %d pages of %dx%d, %d texture binds saved per frame", packed,
+            GetPageCount(), m_pageSize, m_pageSize, packed - GetPageCount());
+        for (int page = 0; page < (int)m_packers.size(); page++)
+            Log(0, "ATLAS: page %d occupancy %.1f%% (including gutters)", page, GetOccupancy(page) * 100.0f);
+    }
+
+    private:
+        struct Entry
+        {
+            std::vector<unsigned char> pixels;
+            int width = 0;
+            int height = 0;
+        };
+        std::vector<Entry> m_entries;
+        std::vector<AtlasRegion> m_regions;
+        std::vector<SkylinePacker> m_packers;
+        std::vector<Texture2D> m_pages;
+        int m_pageSize;
+        int m_gutter;
+        int m_align;
+
+        int AlignUp(int value) const
+        {
+            return (value + m_align - 1) & ~(m_align - 1);
+        }
+
+        // Copies the image and extends its edge pixels out through the gutter
+        void Blit(const Entry &entry, const AtlasRegion &region, unsigned char *page) const
+        {
+            for (int y = -m_gutter; y < entry.height + m_gutter; y++)
+            {
+                int sy = std::min(std::max(y, 0), entry.height - 1);
+                int py = region.y + y;
+                if (py < 0 || py >= m_pageSize)
+                    continue;
+                for (int x = -m_gutter; x < entry.width + m_gutter; x++)
+                {
+                    int sx = std::min(std::max(x, 0), entry.width - 1);
+                    int px = region.x + x;
+                    if (px < 0 || px >= m_pageSize)
+                        continue;
+                    memcpy(page + ((size_t)py * m_pageSize + px) * 4, &entry.pixels[((size_t)sy * entry.width + sx) * 4], 4);
+                }
+            }
+        }
+};
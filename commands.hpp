@@ -0,0 +1,293 @@
+#pragma once
+#include <vector>
+#include <string.h>
+#include <stdint.h>
+#include "glad/glad.h"
+#include "utils.hpp"
+#include "math.hpp"
+#include "render.hpp"
+#include "jobs.hpp"
+
+// Records draw work as a flat stream of small commands so culling and draw
+// preparation can run on any thread; only Execute() touches GL and must run on
+// the GL thread. Commands keep raw pointers to shaders, textures and surfaces,
+// which have to outlive the buffer until it is executed or cleared. Uniform
+// locations are resolved up front on the GL thread (Shader::addUniform /
+// getUniformLocation) since workers cannot query them.
+
+enum CommandType
+{
+    COMMAND_BIND_SHADER = 0,
+    COMMAND_BIND_TEXTURE,
+    COMMAND_BIND_TEXTURE_ARRAY,
+    COMMAND_UNIFORM_INT,
+    COMMAND_UNIFORM_FLOAT,
+    COMMAND_UNIFORM_FLOAT2,
+    COMMAND_UNIFORM_FLOAT3,
+    COMMAND_UNIFORM_FLOAT4,
+    COMMAND_UNIFORM_MATRIX4,
+    COMMAND_DRAW,
+    COMMAND_DRAW_INSTANCED,
+};
+
+class CommandBuffer
+{
+    public:
+    CommandBuffer()
+    {
+        m_count = 0;
+    }
+
+    void Reserve(size_t bytes)
+    {
+        m_data.reserve(bytes);
+    }
+
+    // Keeps the memory so the next frame records without allocating
+    void Clear()
+    {
+        m_data.clear();
+        m_count = 0;
+    }
+
+    void BindShader(Shader *shader)
+    {
+        Push(COMMAND_BIND_SHADER, &shader, sizeof(shader));
+    }
+
+    void BindTexture(UINT unit, Texture2D *texture)
+    {
+        TextureCommand command = { unit, texture };
+        Push(COMMAND_BIND_TEXTURE, &command, sizeof(command));
+    }
+
+    void BindTexture(UINT unit, Texture2DArray *texture)
+    {
+        TextureCommand command = { unit, texture };
+        Push(COMMAND_BIND_TEXTURE_ARRAY, &command, sizeof(command));
+    }
+
+    void SetInt(int location, int value)
+    {
+        UniformCommand<int, 1> command = { location, { value } };
+        Push(COMMAND_UNIFORM_INT, &command, sizeof(command));
+    }
+
+    void SetFloat(int location, float value)
+    {
+        UniformCommand<float, 1> command = { location, { value } };
+        Push(COMMAND_UNIFORM_FLOAT, &command, sizeof(command));
+    }
+
+    void SetFloat2(int location, float x, float y)
+    {
+        UniformCommand<float, 2> command = { location, { x, y } };
+        Push(COMMAND_UNIFORM_FLOAT2, &command, sizeof(command));
+    }
+
+    void SetFloat3(int location, float x, float y, float z)
+    {
+        UniformCommand<float, 3> command = { location, { x, y, z } };
+        Push(COMMAND_UNIFORM_FLOAT3, &command, sizeof(command));
+    }
+
+    void SetFloat4(int location, float x, float y, float z, float w)
+    {
+        UniformCommand<float, 4> command = { location, { x, y, z, w } };
+        Push(COMMAND_UNIFORM_FLOAT4, &command, sizeof(command));
+    }
+
+    void SetMatrix4(int location, const Mat4 &mat)
+    {
+        UniformCommand<float, 16> command;
+        command.location = location;
+        memcpy(command.value, mat.x, sizeof(command.value));
+        Push(COMMAND_UNIFORM_MATRIX4, &command, sizeof(command));
+    }
+
+    void Draw(Surface *surface, UINT mode = GL_TRIANGLES)
+    {
+        DrawCommand command = { surface, mode, 0 };
+        Push(COMMAND_DRAW, &command, sizeof(command));
+    }
+
+    // The instance data must already be set on the surface when this executes
+    void DrawInstanced(Surface *surface, int count, UINT mode = GL_TRIANGLES)
+    {
+        DrawCommand command = { surface, mode, count };
+        Push(COMMAND_DRAW_INSTANCED, &command, sizeof(command));
+    }
+
+    // GL thread only
+    void Execute() const
+    {
+        const unsigned char *p = m_data.data();
+        const unsigned char *end = p + m_data.size();
+        while (p < end)
+        {
+            Header header;
+            memcpy(&header, p, sizeof(header));
+            const unsigned char *payload = p + sizeof(Header);
+            p += header.size;
+
+            switch (header.type)
+            {
+                case COMMAND_BIND_SHADER:
+                {
+                    Shader *shader;
+                    memcpy(&shader, payload, sizeof(shader));
+                    shader->Bind();
+                    break;
+                }
+                case COMMAND_BIND_TEXTURE:
+                {
+                    TextureCommand command;
+                    memcpy(&command, payload, sizeof(command));
+                    ((Texture2D*)command.texture)->Bind(command.unit);
+                    break;
+                }
+                case COMMAND_BIND_TEXTURE_ARRAY:
+                {
+                    TextureCommand command;
+                    memcpy(&command, payload, sizeof(command));
+                    ((Texture2DArray*)command.texture)->Bind(command.unit);
+                    break;
+                }
+                case COMMAND_UNIFORM_INT:
+                {
+                    UniformCommand<int, 1> command;
+                    memcpy(&command, payload, sizeof(command));
+                    glUniform1i(command.location, command.value[0]);
+                    break;
+                }
+                case COMMAND_UNIFORM_FLOAT:
+                {
+                    UniformCommand<float, 1> command;
+                    memcpy(&command, payload, sizeof(command));
+                    glUniform1f(command.location, command.value[0]);
+                    break;
+                }
+                case COMMAND_UNIFORM_FLOAT2:
+                {
+                    UniformCommand<float, 2> command;
+                    memcpy(&command, payload, sizeof(command));
+                    glUniform2fv(command.location, 1, command.value);
+                    break;
+                }
+                case COMMAND_UNIFORM_FLOAT3:
+                {
+                    UniformCommand<float, 3> command;
+                    memcpy(&command, payload, sizeof(command));
+                    glUniform3fv(command.location, 1, command.value);
+                    break;
+                }
+                case COMMAND_UNIFORM_FLOAT4:
+                {
+                    UniformCommand<float, 4> command;
+                    memcpy(&command, payload, sizeof(command));
+                    glUniform4fv(command.location, 1, command.value);
+                    break;
+                }
+                case COMMAND_UNIFORM_MATRIX4:
+                {
+                    UniformCommand<float, 16> command;
+                    memcpy(&command, payload, sizeof(command));
+                    glUniformMatrix4fv(command.location, 1, GL_FALSE, command.value);
+                    break;
+                }
+                case COMMAND_DRAW:
+                {
+                    DrawCommand command;
+                    memcpy(&command, payload, sizeof(command));
+                    command.surface->Render(command.mode);
+                    break;
+                }
+                case COMMAND_DRAW_INSTANCED:
+                {
+                    DrawCommand command;
+                    memcpy(&command, payload, sizeof(command));
+                    command.surface->RenderInstanced(command.instances, command.mode);
+                    break;
+                }
+                default:
+                    Log(2, "COMMANDS: Unknown command %d", (int)header.type);
+                    return;
+            }
+        }
+    }
+
+    // Executes the buffers one after another, e.g. one per recording job
+    static void Execute(const std::vector<CommandBuffer> &buffers)
+    {
+        for (const CommandBuffer &buffer : buffers)
+            buffer.Execute();
+    }
+
+    int GetCount() const { return m_count; }
+    size_t GetSize() const { return m_data.size(); }
+    bool IsEmpty() const { return m_count == 0; }
+
+    private:
+        struct Header
+        {
+            uint16_t type;
+            uint16_t size;      // header included
+        };
+        struct TextureCommand
+        {
+            UINT unit;
+            void *texture;
+        };
+        template <typename T, int N>
+        struct UniformCommand
+        {
+            int location;
+            T value[N];
+        };
+        struct DrawCommand
+        {
+            Surface *surface;
+            UINT mode;
+            int instances;
+        };
+
+        std::vector<unsigned char> m_data;
+        int m_count;
+
+        // Commands are padded to 4 bytes, enough for the int and float
+        // payloads; the ones holding pointers are memcpy'd out in Execute()
+        void Push(CommandType type, const void *payload, size_t size)
+        {
+            size_t padded = (sizeof(Header) + size + 3) & ~(size_t)3;
+            size_t offset = m_data.size();
+            m_data.resize(offset + padded);
+            Header header = { (uint16_t)type, (uint16_t)padded };
+            memcpy(&m_data[offset], &header, sizeof(header));
+            memcpy(&m_data[offset + sizeof(header)], payload, size);
+            m_count++;
+        }
+};
+
+// Records 'count' items into one command buffer per chunk of 'grain' items,
+// on the job system workers. record(buffer, begin, end) must not call GL.
+// Executing 'buffers' in order gives the same result as recording serially.
+template <typename F>
+inline void RecordParallel(JobSystem &jobs, int count, int grain, std::vector<CommandBuffer> &buffers, const F &record)
+{
+    if (grain < 1) grain = 1;
+    int chunks = (count + grain - 1) / grain;
+    if ((int)buffers.size() < chunks)
+        buffers.resize(chunks);
+    for (CommandBuffer &buffer : buffers)
+        buffer.Clear();
+
+    jobs.ParallelFor(chunks, 1, [&](int begin, int end)
+    {
+        for (int chunk = begin; chunk < end; chunk++)
+        {
+            int first = chunk * grain;
+            int last = first + grain < count ? first + grain : count;
+            record(buffers[chunk], first, last);
+        }
+    });
+}
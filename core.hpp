@@ -15,9 +15,22 @@
 #include <iostream>
 #include <array>
 #include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
 #include "glad/glad.h"
 #include "utils.hpp"
 #include "math.hpp"
+#include "jobs.hpp"
+#include "glstate.hpp"
+#include "timer.hpp"
+#include "profiler.hpp"
+#include "commands.hpp"
+#include "arena.hpp"
   
 
 class Input
@@ -25,12 +38,40 @@ class Input
     
     
 };
+
+// Everything the render thread needs to draw one frame. Filled by the update
+// thread between App::BeginFrame() and App::Swap(); must not call GL.
+struct FramePacket
+{
+    GLbitfield clear = GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT;
+    float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    CommandBuffer commands;                 // executed first
+    std::vector<CommandBuffer> buffers;     // then these in order, e.g. from RecordParallel
+    long frame = 0;
+
+    void Reset()
+    {
+        commands.Clear();
+        for (CommandBuffer &buffer : buffers)
+            buffer.Clear();
+    }
+};
   
 class App
 {
     public:
         App()
         {
+            window = nullptr;
+            context = nullptr;
+            m_renderRunning = false;
+            m_renderStop = false;
+            m_packet = nullptr;
+            m_frameCount = 0;
+            m_renderTime = 0.0;
+            m_target = 0.0;
+            m_start = Timer::GetNanoseconds();
+            Profiler::SetThreadName("main");
              if (SDL_Init(SDL_INIT_VIDEO) < 0) 
             {
                  Log(2,"SDL could not initialize! Error: %s", SDL_GetError());
@@ -47,6 +88,8 @@ class App
                 SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
                 SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
                 SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
+
+                m_jobs.Init();
         }
         bool CreateWindow(int width, int height, const std::string &tile, bool vsync = true)
         {
@@ -67,6 +110,8 @@ class App
         }
 
         gladLoadGLES2Loader(SDL_GL_GetProcAddress);
+        GLState::Invalidate();
+        Profiler::InitGPU();
         Log(0,"Vendor  :  %s",glGetString(GL_VENDOR));
         Log(0,"Renderer:  %s",glGetString(GL_RENDERER));
         Log(0,"Version :  %s",glGetString(GL_VERSION));
@@ -143,13 +188,29 @@ class App
   
         void Close()
         {
+            if (context)
+                Profiler::ShutdownGPU();
             SDL_GL_DeleteContext(context);
             SDL_DestroyWindow(window);
         }
 
         void Swap()
         {
-            SDL_GL_SwapWindow(window);
+            if (m_renderRunning)
+                SubmitFrame();
+            else
+            {
+                long long start = Timer::GetNanoseconds();
+                if (m_packet)
+                {
+                    DrawPacket(*m_packet);
+                    m_packet = nullptr;
+                }
+                SDL_GL_SwapWindow(window);
+                GLState::EndFrame();
+                Profiler::NewFrame();
+                m_renderTime = (Timer::GetNanoseconds() - start) * 1e-9;
+            }
               // Frame time control system
             m_current = GetTime();
             m_draw = m_current - m_previous;
@@ -157,10 +218,10 @@ class App
 
             m_frame = m_update + m_draw;
 
-            // Wait for some milliseconds...
+            // Sleep, then spin out the rest of the frame
             if (m_frame < m_target)
             {
-                Wait((float)(m_target -m_frame)*1000.0f);
+                Timer::Wait(m_target - m_frame);
 
                 m_current = GetTime();
                 double waitTime = m_current - m_previous;
@@ -168,14 +229,18 @@ class App
 
                 m_frame += waitTime;      // Total frame time: update + draw + wait
             }
+            m_frameStats.Add(m_frame);
+            FrameArena::NewFrame();
         }
         void Wait(float ms)
         {
-        SDL_Delay((int)ms);
+        Timer::Wait(ms / 1000.0);
         }
 
         ~App()
         {
+         StopRenderThread();
+         m_jobs.Shutdown();
          Close();
          SDL_Quit();
          Log(0,"Unload and free");
@@ -219,14 +284,152 @@ class App
         {
             return (float)m_frame;
         }
+        // Seconds since the App was created, nanosecond resolution
         double GetTime(void)
         {
-        return (double) SDL_GetTicks()/1000.0;
+        return (Timer::GetNanoseconds() - m_start) * 1e-9;
+        }
+
+        // Min/avg/p99 of the last frames (update + draw + wait)
+        const FrameStats &GetFrameStats() const
+        {
+            return m_frameStats;
+        }
+
+        // Worker pool shared by the samples for update, culling and loading work
+        JobSystem &GetJobs()
+        {
+            return m_jobs;
+        }
+
+        // Moves the GL context to a render thread that draws FramePackets while
+        // this thread updates the next one. 'packets' is the ring size: 2 lets
+        // update run one frame ahead, 3 two frames. From here until
+        // StopRenderThread(), GL may only be used through the packets or
+        // RunOnRenderThread(), and App::Swap() hands the packet over.
+        bool StartRenderThread(int packets = 3)
+        {
+            if (m_renderRunning || !window)
+                return false;
+            if (packets < 2) packets = 2;
+
+            m_packet = nullptr;
+            m_packets.clear();
+            m_freePackets.clear();
+            m_readyPackets.clear();
+            for (int i = 0; i < packets; i++)
+            {
+                m_packets.emplace_back(new FramePacket());
+                m_freePackets.push_back(m_packets.back().get());
+            }
+
+            SDL_GL_MakeCurrent(window, nullptr);
+            m_renderStop = false;
+            m_renderRunning = true;
+            m_renderThread = std::thread(&App::RenderLoop, this);
+            Log(0, "RENDER: Started render thread with %d frame packets", packets);
+            return true;
+        }
+
+        // Draws what was submitted, then gives the context back to this thread
+        void StopRenderThread()
+        {
+            if (!m_renderRunning)
+                return;
+            if (m_packet)
+            {
+                m_freePackets.push_back(m_packet);
+                m_packet = nullptr;
+            }
+            {
+                std::lock_guard<std::mutex> guard(m_renderLock);
+                m_renderStop = true;
+            }
+            m_renderWake.notify_all();
+            m_renderThread.join();
+            m_renderRunning = false;
+            m_packets.clear();
+            m_freePackets.clear();
+            SDL_GL_MakeCurrent(window, context);
+            Log(0, "RENDER: Stopped render thread");
+        }
+
+        bool IsRenderThreadRunning() const
+        {
+            return m_renderRunning;
+        }
+
+        // Packet for the frame being updated. Blocks while the render thread
+        // still holds every packet, which is what keeps update from running away.
+        FramePacket &BeginFrame()
+        {
+            if (!m_packet && !m_renderRunning)
+            {
+                // Single threaded: one packet, drawn by Swap()
+                if (m_packets.empty())
+                    m_packets.emplace_back(new FramePacket());
+                m_packet = m_packets.front().get();
+                m_packet->Reset();
+                m_packet->frame = m_frameCount++;
+            }
+            if (!m_packet)
+            {
+                std::unique_lock<std::mutex> guard(m_renderLock);
+                m_renderWake.wait(guard, [this]() { return !m_freePackets.empty(); });
+                m_packet = m_freePackets.front();
+                m_freePackets.pop_front();
+                guard.unlock();
+                m_packet->Reset();
+                m_packet->frame = m_frameCount++;
+            }
+            return *m_packet;
+        }
+
+        // Queues the packet from BeginFrame() for drawing; Swap() calls this
+        void SubmitFrame()
+        {
+            if (!m_renderRunning)
+                return;
+            BeginFrame();
+            {
+                std::lock_guard<std::mutex> guard(m_renderLock);
+                m_readyPackets.push_back(m_packet);
+                m_packet = nullptr;
+            }
+            m_renderWake.notify_all();
+        }
+
+        // Runs task with the GL context, before the next packet is drawn. Without
+        // a render thread it runs at once. wait = false returns immediately.
+        void RunOnRenderThread(const std::function<void()> &task, bool wait = true)
+        {
+            if (!m_renderRunning)
+            {
+                task();
+                return;
+            }
+            auto done = std::make_shared<std::atomic<bool>>(false);
+            {
+                std::lock_guard<std::mutex> guard(m_renderLock);
+                m_renderTasks.push_back([task, done]() { task(); done->store(true); });
+            }
+            m_renderWake.notify_all();
+            if (wait)
+            {
+                std::unique_lock<std::mutex> guard(m_renderLock);
+                m_renderWake.wait(guard, [&done]() { return done->load(); });
+            }
+        }
+
+        // Seconds spent drawing the last packet, swap included
+        double GetRenderFrameTime() const
+        {
+            return m_renderTime;
         }
 
-        
     private:
     SDL_Window *window;
+    JobSystem m_jobs;
     SDL_GLContext context;
     bool m_shouldclose;
         //time
@@ -236,4 +439,81 @@ class App
         double m_draw;                        // Time measure for frame draw
         double m_frame;                       // Time measure for one frame
         double m_target;                      // Desired time for one frame, if 0 not applied
+        long long m_start;                    // Timer::GetNanoseconds() at creation
+        FrameStats m_frameStats;
+        //render thread
+        std::thread m_renderThread;
+        std::mutex m_renderLock;
+        std::condition_variable m_renderWake;
+        std::vector<std::unique_ptr<FramePacket>> m_packets;
+        std::deque<FramePacket*> m_freePackets;
+        std::deque<FramePacket*> m_readyPackets;
+        std::deque<std::function<void()>> m_renderTasks;
+        FramePacket *m_packet;                // Being filled by the update thread
+        bool m_renderRunning;
+        bool m_renderStop;
+        long m_frameCount;
+        std::atomic<double> m_renderTime;
+
+        void DrawPacket(const FramePacket &packet)
+        {
+            PROFILE_SCOPE("DrawPacket");
+            PROFILE_GPU_SCOPE("DrawPacket");
+            if (packet.clear)
+            {
+                glClearColor(packet.clearColor[0], packet.clearColor[1], packet.clearColor[2], packet.clearColor[3]);
+                glClear(packet.clear);
+            }
+            packet.commands.Execute();
+            CommandBuffer::Execute(packet.buffers);
+        }
+
+        void RenderLoop()
+        {
+            SDL_GL_MakeCurrent(window, context);
+            GLState::Invalidate();
+            Profiler::SetThreadName("render");
+            std::unique_lock<std::mutex> guard(m_renderLock);
+            for (;;)
+            {
+                m_renderWake.wait(guard, [this]()
+                {
+                    return m_renderStop || !m_readyPackets.empty() || !m_renderTasks.empty();
+                });
+
+                while (!m_renderTasks.empty())
+                {
+                    std::function<void()> task = std::move(m_renderTasks.front());
+                    m_renderTasks.pop_front();
+                    guard.unlock();
+                    task();
+                    guard.lock();
+                    m_renderWake.notify_all();
+                }
+
+                if (m_readyPackets.empty())
+                {
+                    if (m_renderStop)
+                        break;
+                    continue;
+                }
+
+                FramePacket *packet = m_readyPackets.front();
+                m_readyPackets.pop_front();
+                guard.unlock();
+
+                long long start = Timer::GetNanoseconds();
+                DrawPacket(*packet);
+                SDL_GL_SwapWindow(window);
+                GLState::EndFrame();
+                Profiler::NewFrame();
+                m_renderTime = (Timer::GetNanoseconds() - start) * 1e-9;
+
+                guard.lock();
+                m_freePackets.push_back(packet);
+                m_renderWake.notify_all();
+            }
+            guard.unlock();
+            SDL_GL_MakeCurrent(window, nullptr);
+        }
 };
\ No newline at end of file
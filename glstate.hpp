@@ -0,0 +1,188 @@
+#pragma once
+#include "glad/glad.h"
+#include "utils.hpp"
+
+// Shadow copy of the GL bindings that Shader, Texture2D, VertexBuffer and
+// friends change, so binding what is already bound costs nothing. Every bind
+// in the engine goes through here; code that calls GL directly must call
+// Invalidate() afterwards. The element array buffer belongs to the vertex
+// array object, so it is forgotten whenever the VAO changes. Must only be
+// used from the thread that owns the context.
+
+#define GLSTATE_MAX_UNITS 32
+
+class GLState
+{
+    public:
+    static void UseProgram(GLuint program)
+    {
+        if (program == m_program) { m_skipped++; return; }
+        glUseProgram(program);
+        m_program = program;
+        m_calls++;
+    }
+
+    static void ActiveTexture(GLuint unit)
+    {
+        if (unit == m_activeUnit) { m_skipped++; return; }
+        glActiveTexture(GL_TEXTURE0 + unit);
+        m_activeUnit = unit;
+        m_calls++;
+    }
+
+    // Binds to the active unit
+    static void BindTexture(GLenum target, GLuint texture)
+    {
+        GLuint *slot = TextureSlot(target, m_activeUnit);
+        if (slot && *slot == texture) { m_skipped++; return; }
+        glBindTexture(target, texture);
+        if (slot) *slot = texture;
+        m_calls++;
+    }
+
+    // Only switches the active unit when the texture actually changes
+    static void BindTextureUnit(GLuint unit, GLenum target, GLuint texture)
+    {
+        GLuint *slot = TextureSlot(target, unit);
+        if (slot && *slot == texture) { m_skipped++; return; }
+        ActiveTexture(unit);
+        BindTexture(target, texture);
+    }
+
+    static void BindVertexArray(GLuint vao)
+    {
+        if (vao == m_vertexArray) { m_skipped++; return; }
+        glBindVertexArray(vao);
+        m_vertexArray = vao;
+        m_elementBuffer = UNKNOWN;
+        m_calls++;
+    }
+
+    static void BindBuffer(GLenum target, GLuint buffer)
+    {
+        GLuint *slot = BufferSlot(target);
+        if (slot && *slot == buffer) { m_skipped++; return; }
+        glBindBuffer(target, buffer);
+        if (slot) *slot = buffer;
+        m_calls++;
+    }
+
+    // Deleting an object unbinds it everywhere, the cache has to follow
+    static void DeleteProgram(GLuint program)
+    {
+        if (program == m_program) m_program = 0;
+        MemoryTracker::ReleaseGPU(MEMORY_GPU_SHADER, program);
+        glDeleteProgram(program);
+    }
+
+    static void DeleteTexture(GLuint texture)
+    {
+        for (int i = 0; i < GLSTATE_MAX_UNITS; i++)
+        {
+            if (m_texture2D[i] == texture) m_texture2D[i] = 0;
+            if (m_texture2DArray[i] == texture) m_texture2DArray[i] = 0;
+        }
+        MemoryTracker::ReleaseGPU(MEMORY_GPU_TEXTURE, texture);
+        glDeleteTextures(1, &texture);
+    }
+
+    static void DeleteVertexArray(GLuint vao)
+    {
+        if (vao == m_vertexArray)
+        {
+            m_vertexArray = 0;
+            m_elementBuffer = UNKNOWN;
+        }
+        glDeleteVertexArrays(1, &vao);
+    }
+
+    static void DeleteBuffer(GLuint buffer)
+    {
+        if (buffer == m_arrayBuffer) m_arrayBuffer = 0;
+        if (buffer == m_elementBuffer) m_elementBuffer = 0;
+        if (buffer == m_pixelUnpackBuffer) m_pixelUnpackBuffer = 0;
+        MemoryTracker::ReleaseGPU(MEMORY_GPU_BUFFER, buffer);
+        glDeleteBuffers(1, &buffer);
+    }
+
+    // Forget everything, e.g. after third party code touched the context
+    static void Invalidate()
+    {
+        m_program = UNKNOWN;
+        m_activeUnit = UNKNOWN;
+        m_vertexArray = UNKNOWN;
+        m_arrayBuffer = UNKNOWN;
+        m_elementBuffer = UNKNOWN;
+        m_pixelUnpackBuffer = UNKNOWN;
+        for (int i = 0; i < GLSTATE_MAX_UNITS; i++)
+        {
+            m_texture2D[i] = UNKNOWN;
+            m_texture2DArray[i] = UNKNOWN;
+        }
+    }
+
+    // Rolls the counters over; App::Swap calls this once per frame
+    static void EndFrame()
+    {
+        m_frameCalls = m_calls;
+        m_frameSkipped = m_skipped;
+        m_totalCalls += m_calls;
+        m_totalSkipped += m_skipped;
+        m_calls = 0;
+        m_skipped = 0;
+    }
+
+    // Counts for the last finished frame
+    static int GetFrameCalls() { return m_frameCalls; }
+    static int GetFrameSkipped() { return m_frameSkipped; }
+
+    static void LogStats()
+    {
+        long total = m_totalCalls + m_totalSkipped;
+        Log(0, "GLSTATE: last frame %d binds issued, %d skipped | total %ld issued, %ld skipped (%.1f%%)",
+            m_frameCalls, m_frameSkipped, m_totalCalls, m_totalSkipped,
+            total > 0 ? 100.0 * m_totalSkipped / total : 0.0);
+    }
+
+    private:
+        static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+        inline static GLuint m_program = UNKNOWN;
+        inline static GLuint m_activeUnit = UNKNOWN;
+        inline static GLuint m_vertexArray = UNKNOWN;
+        inline static GLuint m_arrayBuffer = UNKNOWN;
+        inline static GLuint m_elementBuffer = UNKNOWN;
+        inline static GLuint m_pixelUnpackBuffer = UNKNOWN;
+        inline static GLuint m_texture2D[GLSTATE_MAX_UNITS] = { UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN,
+                                                               UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN,
+                                                               UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN,
+                                                               UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN };
+        inline static GLuint m_texture2DArray[GLSTATE_MAX_UNITS] = { UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN,
+                                                                    UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN,
+                                                                    UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN,
+                                                                    UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN };
+        inline static int m_calls = 0;
+        inline static int m_skipped = 0;
+        inline static int m_frameCalls = 0;
+        inline static int m_frameSkipped = 0;
+        inline static long m_totalCalls = 0;
+        inline static long m_totalSkipped = 0;
+
+        // nullptr for targets that are not tracked; those are always issued
+        static GLuint *TextureSlot(GLenum target, GLuint unit)
+        {
+            if (unit >= GLSTATE_MAX_UNITS)
+                return nullptr;
+            if (target == GL_TEXTURE_2D) return &m_texture2D[unit];
+            if (target == GL_TEXTURE_2D_ARRAY) return &m_texture2DArray[unit];
+            return nullptr;
+        }
+
+        static GLuint *BufferSlot(GLenum target)
+        {
+            if (target == GL_ARRAY_BUFFER) return &m_arrayBuffer;
+            if (target == GL_ELEMENT_ARRAY_BUFFER) return &m_elementBuffer;
+            if (target == GL_PIXEL_UNPACK_BUFFER) return &m_pixelUnpackBuffer;
+            return nullptr;
+        }
+};
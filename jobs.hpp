@@ -0,0 +1,323 @@
+#pragma once
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <functional>
+#include "utils.hpp"
+
+
+#define MAX_JOB_THREADS     64
+
+class JobSystem;
+
+// Counts the jobs still in flight. Jobs submitted with a dependency on a counter
+// are held back until that counter drops to zero.
+struct JobCounter
+{
+    std::atomic<int> count{0};
+
+    bool Done() const
+    {
+        return count.load(std::memory_order_acquire) == 0;
+    }
+
+    private:
+        friend class JobSystem;
+        std::mutex lock;
+        std::vector<std::pair<std::function<void()>, JobCounter*>> waiting;
+};
+
+
+class JobSystem
+{
+    public:
+    JobSystem()
+    {
+        m_running = false;
+        m_pending = 0;
+        m_threads = 0;
+    }
+    ~JobSystem()
+    {
+        Shutdown();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem &operator=(const JobSystem&) = delete;
+
+    // threads = 0 uses one worker per hardware thread minus the caller
+    void Init(int threads = 0)
+    {
+        if (m_running)
+            return;
+
+        if (threads <= 0)
+        {
+            threads = (int)std::thread::hardware_concurrency() - 1;
+            if (threads < 1) threads = 1;
+        }
+        if (threads > MAX_JOB_THREADS - 1) threads = MAX_JOB_THREADS - 1;
+
+        m_threads = threads;
+        m_queues.clear();
+        for (int i = 0; i < m_threads + 1; i++)
+            m_queues.emplace_back(new WorkQueue());
+
+        m_running = true;
+        for (int i = 0; i < m_threads; i++)
+            m_workers.emplace_back(&JobSystem::WorkerLoop, this, i + 1);
+
+        Log(0, "JOBS: Started %d worker threads", m_threads);
+    }
+
+    void Shutdown()
+    {
+        if (!m_running)
+            return;
+
+        {
+            std::lock_guard<std::mutex> guard(m_sleepLock);
+            m_running = false;
+        }
+        m_wake.notify_all();
+        for (auto &worker : m_workers)
+            worker.join();
+        m_workers.clear();
+
+        // Run whatever the workers left queued (and the dependents it releases)
+        // so a later Wait() on their counters still returns
+        Job job;
+        while (Pop(GetThreadIndex(), job))
+            Execute(job);
+
+        for (auto queue : m_queues)
+            delete queue;
+        m_queues.clear();
+        Log(0, "JOBS: Stopped worker threads");
+    }
+
+    // Queues a job. If dependency is given the job starts only after it completes.
+    void Run(const std::function<void()> &job, JobCounter *counter = nullptr, JobCounter *dependency = nullptr)
+    {
+        if (counter)
+            counter->count.fetch_add(1, std::memory_order_relaxed);
+
+        if (!m_running)
+        {
+            if (dependency)
+                Wait(*dependency);
+            job();
+            Finish(counter);
+            return;
+        }
+
+        if (dependency)
+        {
+            std::lock_guard<std::mutex> guard(dependency->lock);
+            if (!dependency->Done())
+            {
+                dependency->waiting.emplace_back(job, counter);
+                return;
+            }
+        }
+        Push(Job{job, counter});
+    }
+
+    // Blocks until the counter reaches zero, running queued jobs meanwhile
+    void Wait(JobCounter &counter)
+    {
+        while (!counter.Done())
+        {
+            Job job;
+            if (m_running && Pop(GetThreadIndex(), job))
+                Execute(job);
+            else
+                std::this_thread::yield();
+        }
+        std::lock_guard<std::mutex> guard(counter.lock);
+    }
+
+    // Splits [0, count) into chunks of grain items; fn(begin, end) runs once per chunk.
+    template <typename F>
+    void ParallelFor(int count, int grain, const F &fn)
+    {
+        if (count <= 0)
+            return;
+        if (grain < 1) grain = 1;
+
+        if (!m_running || count <= grain)
+        {
+            fn(0, count);
+            return;
+        }
+
+        JobCounter counter;
+        for (int begin = 0; begin < count; begin += grain)
+        {
+            int end = (begin + grain < count) ? begin + grain : count;
+            Run([&fn, begin, end]() { fn(begin, end); }, &counter);
+        }
+        Wait(counter);
+    }
+
+    int GetWorkerCount() const
+    {
+        return m_threads;
+    }
+
+    // 0 is the thread that called Init (or any thread outside the pool), workers are 1..N
+    static int GetThreadIndex()
+    {
+        return ThreadIndex();
+    }
+
+    private:
+        struct Job
+        {
+            std::function<void()> fn;
+            JobCounter *counter = nullptr;
+        };
+
+        // Owner pushes and pops at the back, thieves take from the front. A ring
+        // rather than a deque so steady state submission does not allocate.
+        struct WorkQueue
+        {
+            std::mutex lock;
+            std::vector<Job> jobs;
+            size_t head = 0;
+            size_t count = 0;
+
+            bool Empty() const
+            {
+                return count == 0;
+            }
+
+            void PushBack(Job &&job)
+            {
+                if (count == jobs.size())
+                {
+                    std::vector<Job> grown(jobs.empty() ? 64 : jobs.size() * 2);
+                    for (size_t i = 0; i < count; i++)
+                        grown[i] = std::move(jobs[(head + i) % jobs.size()]);
+                    jobs.swap(grown);
+                    head = 0;
+                }
+                jobs[(head + count) % jobs.size()] = std::move(job);
+                count++;
+            }
+
+            void PopBack(Job &job)
+            {
+                count--;
+                job = std::move(jobs[(head + count) % jobs.size()]);
+            }
+
+            void PopFront(Job &job)
+            {
+                job = std::move(jobs[head]);
+                head = (head + 1) % jobs.size();
+                count--;
+            }
+        };
+
+        std::vector<WorkQueue*> m_queues;
+        std::vector<std::thread> m_workers;
+        std::atomic<bool> m_running;
+        std::atomic<int> m_pending;
+        std::mutex m_sleepLock;
+        std::condition_variable m_wake;
+        int m_threads;
+
+        static int &ThreadIndex()
+        {
+            static thread_local int index = 0;
+            return index;
+        }
+
+        void Push(Job &&job)
+        {
+            WorkQueue *queue = m_queues[GetThreadIndex()];
+            {
+                std::lock_guard<std::mutex> guard(queue->lock);
+                queue->PushBack(std::move(job));
+            }
+            m_pending.fetch_add(1, std::memory_order_release);
+            m_wake.notify_one();
+        }
+
+        bool Pop(int index, Job &job)
+        {
+            if (m_pending.load(std::memory_order_acquire) <= 0)
+                return false;
+
+            WorkQueue *own = m_queues[index];
+            {
+                std::lock_guard<std::mutex> guard(own->lock);
+                if (!own->Empty())
+                {
+                    own->PopBack(job);
+                    m_pending.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+
+            const int count = (int)m_queues.size();
+            for (int i = 1; i < count; i++)
+            {
+                WorkQueue *victim = m_queues[(index + i) % count];
+                std::unique_lock<std::mutex> guard(victim->lock, std::try_to_lock);
+                if (guard.owns_lock() && !victim->Empty())
+                {
+                    victim->PopFront(job);
+                    m_pending.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void Execute(Job &job)
+        {
+            job.fn();
+            Finish(job.counter);
+        }
+
+        void Finish(JobCounter *counter)
+        {
+            if (!counter)
+                return;
+
+            // Decrement under the lock so Wait() cannot return (and the counter go
+            // out of scope) while we still touch it; release its dependent jobs.
+            std::vector<std::pair<std::function<void()>, JobCounter*>> ready;
+            {
+                std::lock_guard<std::mutex> guard(counter->lock);
+                if (counter->count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    ready.swap(counter->waiting);
+            }
+            for (auto &entry : ready)
+                Push(Job{std::move(entry.first), entry.second});
+        }
+
+        void WorkerLoop(int index)
+        {
+            ThreadIndex() = index;
+            while (m_running)
+            {
+                Job job;
+                if (Pop(index, job))
+                {
+                    Execute(job);
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> guard(m_sleepLock);
+                m_wake.wait_for(guard, std::chrono::milliseconds(1), [this]()
+                {
+                    return !m_running || m_pending.load(std::memory_order_acquire) > 0;
+                });
+            }
+        }
+};
@@ -0,0 +1,286 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "glad/glad.h"
+#include "utils.hpp"
+#include "render.hpp"
+
+// KTX 1.1 and KTX 2.0 containers holding 2D textures. Block compressed data
+// (ETC2/EAC, which GLES 3.0 mandates, and ASTC) goes straight to
+// glCompressedTexImage2D; plain RGB8/RGBA8 is uploaded with glTexImage2D.
+
+static const unsigned char KTX1_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct KTX1Header
+{
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+#pragma pack(push, 1)
+struct KTX2Header
+{
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+#pragma pack(pop)
+
+struct KTX2LevelIndex
+{
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+inline uint32_t KTXSwap32(uint32_t v)
+{
+    return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+}
+
+inline bool IsCompressedFormatETC2(GLenum format)
+{
+    return format >= GL_COMPRESSED_R11_EAC && format <= GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;
+}
+
+inline bool IsCompressedFormatASTC(GLenum format)
+{
+    return (format >= GL_COMPRESSED_RGBA_ASTC_4x4 && format <= GL_COMPRESSED_RGBA_ASTC_12x12) ||
+           (format >= GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4 && format <= GL_COMPRESSED_SRGB8_ALPHA8_ASTC_12x12);
+}
+
+// Maps the Vulkan formats used by KTX2 to GL; 0 if not supported
+inline GLenum KTX2FormatToGL(uint32_t vkFormat, GLenum *uncompressed)
+{
+    *uncompressed = 0;
+    switch (vkFormat)
+    {
+        case 23:  *uncompressed = GL_RGB;  return GL_RGB;      // VK_FORMAT_R8G8B8_UNORM
+        case 37:  *uncompressed = GL_RGBA; return GL_RGBA;     // VK_FORMAT_R8G8B8A8_UNORM
+        case 147: return GL_COMPRESSED_RGB8_ETC2;
+        case 148: return GL_COMPRESSED_SRGB8_ETC2;
+        case 149: return GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+        case 150: return GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+        case 151: return GL_COMPRESSED_RGBA8_ETC2_EAC;
+        case 152: return GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;
+        case 153: return GL_COMPRESSED_R11_EAC;
+        case 154: return GL_COMPRESSED_SIGNED_R11_EAC;
+        case 155: return GL_COMPRESSED_RG11_EAC;
+        case 156: return GL_COMPRESSED_SIGNED_RG11_EAC;
+    }
+    // VK_FORMAT_ASTC_4x4_UNORM_BLOCK .. VK_FORMAT_ASTC_12x12_SRGB_BLOCK alternate UNORM/SRGB
+    if (vkFormat >= 157 && vkFormat <= 184)
+    {
+        uint32_t block = (vkFormat - 157) / 2;
+        bool srgb = ((vkFormat - 157) % 2) == 1;
+        return (srgb ? GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4 : GL_COMPRESSED_RGBA_ASTC_4x4) + block;
+    }
+    return 0;
+}
+
+inline bool CheckCompressedFormat(GLenum format, const char *fileName)
+{
+    // ETC2/EAC are core in GLES 3.0, ASTC in GLES 3.2 or via the LDR extension
+    if (IsCompressedFormatASTC(format) && !GLAD_GL_ES_VERSION_3_2 &&
+        !IsExtensionSupported("GL_KHR_texture_compression_astc_ldr"))
+    {
+        Log(2, "KTX: [%s] ASTC textures are not supported by this context", fileName);
+        return false;
+    }
+    return true;
+}
+
+// rowAlignment is the padding of uncompressed rows in the file: 4 for KTX1, 1 for
+// KTX2. Texture2D uploads tightly packed rows, so padded ones are repacked first.
+inline bool UploadKTXLevel(Texture2D &texture, int level, int levels, GLenum format, GLenum uncompressed,
+                           int w, int h, const unsigned char *data, size_t size, int rowAlignment = 1)
+{
+    if (uncompressed != 0)
+    {
+        Image image;
+        image.data = (unsigned char*)data;
+        image.width = w;
+        image.height = h;
+        image.components = (uncompressed == GL_RGBA) ? 4 : 3;
+        const size_t row = (size_t)w * image.components;
+        const size_t pitch = (row + rowAlignment - 1) / rowAlignment * rowAlignment;
+        if (pitch * (h - 1) + row > size)
+            return false;
+
+        std::vector<unsigned char> packed;
+        if (pitch != row && h > 1)
+        {
+            packed.resize(row * h);
+            for (int y = 0; y < h; y++)
+                memcpy(packed.data() + y * row, data + y * pitch, row);
+            image.data = packed.data();
+        }
+        return (level == 0) ? texture.Upload(image, levels == 1) : texture.UploadLevel(level, image);
+    }
+    return texture.UploadCompressed(level, format, w, h, data, (int)size, levels);
+}
+
+inline bool LoadKTX1(Texture2D &texture, const char *fileName, const unsigned char *data, size_t size)
+{
+    KTX1Header header;
+    if (size < 12 + sizeof(header))
+        return false;
+    memcpy(&header, data + 12, sizeof(header));
+
+    bool swap = header.endianness == 0x01020304;
+    if (swap)
+    {
+        uint32_t *fields = (uint32_t*)&header;
+        for (size_t i = 0; i < sizeof(header) / 4; i++)
+            fields[i] = KTXSwap32(fields[i]);
+    }
+    if (header.endianness != 0x04030201)
+        return false;
+
+    if (header.pixelDepth > 1 || header.numberOfArrayElements > 0 || header.numberOfFaces != 1)
+    {
+        Log(2, "KTX: [%s] Only 2D textures are supported", fileName);
+        return false;
+    }
+
+    GLenum format = header.glInternalFormat;
+    GLenum uncompressed = 0;
+    if (header.glType != 0)
+    {
+        if (header.glType != GL_UNSIGNED_BYTE || (header.glFormat != GL_RGB && header.glFormat != GL_RGBA))
+        {
+            Log(2, "KTX: [%s] Unsupported uncompressed format 0x%04X", fileName, header.glFormat);
+            return false;
+        }
+        uncompressed = header.glFormat;
+    }
+    else if (!CheckCompressedFormat(format, fileName))
+        return false;
+
+    int levels = header.numberOfMipmapLevels ? (int)header.numberOfMipmapLevels : 1;
+    size_t offset = 12 + sizeof(header) + header.bytesOfKeyValueData;
+    int w = (int)header.pixelWidth;
+    int h = header.pixelHeight ? (int)header.pixelHeight : 1;
+
+    for (int level = 0; level < levels; level++)
+    {
+        if (offset + 4 > size)
+            return false;
+        uint32_t imageSize;
+        memcpy(&imageSize, data + offset, 4);
+        if (swap) imageSize = KTXSwap32(imageSize);
+        offset += 4;
+        if (offset + imageSize > size)
+            return false;
+
+        if (!UploadKTXLevel(texture, level, levels, format, uncompressed, w, h, data + offset, imageSize, 4))
+            return false;
+
+        offset += (imageSize + 3) & ~3u;
+        w = (w > 1) ? w / 2 : 1;
+        h = (h > 1) ? h / 2 : 1;
+    }
+    return true;
+}
+
+inline bool LoadKTX2(Texture2D &texture, const char *fileName, const unsigned char *data, size_t size)
+{
+    KTX2Header header;
+    if (size < 12 + sizeof(header))
+        return false;
+    memcpy(&header, data + 12, sizeof(header));
+
+    if (header.supercompressionScheme != 0)
+    {
+        Log(2, "KTX: [%s] Supercompressed KTX2 files are not supported", fileName);
+        return false;
+    }
+    if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1)
+    {
+        Log(2, "KTX: [%s] Only 2D textures are supported", fileName);
+        return false;
+    }
+
+    GLenum uncompressed = 0;
+    GLenum format = KTX2FormatToGL(header.vkFormat, &uncompressed);
+    if (format == 0)
+    {
+        Log(2, "KTX: [%s] Unsupported vkFormat %u", fileName, header.vkFormat);
+        return false;
+    }
+    if (uncompressed == 0 && !CheckCompressedFormat(format, fileName))
+        return false;
+
+    int levels = header.levelCount ? (int)header.levelCount : 1;
+    size_t indexOffset = 12 + sizeof(header);
+    if (indexOffset + levels * sizeof(KTX2LevelIndex) > size)
+        return false;
+
+    int w = (int)header.pixelWidth;
+    int h = header.pixelHeight ? (int)header.pixelHeight : 1;
+    for (int level = 0; level < levels; level++)
+    {
+        KTX2LevelIndex index;
+        memcpy(&index, data + indexOffset + level * sizeof(KTX2LevelIndex), sizeof(index));
+        if (index.byteOffset + index.byteLength > size)
+            return false;
+
+        if (!UploadKTXLevel(texture, level, levels, format, uncompressed, w, h, data + index.byteOffset, (size_t)index.byteLength))
+            return false;
+
+        w = (w > 1) ? w / 2 : 1;
+        h = (h > 1) ? h / 2 : 1;
+    }
+    return true;
+}
+
+inline bool LoadKTX(Texture2D &texture, const std::string &file_name)
+{
+    // Level data is uploaded straight from the mapping, no intermediate copy
+    MappedFile file(file_name.c_str());
+    if (!file.IsOpen())
+        return false;
+
+    const unsigned char *fileData = file.Data();
+    size_t fileSize = file.Size();
+    bool result = false;
+    if (fileSize >= 12 && memcmp(fileData, KTX1_IDENTIFIER, 12) == 0)
+        result = LoadKTX1(texture, file_name.c_str(), fileData, fileSize);
+    else if (fileSize >= 12 && memcmp(fileData, KTX2_IDENTIFIER, 12) == 0)
+        result = LoadKTX2(texture, file_name.c_str(), fileData, fileSize);
+    else
+        Log(2, "KTX: [%s] Not a KTX file", file_name.c_str());
+
+    if (result)
+        Log(0, "KTX: [%s] Loaded %dx%d, %.2f KB video memory", file_name.c_str(),
+            texture.GetWidth(), texture.GetHeight(), texture.GetMemorySize() / 1024.0);
+    else
+        Log(2, "KTX: [%s] Failed to load texture", file_name.c_str());
+
+    return result;
+}
@@ -1277,6 +1277,56 @@ public:
 };
 
 
+// -------------------------------------------------------------------------------------------------
+// Frustum
+// -------------------------------------------------------------------------------------------------
+
+class Frustum
+{
+public:
+	Plane planes[6];	// Left, right, bottom, top, near, far
+
+	// Extracts the planes from a combined projection * view (* model) matrix
+	void buildViewFrustum( const Mat4 &viewProjMat )
+	{
+		const Vec4 r0 = viewProjMat.getRow( 0 );
+		const Vec4 r1 = viewProjMat.getRow( 1 );
+		const Vec4 r2 = viewProjMat.getRow( 2 );
+		const Vec4 r3 = viewProjMat.getRow( 3 );
+
+		planes[0] = Plane( r3.x + r0.x, r3.y + r0.y, r3.z + r0.z, r3.w + r0.w );
+		planes[1] = Plane( r3.x - r0.x, r3.y - r0.y, r3.z - r0.z, r3.w - r0.w );
+		planes[2] = Plane( r3.x + r1.x, r3.y + r1.y, r3.z + r1.z, r3.w + r1.w );
+		planes[3] = Plane( r3.x - r1.x, r3.y - r1.y, r3.z - r1.z, r3.w - r1.w );
+		planes[4] = Plane( r3.x + r2.x, r3.y + r2.y, r3.z + r2.z, r3.w + r2.w );
+		planes[5] = Plane( r3.x - r2.x, r3.y - r2.y, r3.z - r2.z, r3.w - r2.w );
+	}
+
+	// Returns true if the sphere is completely outside the frustum
+	bool cullSphere( const Vec3 &pos, float rad ) const
+	{
+		for( unsigned int i = 0; i < 6; ++i )
+		{
+			if( planes[i].distToPoint( pos ) < -rad ) return true;
+		}
+		return false;
+	}
+
+	// Returns true if the box is completely outside the frustum
+	bool cullBox( const Vec3 &mins, const Vec3 &maxs ) const
+	{
+		for( unsigned int i = 0; i < 6; ++i )
+		{
+			// Test the corner that is furthest along the plane normal
+			const Vec3 &n = planes[i].normal;
+			Vec3 p( n.x >= 0 ? maxs.x : mins.x, n.y >= 0 ? maxs.y : mins.y, n.z >= 0 ? maxs.z : mins.z );
+			if( planes[i].distToPoint( p ) < 0 ) return true;
+		}
+		return false;
+	}
+};
+
+
 // -------------------------------------------------------------------------------------------------
 // Intersection
 // -------------------------------------------------------------------------------------------------
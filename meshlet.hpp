@@ -0,0 +1,289 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include "math.hpp"
+
+#define MESHLET_MAX_VERTICES    64
+#define MESHLET_MAX_TRIANGLES   124
+
+// A small cluster of triangles with bounds for culling it as a whole. Its
+// triangles are indexCount indices at indexOffset in the builder's index list,
+// still pointing into the original vertex array.
+struct Meshlet
+{
+    Vec3  center;           // bounding sphere
+    float radius;
+    Vec3  coneApex;         // every triangle faces away from a viewer inside the cone
+    Vec3  coneAxis;
+    float coneCutoff;       // sin of the cone half angle, 1 when the normals spread too wide to cull
+    int   indexOffset;
+    int   indexCount;
+    int   vertexCount;
+};
+
+// Per frame counts from MeshletCuller::Cull
+struct MeshletStats
+{
+    int meshlets;
+    int frustumCulled;
+    int backfaceCulled;
+    long triangles;
+    long trianglesRejected;
+
+    MeshletStats() { Reset(); }
+
+    void Reset()
+    {
+        meshlets = 0;
+        frustumCulled = 0;
+        backfaceCulled = 0;
+        triangles = 0;
+        trianglesRejected = 0;
+    }
+};
+
+class MeshletBuilder
+{
+    public:
+    // Splits an indexed triangle list into meshlets of at most maxVertices
+    // unique vertices and maxTriangles triangles. Each meshlet grows from a
+    // seed triangle by adding the neighbour that brings in the fewest new
+    // vertices (nearest to the meshlet's centre on ties), so clusters stay
+    // compact and their normal cones narrow. The reordered triangles go to
+    // meshletIndices.
+    static void Build(const float *positions, size_t stride, int vertexCount, const int *indices, int indexCount,
+                      std::vector<Meshlet> &meshlets, std::vector<int> &meshletIndices,
+                      int maxVertices = MESHLET_MAX_VERTICES, int maxTriangles = MESHLET_MAX_TRIANGLES)
+    {
+        meshlets.clear();
+        meshletIndices.clear();
+        const int triangleCount = indexCount / 3;
+        if (triangleCount == 0)
+            return;
+        meshletIndices.reserve(triangleCount * 3);
+
+        // Triangles around each vertex
+        std::vector<int> adjacencyStart(vertexCount + 1, 0), adjacency(triangleCount * 3);
+        for (int i = 0; i < triangleCount * 3; i++)
+            adjacencyStart[indices[i] + 1]++;
+        for (int v = 0; v < vertexCount; v++)
+            adjacencyStart[v + 1] += adjacencyStart[v];
+        std::vector<int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (int i = 0; i < triangleCount * 3; i++)
+            adjacency[fill[indices[i]]++] = i / 3;
+
+        std::vector<unsigned char> emitted(triangleCount, 0);
+        std::vector<int> vertexMeshlet(vertexCount, -1);     // last meshlet that used the vertex
+        std::vector<int> candidates;
+        auto position = [&](int v) { return (const float*)((const char*)positions + (size_t)v * stride); };
+
+        int seed = 0;
+        while (true)
+        {
+            while (seed < triangleCount && emitted[seed])
+                seed++;
+            if (seed == triangleCount)
+                break;
+
+            Meshlet meshlet;
+            meshlet.indexOffset = (int)meshletIndices.size();
+            meshlet.indexCount = 0;
+            meshlet.vertexCount = 0;
+            const int id = (int)meshlets.size();
+            float sum[3] = { 0, 0, 0 };
+            candidates.clear();
+
+            int triangle = seed;
+            while (triangle >= 0)
+            {
+                emitted[triangle] = 1;
+                for (int k = 0; k < 3; k++)
+                {
+                    int v = indices[triangle * 3 + k];
+                    meshletIndices.push_back(v);
+                    if (vertexMeshlet[v] == id)
+                        continue;
+                    vertexMeshlet[v] = id;
+                    meshlet.vertexCount++;
+                    const float *p = position(v);
+                    sum[0] += p[0]; sum[1] += p[1]; sum[2] += p[2];
+                    for (int a = adjacencyStart[v]; a < adjacencyStart[v + 1]; a++)
+                        if (!emitted[adjacency[a]])
+                            candidates.push_back(adjacency[a]);
+                }
+                meshlet.indexCount += 3;
+                if (meshlet.indexCount / 3 >= maxTriangles)
+                    break;
+
+                // Cheapest neighbour that still fits
+                float centre[3] = { sum[0] / meshlet.vertexCount, sum[1] / meshlet.vertexCount, sum[2] / meshlet.vertexCount };
+                int best = -1, bestNew = 4;
+                float bestDistance = FLT_MAX;
+                size_t write = 0;
+                for (size_t c = 0; c < candidates.size(); c++)
+                {
+                    int t = candidates[c];
+                    if (emitted[t])
+                        continue;
+                    candidates[write++] = t;
+                    int added = 0;
+                    for (int k = 0; k < 3; k++)
+                        added += vertexMeshlet[indices[t * 3 + k]] != id;
+                    if (meshlet.vertexCount + added > maxVertices || added > bestNew)
+                        continue;
+                    const float *p = position(indices[t * 3]);
+                    float dx = p[0] - centre[0], dy = p[1] - centre[1], dz = p[2] - centre[2];
+                    float distance = dx * dx + dy * dy + dz * dz;
+                    if (added < bestNew || distance < bestDistance)
+                    {
+                        best = t;
+                        bestNew = added;
+                        bestDistance = distance;
+                    }
+                }
+                candidates.resize(write);
+                triangle = best;
+            }
+
+            ComputeBounds(meshlet, positions, stride, meshletIndices.data() + meshlet.indexOffset);
+            meshlets.push_back(meshlet);
+        }
+    }
+
+    private:
+        static void ComputeBounds(Meshlet &meshlet, const float *positions, size_t stride, const int *indices)
+        {
+            auto position = [&](int v)
+            {
+                const float *p = (const float*)((const char*)positions + (size_t)v * stride);
+                return Vec3(p[0], p[1], p[2]);
+            };
+
+            Vec3 mins(FLT_MAX, FLT_MAX, FLT_MAX), maxs(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+            for (int i = 0; i < meshlet.indexCount; i++)
+            {
+                Vec3 p = position(indices[i]);
+                mins = Vec3(std::min(mins.x, p.x), std::min(mins.y, p.y), std::min(mins.z, p.z));
+                maxs = Vec3(std::max(maxs.x, p.x), std::max(maxs.y, p.y), std::max(maxs.z, p.z));
+            }
+            meshlet.center = (mins + maxs) * 0.5f;
+            float radius = 0.0f;
+            for (int i = 0; i < meshlet.indexCount; i++)
+                radius = std::max(radius, (position(indices[i]) - meshlet.center).length());
+            meshlet.radius = radius;
+
+            // Axis is the mean of the unit normals; the cutoff comes from the widest normal
+            std::vector<Vec3> normals;
+            normals.reserve(meshlet.indexCount / 3);
+            Vec3 axis(0, 0, 0);
+            for (int i = 0; i < meshlet.indexCount; i += 3)
+            {
+                Vec3 p0 = position(indices[i]), p1 = position(indices[i + 1]), p2 = position(indices[i + 2]);
+                Vec3 normal = (p1 - p0).cross(p2 - p0);
+                float length = normal.length();
+                if (length <= 0.0f)
+                    continue;
+                normal = normal * (1.0f / length);
+                normals.push_back(normal);
+                axis = axis + normal;
+            }
+            meshlet.coneApex = meshlet.center;
+            meshlet.coneAxis = Vec3(0, 0, 0);
+            meshlet.coneCutoff = 1.0f;
+            float axisLength = axis.length();
+            if (normals.empty() || axisLength <= 0.0f)
+                return;
+            axis = axis * (1.0f / axisLength);
+
+            float minDot = 1.0f;
+            for (const Vec3 &normal : normals)
+                minDot = std::min(minDot, normal.dot(axis));
+            meshlet.coneAxis = axis;
+            if (minDot <= 0.1f)
+                return;     // close to a hemisphere or wider, always visible from somewhere in front
+
+            // Move the apex back along the axis until it is behind every triangle plane
+            float maxT = 0.0f;
+            for (int i = 0, n = 0; i < meshlet.indexCount; i += 3)
+            {
+                Vec3 p0 = position(indices[i]), p1 = position(indices[i + 1]), p2 = position(indices[i + 2]);
+                if ((p1 - p0).cross(p2 - p0).length() <= 0.0f)
+                    continue;
+                const Vec3 &normal = normals[n++];
+                float t = (meshlet.center - p0).dot(normal) / normal.dot(axis);
+                maxT = std::max(maxT, t);
+            }
+            meshlet.coneApex = meshlet.center - axis * maxT;
+            meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+        }
+};
+
+class MeshletCuller
+{
+    public:
+    // Appends the indices of the meshlets that can be visible to destination and
+    // returns the new count. frustum and camera must be in the meshlets' space,
+    // see ToModelSpace.
+    static int Cull(const std::vector<Meshlet> &meshlets, const int *meshletIndices, const Frustum &frustum,
+                    const Vec3 &camera, int *destination, int count, MeshletStats *stats = nullptr)
+    {
+        for (const Meshlet &meshlet : meshlets)
+        {
+            const int triangles = meshlet.indexCount / 3;
+            if (stats)
+            {
+                stats->meshlets++;
+                stats->triangles += triangles;
+            }
+            if (frustum.cullSphere(meshlet.center, meshlet.radius))
+            {
+                if (stats)
+                {
+                    stats->frustumCulled++;
+                    stats->trianglesRejected += triangles;
+                }
+                continue;
+            }
+            if (IsBackfacing(meshlet, camera))
+            {
+                if (stats)
+                {
+                    stats->backfaceCulled++;
+                    stats->trianglesRejected += triangles;
+                }
+                continue;
+            }
+            const int *source = meshletIndices + meshlet.indexOffset;
+            for (int i = 0; i < meshlet.indexCount; i++)
+                destination[count++] = source[i];
+        }
+        return count;
+    }
+
+    // Camera seen from the model: undoes translation, rotation and per axis
+    // scale (no shear)
+    static Vec3 ToModelSpace(const Mat4 &model, const Vec3 &position)
+    {
+        Vec3 d = position - model.getTrans();
+        Vec3 local;
+        float *out[3] = { &local.x, &local.y, &local.z };
+        for (int axis = 0; axis < 3; axis++)
+        {
+            Vec3 column(model.c[axis][0], model.c[axis][1], model.c[axis][2]);
+            float lengthSquared = column.dot(column);
+            *out[axis] = lengthSquared > 0.0f ? d.dot(column) / lengthSquared : 0.0f;
+        }
+        return local;
+    }
+
+    static bool IsBackfacing(const Meshlet &meshlet, const Vec3 &camera)
+    {
+        if (meshlet.coneCutoff >= 1.0f)
+            return false;
+        Vec3 direction = meshlet.coneApex - camera;
+        float length = direction.length();
+        return length > 0.0f && direction.dot(meshlet.coneAxis) >= meshlet.coneCutoff * length;
+    }
+};
@@ -0,0 +1,399 @@
+#pragma once
+#include <vector>
+#include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "utils.hpp"
+#include "render.hpp"
+#include "jobs.hpp"
+
+
+#define MIPCHAIN_FILE_VERSION   1
+#define MIPCHAIN_ROW_GRAIN      16          // Output rows per job
+
+enum MipFilter
+{
+    MIP_BOX,        // 2x2 average
+    MIP_KAISER      // 6x6 Kaiser windowed sinc, sharper and with less aliasing
+};
+
+struct MipLevel
+{
+    int    width;
+    int    height;
+    size_t offset;
+    size_t size;
+};
+
+// All levels of a texture, tightly packed, level 0 first
+struct MipChain
+{
+    int components = 0;
+    std::vector<MipLevel> levels;
+    std::vector<unsigned char> data;
+
+    int CountLevels() const
+    {
+        return (int)levels.size();
+    }
+
+    Image GetLevel(int level) const
+    {
+        Image image;
+        image.data = (unsigned char*)data.data() + levels[level].offset;
+        image.width = levels[level].width;
+        image.height = levels[level].height;
+        image.components = components;
+        return image;
+    }
+
+    void Layout(int width, int height, int comps)
+    {
+        components = comps;
+        levels.clear();
+        size_t offset = 0;
+        while (true)
+        {
+            MipLevel level;
+            level.width = width;
+            level.height = height;
+            level.offset = offset;
+            level.size = (size_t)width * height * comps;
+            levels.push_back(level);
+            offset += level.size;
+            if (width == 1 && height == 1)
+                break;
+            width = (width > 1) ? width / 2 : 1;
+            height = (height > 1) ? height / 2 : 1;
+        }
+        data.resize(offset);
+    }
+};
+
+
+inline const float *SRGBToLinearTable()
+{
+    static float table[256];
+    static bool init = []()
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            float c = i / 255.0f;
+            table[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return true;
+    }();
+    (void)init;
+    return table;
+}
+
+#define LINEAR_TO_SRGB_TABLE_SIZE   4096
+
+inline const unsigned char *LinearToSRGBTable()
+{
+    static unsigned char table[LINEAR_TO_SRGB_TABLE_SIZE];
+    static bool init = []()
+    {
+        for (int i = 0; i < LINEAR_TO_SRGB_TABLE_SIZE; i++)
+        {
+            float c = i / (float)(LINEAR_TO_SRGB_TABLE_SIZE - 1);
+            float s = (c <= 0.0031308f) ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+            table[i] = (unsigned char)(s * 255.0f + 0.5f);
+        }
+        return true;
+    }();
+    (void)init;
+    return table;
+}
+
+// Alpha is always filtered as-is, only color channels are linearised
+inline bool IsAlphaChannel(int channel, int components)
+{
+    return (components == 2 && channel == 1) || (components == 4 && channel == 3);
+}
+
+inline void DecodeMipRow(const unsigned char *src, float *dst, int count, int components, bool srgb)
+{
+    const float *table = SRGBToLinearTable();
+    for (int i = 0; i < count; i++)
+    {
+        int channel = i % components;
+        dst[i] = (srgb && !IsAlphaChannel(channel, components)) ? table[src[i]] : src[i] / 255.0f;
+    }
+}
+
+inline void EncodeMipRow(const float *src, unsigned char *dst, int count, int components, bool srgb)
+{
+    const unsigned char *table = LinearToSRGBTable();
+    for (int i = 0; i < count; i++)
+    {
+        float v = src[i];
+        v = (v < 0.0f) ? 0.0f : ((v > 1.0f) ? 1.0f : v);
+        int channel = i % components;
+        if (srgb && !IsAlphaChannel(channel, components))
+            dst[i] = table[(int)(v * (LINEAR_TO_SRGB_TABLE_SIZE - 1) + 0.5f)];
+        else
+            dst[i] = (unsigned char)(v * 255.0f + 0.5f);
+    }
+}
+
+inline void BoxFilterRow(const float *src, int sw, int sh, int c, float *dst, int dw, int y)
+{
+    const float *r0 = src + (size_t)(2 * y) * sw * c;
+    const float *r1 = src + (size_t)((2 * y + 1 < sh) ? 2 * y + 1 : sh - 1) * sw * c;
+
+    for (int x = 0; x < dw; x++)
+    {
+        int x0 = 2 * x * c;
+        int x1 = ((2 * x + 1 < sw) ? 2 * x + 1 : sw - 1) * c;
+#if defined(__SSE2__)
+        if (c == 4)
+        {
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(r0 + x0), _mm_loadu_ps(r0 + x1)),
+                                    _mm_add_ps(_mm_loadu_ps(r1 + x0), _mm_loadu_ps(r1 + x1)));
+            _mm_storeu_ps(dst + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+            continue;
+        }
+#endif
+        for (int k = 0; k < c; k++)
+            dst[x * c + k] = (r0[x0 + k] + r0[x1 + k] + r1[x0 + k] + r1[x1 + k]) * 0.25f;
+    }
+}
+
+#define KAISER_TAPS     6
+
+// Weights for a 2:1 reduction; taps sit at -2.5 .. 2.5 source pixels from the output center
+inline const float *KaiserWeights()
+{
+    static float weights[KAISER_TAPS];
+    static bool init = []()
+    {
+        const float alpha = 4.0f;
+        const float radius = KAISER_TAPS / 2.0f;
+        auto bessel0 = [](float x)
+        {
+            float sum = 1.0f, term = 1.0f;
+            for (int k = 1; k < 16; k++)
+            {
+                term *= (x / (2.0f * k)) * (x / (2.0f * k));
+                sum += term;
+            }
+            return sum;
+        };
+
+        float total = 0.0f;
+        for (int i = 0; i < KAISER_TAPS; i++)
+        {
+            float d = (i - KAISER_TAPS / 2) + 0.5f;
+            float x = d * 0.5f * MATH_PI;
+            float sinc = (x == 0.0f) ? 1.0f : sinf(x) / x;
+            float r = d / radius;
+            float window = bessel0(alpha * sqrtf(fmaxf(0.0f, 1.0f - r * r))) / bessel0(alpha);
+            weights[i] = sinc * window;
+            total += weights[i];
+        }
+        for (int i = 0; i < KAISER_TAPS; i++)
+            weights[i] /= total;
+        return true;
+    }();
+    (void)init;
+    return weights;
+}
+
+// Vertical pass into tmp (SIMD over the whole row), then horizontal pass into dst
+inline void KaiserFilterRow(const float *src, int sw, int sh, int c, float *dst, int dw, int y, float *tmp)
+{
+    const float *w = KaiserWeights();
+    const int count = sw * c;
+
+    const float *rows[KAISER_TAPS];
+    for (int t = 0; t < KAISER_TAPS; t++)
+    {
+        int sy = 2 * y + t - (KAISER_TAPS / 2 - 1);
+        sy = (sy < 0) ? 0 : ((sy >= sh) ? sh - 1 : sy);
+        rows[t] = src + (size_t)sy * count;
+    }
+
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for (int t = 0; t < KAISER_TAPS; t++)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[t] + i), _mm_set1_ps(w[t])));
+        _mm_storeu_ps(tmp + i, sum);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        float sum = 0.0f;
+        for (int t = 0; t < KAISER_TAPS; t++)
+            sum += rows[t][i] * w[t];
+        tmp[i] = sum;
+    }
+
+    for (int x = 0; x < dw; x++)
+    {
+        for (int k = 0; k < c; k++)
+        {
+            float sum = 0.0f;
+            for (int t = 0; t < KAISER_TAPS; t++)
+            {
+                int sx = 2 * x + t - (KAISER_TAPS / 2 - 1);
+                sx = (sx < 0) ? 0 : ((sx >= sw) ? sw - 1 : sx);
+                sum += tmp[sx * c + k] * w[t];
+            }
+            dst[x * c + k] = sum;
+        }
+    }
+}
+
+// Builds the full mip chain on the CPU. Filtering happens in linear light when
+// srgb is set; rows of every level are split across the job system if given.
+inline bool GenerateMipChain(const Image &image, MipChain &chain, MipFilter filter = MIP_BOX, bool srgb = true, JobSystem *jobs = nullptr)
+{
+    if (!image.data || image.width <= 0 || image.height <= 0 || image.components < 1 || image.components > 4)
+        return false;
+
+    const int c = image.components;
+    chain.Layout(image.width, image.height, c);
+    memcpy(chain.data.data(), image.data, chain.levels[0].size);
+
+    JobSystem local;
+    JobSystem &pool = jobs ? *jobs : local;
+
+    std::vector<float> src((size_t)image.width * image.height * c);
+    std::vector<float> dst;
+
+    pool.ParallelFor(image.height, MIPCHAIN_ROW_GRAIN, [&](int begin, int end)
+    {
+        size_t row = (size_t)image.width * c;
+        for (int y = begin; y < end; y++)
+            DecodeMipRow(image.data + y * row, src.data() + y * row, (int)row, c, srgb);
+    });
+
+    for (int level = 1; level < chain.CountLevels(); level++)
+    {
+        const MipLevel &from = chain.levels[level - 1];
+        const MipLevel &to = chain.levels[level];
+        dst.resize((size_t)to.width * to.height * c);
+        unsigned char *out = chain.data.data() + to.offset;
+
+        pool.ParallelFor(to.height, MIPCHAIN_ROW_GRAIN, [&](int begin, int end)
+        {
+            std::vector<float> tmp;
+            if (filter == MIP_KAISER)
+                tmp.resize((size_t)from.width * c);
+
+            size_t row = (size_t)to.width * c;
+            for (int y = begin; y < end; y++)
+            {
+                float *line = dst.data() + y * row;
+                if (filter == MIP_KAISER)
+                    KaiserFilterRow(src.data(), from.width, from.height, c, line, to.width, y, tmp.data());
+                else
+                    BoxFilterRow(src.data(), from.width, from.height, c, line, to.width, y);
+                EncodeMipRow(line, out + y * row, (int)row, c, srgb);
+            }
+        });
+        src.swap(dst);
+    }
+    return true;
+}
+
+struct MipChainFileHeader
+{
+    char magic[4];
+    int  version;
+    int  width;
+    int  height;
+    int  components;
+    int  levels;
+};
+
+inline bool SaveMipChain(const char *fileName, const MipChain &chain)
+{
+    if (chain.levels.empty())
+        return false;
+
+    MipChainFileHeader header;
+    memcpy(header.magic, "MIPC", 4);
+    header.version = MIPCHAIN_FILE_VERSION;
+    header.width = chain.levels[0].width;
+    header.height = chain.levels[0].height;
+    header.components = chain.components;
+    header.levels = chain.CountLevels();
+
+    std::vector<unsigned char> file(sizeof(header) + chain.data.size());
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + sizeof(header), chain.data.data(), chain.data.size());
+    return SaveFileData(fileName, file.data(), (unsigned int)file.size());
+}
+
+inline bool LoadMipChain(const char *fileName, MipChain &chain)
+{
+    MappedFile mapped(fileName);
+    if (!mapped.IsOpen())
+        return false;
+    const unsigned char *file = mapped.Data();
+    size_t bytesRead = mapped.Size();
+
+    MipChainFileHeader header;
+    bool valid = bytesRead >= sizeof(header);
+    if (valid)
+    {
+        memcpy(&header, file, sizeof(header));
+        valid = memcmp(header.magic, "MIPC", 4) == 0 && header.version == MIPCHAIN_FILE_VERSION &&
+                header.width > 0 && header.height > 0 && header.components >= 1 && header.components <= 4;
+    }
+    if (valid)
+    {
+        chain.Layout(header.width, header.height, header.components);
+        valid = chain.CountLevels() == header.levels && bytesRead == sizeof(header) + chain.data.size();
+        if (valid)
+            memcpy(chain.data.data(), file + sizeof(header), chain.data.size());
+    }
+    if (!valid)
+        Log(1, "MIPCHAIN: [%s] Invalid mip chain file", fileName);
+
+    return valid;
+}
+
+// Uploads every level explicitly, so the driver never runs glGenerateMipmap
+inline bool UploadMipChain(Texture2D &texture, const MipChain &chain)
+{
+    if (chain.levels.empty())
+        return false;
+    if (!texture.Upload(chain.GetLevel(0), false))
+        return false;
+    for (int level = 1; level < chain.CountLevels(); level++)
+        texture.UploadLevel(level, chain.GetLevel(level));
+    return true;
+}
+
+// Loads a texture with CPU generated mips, reusing "<file>.mips" when it is newer than the image
+inline bool LoadTextureMipmapped(Texture2D &texture, const std::string &file_name, JobSystem *jobs = nullptr,
+                                 MipFilter filter = MIP_BOX, bool srgb = true)
+{
+    std::string cacheName = file_name + ".mips";
+    MipChain chain;
+
+    if (FileExists(cacheName.c_str()) &&
+        GetFileModTime(cacheName.c_str()) >= GetFileModTime(file_name.c_str()) &&
+        LoadMipChain(cacheName.c_str(), chain))
+    {
+        return UploadMipChain(texture, chain);
+    }
+
+    Image image;
+    if (!LoadImage(file_name, image))
+        return false;
+    bool result = GenerateMipChain(image, chain, filter, srgb, jobs);
+    UnloadImage(image);
+    if (!result)
+        return false;
+
+    SaveMipChain(cacheName.c_str(), chain);
+    return UploadMipChain(texture, chain);
+}
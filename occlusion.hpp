@@ -0,0 +1,430 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "utils.hpp"
+#include "math.hpp"
+#include "jobs.hpp"
+#include "timer.hpp"
+#include "render.hpp"
+
+
+#define OCCLUSION_TILE_WIDTH    64
+#define OCCLUSION_TILE_HEIGHT   16
+#define OCCLUSION_NEAR_W        0.01f       // Occluders are clipped to w >= this, boxes crossing it are visible
+
+struct OcclusionStats
+{
+    int occluders;
+    int triangles;          // occluder triangles submitted
+    int rasterized;         // after clipping, back face and size rejection
+    int binned;             // triangle-tile pairs
+    int tests;
+    int occluded;
+    double setupMs;
+    double rasterMs;
+    double testMs;
+
+    OcclusionStats() { Reset(); }
+
+    void Reset()
+    {
+        occluders = 0;
+        triangles = 0;
+        rasterized = 0;
+        binned = 0;
+        tests = 0;
+        occluded = 0;
+        setupMs = 0.0;
+        rasterMs = 0.0;
+        testMs = 0.0;
+    }
+};
+
+// Software occlusion culling. A few large occluder surfaces are drawn into a
+// small depth buffer on the CPU, then object bounding boxes are checked
+// against it so hidden objects never reach the GPU.
+//
+// The buffer holds 1/w (0 is empty, larger is nearer), which is linear in
+// screen space and so is interpolated exactly by a plane equation. Triangles
+// are transformed and set up per occluder, binned into 64x16 tiles, and each
+// tile is rasterized by one job, 4 pixels at a time with SSE2 when available.
+// Every tile also keeps its farthest depth so a box behind a fully covered
+// tile is rejected without reading its pixels. Results are conservative: a box
+// is only reported hidden when every pixel it may touch is nearer.
+//
+// Per frame: BeginFrame, AddOccluder for each occluder, Rasterize, then
+// TestBox/TestBoxes.
+class OcclusionBuffer
+{
+    public:
+    OcclusionBuffer()
+    {
+        m_width = 0;
+        m_height = 0;
+        m_tilesX = 0;
+        m_tilesY = 0;
+    }
+
+    // width is rounded up to a multiple of the tile width, height to the tile height
+    void Init(int width, int height)
+    {
+        m_tilesX = (width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH;
+        m_tilesY = (height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT;
+        m_width = m_tilesX * OCCLUSION_TILE_WIDTH;
+        m_height = m_tilesY * OCCLUSION_TILE_HEIGHT;
+        m_depth.assign((size_t)m_width * m_height, 0.0f);
+        m_tileFarthest.assign(m_tilesX * m_tilesY, 0.0f);
+        m_bins.assign(m_tilesX * m_tilesY, std::vector<BinEntry>());
+        Log(0, "OCCLUSION: %dx%d depth buffer, %dx%d tiles", m_width, m_height, m_tilesX, m_tilesY);
+    }
+
+    void BeginFrame(const Mat4 &viewProjection)
+    {
+        m_viewProjection = viewProjection;
+        m_occluders.clear();
+        m_stats.Reset();
+    }
+
+    // The surface needs its CPU copy; it is read during Rasterize
+    void AddOccluder(const Surface *surface, const Mat4 &model)
+    {
+        if (!surface->HasCPUData())
+        {
+            Log(1, "OCCLUSION: occluder without CPU data ignored");
+            return;
+        }
+        m_occluders.push_back({ surface, m_viewProjection * model });
+        m_stats.occluders++;
+        m_stats.triangles += surface->CountIndices() / 3;
+    }
+
+    void Rasterize(JobSystem *jobs = nullptr)
+    {
+        PROFILE_SCOPE("OcclusionBuffer::Rasterize");
+        long long start = Timer::GetNanoseconds();
+        m_triangles.resize(m_occluders.size());
+        RunRange(jobs, (int)m_occluders.size(), 1, [this](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+                SetupOccluder(m_occluders[i], m_triangles[i]);
+        });
+        BinTriangles();
+        long long setup = Timer::GetNanoseconds();
+        m_stats.setupMs = (setup - start) * 1e-6;
+
+        RunRange(jobs, m_tilesX * m_tilesY, 1, [this](int begin, int end)
+        {
+            for (int tile = begin; tile < end; tile++)
+                RasterizeTile(tile);
+        });
+        m_stats.rasterMs = (Timer::GetNanoseconds() - setup) * 1e-6;
+    }
+
+    // World space box; true when some part of it may be visible
+    bool TestBox(const Vec3 &mins, const Vec3 &maxs) const
+    {
+        float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX, nearest = 0.0f;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            Vec4 clip = m_viewProjection * Vec4(corner & 1 ? maxs.x : mins.x, corner & 2 ? maxs.y : mins.y, corner & 4 ? maxs.z : mins.z, 1.0f);
+            if (clip.w < OCCLUSION_NEAR_W)
+                return true;
+            float inverseW = 1.0f / clip.w;
+            float x = (clip.x * inverseW * 0.5f + 0.5f) * m_width;
+            float y = (clip.y * inverseW * 0.5f + 0.5f) * m_height;
+            x0 = std::min(x0, x); x1 = std::max(x1, x);
+            y0 = std::min(y0, y); y1 = std::max(y1, y);
+            nearest = std::max(nearest, inverseW);
+        }
+
+        // Every pixel the box's rectangle touches, plus one: occluders cover a
+        // pixel when its centre is inside, so a silhouette pixel may be only
+        // partly covered and the box can show through next to it
+        if (x1 < 0.0f || y1 < 0.0f || x0 >= (float)m_width || y0 >= (float)m_height)
+            return false;       // off screen
+        int px0 = std::max((int)floorf(x0) - 1, 0), px1 = std::min((int)floorf(x1) + 1, m_width - 1);
+        int py0 = std::max((int)floorf(y0) - 1, 0), py1 = std::min((int)floorf(y1) + 1, m_height - 1);
+
+        for (int ty = py0 / OCCLUSION_TILE_HEIGHT; ty <= py1 / OCCLUSION_TILE_HEIGHT; ty++)
+            for (int tx = px0 / OCCLUSION_TILE_WIDTH; tx <= px1 / OCCLUSION_TILE_WIDTH; tx++)
+            {
+                if (nearest < m_tileFarthest[ty * m_tilesX + tx])
+                    continue;   // the whole tile is in front of the box
+                int rowBegin = std::max(py0, ty * OCCLUSION_TILE_HEIGHT), rowEnd = std::min(py1, ty * OCCLUSION_TILE_HEIGHT + OCCLUSION_TILE_HEIGHT - 1);
+                int columnBegin = std::max(px0, tx * OCCLUSION_TILE_WIDTH), columnEnd = std::min(px1, tx * OCCLUSION_TILE_WIDTH + OCCLUSION_TILE_WIDTH - 1);
+                for (int y = rowBegin; y <= rowEnd; y++)
+                    if (AnyFarther(&m_depth[(size_t)y * m_width], columnBegin, columnEnd, nearest))
+                        return true;
+            }
+        return false;
+    }
+
+    // Fills visible[i] for count boxes, split over the workers
+    void TestBoxes(const Vec3 *mins, const Vec3 *maxs, int count, unsigned char *visible, JobSystem *jobs = nullptr)
+    {
+        PROFILE_SCOPE("OcclusionBuffer::TestBoxes");
+        long long start = Timer::GetNanoseconds();
+        RunRange(jobs, count, 64, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+                visible[i] = TestBox(mins[i], maxs[i]) ? 1 : 0;
+        });
+        int occluded = 0;
+        for (int i = 0; i < count; i++)
+            occluded += visible[i] ? 0 : 1;
+        m_stats.tests += count;
+        m_stats.occluded += occluded;
+        m_stats.testMs += (Timer::GetNanoseconds() - start) * 1e-6;
+    }
+
+    const OcclusionStats &GetStats() const { return m_stats; }
+
+    void LogStats() const
+    {
+        Log(0, "OCCLUSION: %d occluders, %d of %d triangles rasterized (%d tile bins), setup %.2f ms, raster %.2f ms",
+            m_stats.occluders, m_stats.rasterized, m_stats.triangles, m_stats.binned, m_stats.setupMs, m_stats.rasterMs);
+        Log(0, "OCCLUSION: %d of %d boxes occluded, tests %.2f ms", m_stats.occluded, m_stats.tests, m_stats.testMs);
+    }
+
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+
+    // Row 0 is the bottom of the screen
+    const float *GetDepth() const { return m_depth.data(); }
+
+    private:
+        struct Occluder
+        {
+            const Surface *surface;
+            Mat4 modelViewProjection;
+        };
+
+        struct BinEntry
+        {
+            int occluder;
+            int triangle;
+        };
+
+        // Edge functions e = a*x + b*y + c (inside when all >= 0) and the 1/w plane
+        struct Triangle
+        {
+            float edgeA[3], edgeB[3], edgeC[3];
+            float depthA, depthB, depthC;
+            int minX, minY, maxX, maxY;
+        };
+
+        int m_width;
+        int m_height;
+        int m_tilesX;
+        int m_tilesY;
+        Mat4 m_viewProjection;
+        std::vector<float> m_depth;
+        std::vector<float> m_tileFarthest;
+        std::vector<Occluder> m_occluders;
+        std::vector<std::vector<Triangle>> m_triangles;     // per occluder
+        std::vector<std::vector<BinEntry>> m_bins;          // per tile
+        OcclusionStats m_stats;
+
+        template<typename F>
+        static void RunRange(JobSystem *jobs, int count, int grain, const F &fn)
+        {
+            if (jobs)
+                jobs->ParallelFor(count, grain, fn);
+            else
+                fn(0, count);
+        }
+
+        void SetupOccluder(const Occluder &occluder, std::vector<Triangle> &triangles)
+        {
+            triangles.clear();
+            const Surface &surface = *occluder.surface;
+            const int *indices = (const int*)surface.ConstIndicesData();
+            std::vector<Vec4> clip(surface.CountVertices());
+            for (int v = 0; v < surface.CountVertices(); v++)
+            {
+                const Vec3 &p = surface.GetVertex(v).pos;
+                clip[v] = occluder.modelViewProjection * Vec4(p.x, p.y, p.z, 1.0f);
+            }
+
+            for (int i = 0; i < surface.CountIndices(); i += 3)
+            {
+                Vec4 polygon[4];
+                int count = ClipNear(clip[indices[i]], clip[indices[i + 1]], clip[indices[i + 2]], polygon);
+                if (count < 3)
+                    continue;
+                float x[4], y[4], z[4];
+                for (int k = 0; k < count; k++)
+                {
+                    z[k] = 1.0f / polygon[k].w;
+                    x[k] = (polygon[k].x * z[k] * 0.5f + 0.5f) * m_width;
+                    y[k] = (polygon[k].y * z[k] * 0.5f + 0.5f) * m_height;
+                }
+                SetupTriangle(x, y, z, 0, 1, 2, triangles);
+                if (count == 4)
+                    SetupTriangle(x, y, z, 0, 2, 3, triangles);
+            }
+        }
+
+        // Cuts the triangle against w = OCCLUSION_NEAR_W, leaving 0, 3 or 4 vertices
+        static int ClipNear(const Vec4 &a, const Vec4 &b, const Vec4 &c, Vec4 *out)
+        {
+            if (a.w >= OCCLUSION_NEAR_W && b.w >= OCCLUSION_NEAR_W && c.w >= OCCLUSION_NEAR_W)
+            {
+                out[0] = a; out[1] = b; out[2] = c;
+                return 3;
+            }
+            const Vec4 *input[3] = { &a, &b, &c };
+            int count = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                const Vec4 &from = *input[k], &to = *input[(k + 1) % 3];
+                bool fromInside = from.w >= OCCLUSION_NEAR_W, toInside = to.w >= OCCLUSION_NEAR_W;
+                if (fromInside)
+                    out[count++] = from;
+                if (fromInside != toInside)
+                {
+                    float t = (OCCLUSION_NEAR_W - from.w) / (to.w - from.w);
+                    out[count++] = Vec4(from.x + (to.x - from.x) * t, from.y + (to.y - from.y) * t,
+                                        from.z + (to.z - from.z) * t, OCCLUSION_NEAR_W);
+                }
+            }
+            return count;
+        }
+
+        void SetupTriangle(const float *x, const float *y, const float *z, int i0, int i1, int i2, std::vector<Triangle> &triangles) const
+        {
+            const float x0 = x[i0], y0 = y[i0], x1 = x[i1], y1 = y[i1], x2 = x[i2], y2 = y[i2];
+            // Counter clockwise (y up) is front facing, as for GL
+            float area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+            if (area <= 0.0f)
+                return;
+
+            Triangle triangle;
+            // Pixels whose centre is inside the bounds
+            triangle.minX = std::max((int)ceilf(std::min(std::min(x0, x1), x2) - 0.5f), 0);
+            triangle.maxX = std::min((int)floorf(std::max(std::max(x0, x1), x2) - 0.5f), m_width - 1);
+            triangle.minY = std::max((int)ceilf(std::min(std::min(y0, y1), y2) - 0.5f), 0);
+            triangle.maxY = std::min((int)floorf(std::max(std::max(y0, y1), y2) - 0.5f), m_height - 1);
+            if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+                return;     // off screen or between pixel centres
+
+            const float vx[3] = { x0, x1, x2 }, vy[3] = { y0, y1, y2 };
+            for (int e = 0; e < 3; e++)
+            {
+                int n = (e + 1) % 3;
+                triangle.edgeA[e] = vy[e] - vy[n];
+                triangle.edgeB[e] = vx[n] - vx[e];
+                triangle.edgeC[e] = -(triangle.edgeA[e] * vx[e] + triangle.edgeB[e] * vy[e]);
+            }
+            // Barycentric weights from the edges opposite each vertex give the plane of z
+            const float z0 = z[i0], z1 = z[i1], z2 = z[i2];
+            const float inverseArea = 1.0f / area;
+            triangle.depthA = (triangle.edgeA[1] * z0 + triangle.edgeA[2] * z1 + triangle.edgeA[0] * z2) * inverseArea;
+            triangle.depthB = (triangle.edgeB[1] * z0 + triangle.edgeB[2] * z1 + triangle.edgeB[0] * z2) * inverseArea;
+            triangle.depthC = (triangle.edgeC[1] * z0 + triangle.edgeC[2] * z1 + triangle.edgeC[0] * z2) * inverseArea;
+            triangles.push_back(triangle);
+        }
+
+        void BinTriangles()
+        {
+            for (auto &bin : m_bins)
+                bin.clear();
+            for (size_t o = 0; o < m_triangles.size(); o++)
+            {
+                const std::vector<Triangle> &triangles = m_triangles[o];
+                m_stats.rasterized += (int)triangles.size();
+                for (size_t t = 0; t < triangles.size(); t++)
+                {
+                    const Triangle &triangle = triangles[t];
+                    for (int ty = triangle.minY / OCCLUSION_TILE_HEIGHT; ty <= triangle.maxY / OCCLUSION_TILE_HEIGHT; ty++)
+                        for (int tx = triangle.minX / OCCLUSION_TILE_WIDTH; tx <= triangle.maxX / OCCLUSION_TILE_WIDTH; tx++)
+                        {
+                            m_bins[ty * m_tilesX + tx].push_back({ (int)o, (int)t });
+                            m_stats.binned++;
+                        }
+                }
+            }
+        }
+
+        void RasterizeTile(int tile)
+        {
+            const int tileX = (tile % m_tilesX) * OCCLUSION_TILE_WIDTH, tileY = (tile / m_tilesX) * OCCLUSION_TILE_HEIGHT;
+            for (int y = tileY; y < tileY + OCCLUSION_TILE_HEIGHT; y++)
+                std::fill_n(&m_depth[(size_t)y * m_width + tileX], OCCLUSION_TILE_WIDTH, 0.0f);
+
+            for (const BinEntry &entry : m_bins[tile])
+            {
+                const Triangle &triangle = m_triangles[entry.occluder][entry.triangle];
+                int x0 = std::max(triangle.minX, tileX) & ~3;   // 4 pixel aligned for SSE
+                int x1 = std::min(triangle.maxX, tileX + OCCLUSION_TILE_WIDTH - 1);
+                int y0 = std::max(triangle.minY, tileY), y1 = std::min(triangle.maxY, tileY + OCCLUSION_TILE_HEIGHT - 1);
+                for (int y = y0; y <= y1; y++)
+                    RasterizeSpan(triangle, &m_depth[(size_t)y * m_width], x0, x1, y + 0.5f);
+            }
+
+            float farthest = FLT_MAX;
+            for (int y = tileY; y < tileY + OCCLUSION_TILE_HEIGHT; y++)
+            {
+                const float *row = &m_depth[(size_t)y * m_width + tileX];
+                for (int x = 0; x < OCCLUSION_TILE_WIDTH; x++)
+                    farthest = std::min(farthest, row[x]);
+            }
+            m_tileFarthest[tile] = farthest;
+        }
+
+        // Pixels x0..x1 of one row (x0 a multiple of 4)
+        static void RasterizeSpan(const Triangle &t, float *row, int x0, int x1, float centerY)
+        {
+            float rowE[3];
+            for (int e = 0; e < 3; e++)
+                rowE[e] = t.edgeB[e] * centerY + t.edgeC[e];
+            const float rowZ = t.depthB * centerY + t.depthC;
+            int x = x0;
+#if defined(__SSE2__)
+            const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            for (; x + 3 <= x1; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[0]), px), _mm_set1_ps(rowE[0]));
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[1]), px), _mm_set1_ps(rowE[1]));
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[2]), px), _mm_set1_ps(rowE[2]));
+                __m128 zero = _mm_setzero_ps();
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+                __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.depthA), px), _mm_set1_ps(rowZ));
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_max_ps(old, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+            }
+#endif
+            for (; x <= x1; x++)
+            {
+                float px = x + 0.5f;
+                if (t.edgeA[0] * px + rowE[0] < 0.0f || t.edgeA[1] * px + rowE[1] < 0.0f || t.edgeA[2] * px + rowE[2] < 0.0f)
+                    continue;
+                row[x] = std::max(row[x], t.depthA * px + rowZ);
+            }
+        }
+
+        // True if a pixel in x0..x1 is farther than depth (or empty)
+        static bool AnyFarther(const float *row, int x0, int x1, float depth)
+        {
+            int x = x0;
+#if defined(__SSE2__)
+            const __m128 reference = _mm_set1_ps(depth);
+            for (; x + 3 <= x1; x += 4)
+                if (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(row + x), reference)) != 0)
+                    return true;
+#endif
+            for (; x <= x1; x++)
+                if (row[x] <= depth)
+                    return true;
+            return false;
+        }
+};
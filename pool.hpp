@@ -0,0 +1,193 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <new>
+#include <utility>
+#include <stdlib.h>
+#include <stddef.h>
+#include "utils.hpp"
+
+#define GEOMETRY_POOL_MIN_SHIFT     6           // Smallest block, 64 bytes
+#define GEOMETRY_POOL_MAX_SHIFT     16          // Up to 64 KB; bigger requests go to malloc
+#define GEOMETRY_POOL_CLASSES       (1 + (GEOMETRY_POOL_MAX_SHIFT - GEOMETRY_POOL_MIN_SHIFT) * 4)
+#define GEOMETRY_POOL_SLAB_SIZE     (256*1024)
+
+// Size class allocator for geometry arrays. Block sizes step by quarter powers
+// of two (64, 80, 96, 112, 128, 160...), so under 20% is lost to rounding.
+// Blocks are carved from 256 KB slabs and recycled through a free list per
+// class, so building and dropping many small surfaces reuses the same memory
+// instead of going through malloc for every vector growth. Slabs are kept
+// until exit. Thread safe: one lock per size class.
+class GeometryPool
+{
+    public:
+    static void *Allocate(size_t size)
+    {
+        int index = GetClass(size);
+        if (index < 0)
+        {
+            m_largeBytes.fetch_add(size, std::memory_order_relaxed);
+            void *p = MemAlloc(size, MEMORY_MESH);
+            if (!p) throw std::bad_alloc();
+            return p;
+        }
+
+        SizeClass &sizeClass = Classes()[index];
+        size_t blockSize = GetClassSize(index);
+        std::lock_guard<std::mutex> guard(sizeClass.lock);
+        if (!sizeClass.free)
+            Refill(sizeClass, blockSize);
+        FreeBlock *block = sizeClass.free;
+        sizeClass.free = block->next;
+        m_pooledBytes.fetch_add(blockSize, std::memory_order_relaxed);
+        return block;
+    }
+
+    // size must be the one given to Allocate
+    static void Free(void *p, size_t size)
+    {
+        if (!p)
+            return;
+        int index = GetClass(size);
+        if (index < 0)
+        {
+            m_largeBytes.fetch_sub(size, std::memory_order_relaxed);
+            MemFree(p);
+            return;
+        }
+
+        SizeClass &sizeClass = Classes()[index];
+        size_t blockSize = GetClassSize(index);
+        std::lock_guard<std::mutex> guard(sizeClass.lock);
+        FreeBlock *block = (FreeBlock*)p;
+        block->next = sizeClass.free;
+        sizeClass.free = block;
+        m_pooledBytes.fetch_sub(blockSize, std::memory_order_relaxed);
+    }
+
+    // Bytes handed out from slabs (rounded up to the block size)
+    static size_t GetPooledBytes()
+    {
+        return m_pooledBytes.load(std::memory_order_relaxed);
+    }
+
+    // Bytes in slabs, used or free
+    static size_t GetSlabBytes()
+    {
+        return m_slabBytes.load(std::memory_order_relaxed);
+    }
+
+    // Bytes of requests too big for the pool
+    static size_t GetLargeBytes()
+    {
+        return m_largeBytes.load(std::memory_order_relaxed);
+    }
+
+    static void LogStats()
+    {
+        Log(0, "POOL: %zu KB in use of %zu KB slabs, %zu KB large blocks", GetPooledBytes() / 1024,
+            GetSlabBytes() / 1024, GetLargeBytes() / 1024);
+    }
+
+    private:
+        struct FreeBlock
+        {
+            FreeBlock *next;
+        };
+
+        struct SizeClass
+        {
+            std::mutex lock;
+            FreeBlock *free = nullptr;
+        };
+
+        inline static std::atomic<size_t> m_pooledBytes{0};
+        inline static std::atomic<size_t> m_slabBytes{0};
+        inline static std::atomic<size_t> m_largeBytes{0};
+
+        // Never destroyed, so surfaces freed by static destructors still find it
+        static SizeClass *Classes()
+        {
+            static SizeClass *classes = new SizeClass[GEOMETRY_POOL_CLASSES];
+            return classes;
+        }
+
+        // Class 0 is 64 bytes; then four classes per power of two
+        static int GetClass(size_t size)
+        {
+            if (size <= ((size_t)1 << GEOMETRY_POOL_MIN_SHIFT))
+                return 0;
+            if (size > ((size_t)1 << GEOMETRY_POOL_MAX_SHIFT))
+                return -1;
+            size_t value = size - 1;
+            int shift = 63 - __builtin_clzll((unsigned long long)value);
+            int sub = (int)(value >> (shift - 2)) & 3;
+            return 1 + (shift - GEOMETRY_POOL_MIN_SHIFT) * 4 + sub;
+        }
+
+        static size_t GetClassSize(int index)
+        {
+            if (index == 0)
+                return (size_t)1 << GEOMETRY_POOL_MIN_SHIFT;
+            int shift = GEOMETRY_POOL_MIN_SHIFT + (index - 1) / 4;
+            int sub = (index - 1) % 4;
+            return ((size_t)1 << shift) + (size_t)(sub + 1) * ((size_t)1 << (shift - 2));
+        }
+
+        // Called with the class lock held
+        static void Refill(SizeClass &sizeClass, size_t blockSize)
+        {
+            char *slab = (char*)MemAlloc(GEOMETRY_POOL_SLAB_SIZE, MEMORY_MESH);
+            if (!slab) throw std::bad_alloc();
+            m_slabBytes.fetch_add(GEOMETRY_POOL_SLAB_SIZE, std::memory_order_relaxed);
+            for (size_t offset = GEOMETRY_POOL_SLAB_SIZE; offset >= blockSize; offset -= blockSize)
+            {
+                FreeBlock *block = (FreeBlock*)(slab + offset - blockSize);
+                block->next = sizeClass.free;
+                sizeClass.free = block;
+            }
+        }
+};
+
+// STL allocator on GeometryPool
+template<typename T>
+class PoolAllocator
+{
+    public:
+    typedef T value_type;
+
+    PoolAllocator() {}
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T *allocate(size_t count)
+    {
+        return (T*)GeometryPool::Allocate(count * sizeof(T));
+    }
+    void deallocate(T *p, size_t count)
+    {
+        GeometryPool::Free(p, count * sizeof(T));
+    }
+
+    // Default initialization: resize() leaves ints and floats unset, like
+    // new T[n], so arrays about to be overwritten are not zeroed first
+    template<typename U>
+    void construct(U *p)
+    {
+        ::new((void*)p) U;
+    }
+    template<typename U, typename... Args>
+    void construct(U *p, Args&&... args)
+    {
+        ::new((void*)p) U(std::forward<Args>(args)...);
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U>&) const { return true; }
+    template<typename U>
+    bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
+
+template<typename T>
+using GeometryVector = std::vector<T, PoolAllocator<T>>;
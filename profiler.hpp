@@ -0,0 +1,336 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <stdio.h>
+#include "glad/glad.h"
+#include "utils.hpp"
+#include "timer.hpp"
+#include "jobs.hpp"
+
+// CPU zones (PROFILE_SCOPE) from any thread and GPU zones (PROFILE_GPU_SCOPE)
+// on the GL thread, kept in a ring buffer covering the last few hundred
+// frames and exported as Chrome trace JSON (chrome://tracing, Perfetto).
+// Zone names must be string literals. Recording costs one branch while the
+// profiler is disabled; build with PROFILER_ENABLED 0 to compile zones out.
+
+#ifndef PROFILER_ENABLED
+    #define PROFILER_ENABLED 1
+#endif
+
+#define PROFILER_CAPACITY       (1 << 16)
+#define PROFILER_GPU_QUERIES    64
+#define PROFILER_GPU_THREAD     1000
+
+#ifndef GL_TIME_ELAPSED_EXT
+    #define GL_TIME_ELAPSED_EXT 0x88BF
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+    #define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+typedef void (APIENTRYP PFNGLGETQUERYOBJECTUI64VEXTPROC)(GLuint id, GLenum pname, GLuint64 *params);
+
+struct ProfileEvent
+{
+    const char *name;
+    long long start;        // Timer::GetNanoseconds()
+    long long duration;
+    int thread;             // PROFILER_GPU_THREAD for GPU zones
+    int frame;
+};
+
+class Profiler
+{
+    public:
+    static void Enable(bool enabled)
+    {
+        m_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    static bool IsEnabled()
+    {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    // GL thread, after the context is current. False when the driver has no
+    // GL_EXT_disjoint_timer_query; GPU zones are then ignored.
+    static bool InitGPU()
+    {
+        m_gpuSupported = false;
+        if (!SDL_GL_ExtensionSupported("GL_EXT_disjoint_timer_query"))
+        {
+            Log(1, "PROFILER: GL_EXT_disjoint_timer_query not available, GPU zones disabled");
+            return false;
+        }
+        m_getQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VEXTPROC)SDL_GL_GetProcAddress("glGetQueryObjectui64vEXT");
+        if (!m_getQueryObjectui64v)
+            return false;
+
+        m_queries.resize(PROFILER_GPU_QUERIES);
+        glGenQueries(PROFILER_GPU_QUERIES, m_queries.data());
+        m_freeQueries = m_queries;
+        m_gpuSupported = true;
+        Log(0, "PROFILER: GPU timer queries enabled");
+        return true;
+    }
+
+    // GL thread, before the context goes away
+    static void ShutdownGPU()
+    {
+        if (!m_queries.empty())
+            glDeleteQueries((GLsizei)m_queries.size(), m_queries.data());
+        m_queries.clear();
+        m_freeQueries.clear();
+        m_pendingGpu.clear();
+        m_gpuSupported = false;
+    }
+
+    // Names the calling thread in the exported trace
+    static void SetThreadName(const char *name)
+    {
+        int id = GetThreadId();
+        std::lock_guard<std::mutex> guard(m_threadLock);
+        if ((int)m_threadNames.size() <= id)
+            m_threadNames.resize(id + 1);
+        m_threadNames[id] = name;
+    }
+
+    static void Record(const char *name, long long start, long long duration, int thread)
+    {
+        unsigned int index = m_head.fetch_add(1, std::memory_order_relaxed);
+        ProfileEvent &event = m_events[index % PROFILER_CAPACITY];
+        event.name = name;
+        event.start = start;
+        event.duration = duration;
+        event.thread = thread;
+        event.frame = m_frame.load(std::memory_order_relaxed);
+    }
+
+    // GL thread, once per frame (App::Swap): closes the frame zone and
+    // collects GPU results that have arrived, without waiting for any
+    static void NewFrame()
+    {
+        long long now = Timer::GetNanoseconds();
+        if (IsEnabled() && m_frameStart != 0)
+            Record("Frame", m_frameStart, now - m_frameStart, GetThreadId());
+        m_frameStart = now;
+        m_frame.fetch_add(1, std::memory_order_relaxed);
+
+        if (!m_gpuSupported || m_pendingGpu.empty())
+            return;
+
+        GLint disjoint = 0;
+        glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+        size_t done = 0;
+        for (; done < m_pendingGpu.size(); done++)
+        {
+            GpuZone &zone = m_pendingGpu[done];
+            GLuint available = 0;
+            glGetQueryObjectuiv(zone.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 elapsed = 0;
+            m_getQueryObjectui64v(zone.query, GL_QUERY_RESULT, &elapsed);
+            if (!disjoint)
+            {
+                unsigned int index = m_head.fetch_add(1, std::memory_order_relaxed);
+                m_events[index % PROFILER_CAPACITY] = { zone.name, zone.start, (long long)elapsed, PROFILER_GPU_THREAD, zone.frame };
+            }
+            m_freeQueries.push_back(zone.query);
+        }
+        m_pendingGpu.erase(m_pendingGpu.begin(), m_pendingGpu.begin() + done);
+    }
+
+    static bool BeginGPU(const char *name)
+    {
+        if (!m_gpuSupported || m_gpuActive || m_freeQueries.empty() || !IsEnabled())
+            return false;
+        GpuZone zone = { m_freeQueries.back(), name, Timer::GetNanoseconds(), m_frame.load(std::memory_order_relaxed) };
+        m_freeQueries.pop_back();
+        glBeginQuery(GL_TIME_ELAPSED_EXT, zone.query);
+        m_pendingGpu.push_back(zone);
+        m_gpuActive = true;
+        return true;
+    }
+
+    static void EndGPU()
+    {
+        glEndQuery(GL_TIME_ELAPSED_EXT);
+        m_gpuActive = false;
+    }
+
+    // Writes every event still in the ring. Call between frames; zones that
+    // close while exporting may be cut.
+    static bool ExportChromeTrace(const std::string &file_name)
+    {
+        FILE *file = fopen(file_name.c_str(), "w");
+        if (!file)
+        {
+            Log(2, "PROFILER: [%s] Failed to open file", file_name.c_str());
+            return false;
+        }
+
+        std::vector<ProfileEvent> events = Snapshot();
+        long long origin = events.empty() ? 0 : events.front().start;
+        for (const ProfileEvent &event : events)
+            origin = std::min(origin, event.start);
+
+        fprintf(file, "{\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"GPU\"}}", PROFILER_GPU_THREAD);
+        {
+            std::lock_guard<std::mutex> guard(m_threadLock);
+            for (int i = 0; i < (int)m_threadNames.size(); i++)
+                if (!m_threadNames[i].empty())
+                    fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                            i, m_threadNames[i].c_str());
+        }
+        for (const ProfileEvent &event : events)
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%d}}",
+                    event.name, event.thread, (event.start - origin) / 1000.0, event.duration / 1000.0, event.frame);
+        fprintf(file, "\n]}\n");
+        fclose(file);
+
+        Log(0, "PROFILER: [%s] Exported %d events", file_name.c_str(), (int)events.size());
+        return true;
+    }
+
+    // Total time and calls per zone in the last finished frame
+    static void LogFrame()
+    {
+        int frame = m_frame.load(std::memory_order_relaxed) - 1;
+        struct Total { const char *name; int thread; long long time; int calls; };
+        std::vector<Total> totals;
+        for (const ProfileEvent &event : Snapshot())
+        {
+            if (event.frame != frame)
+                continue;
+            auto it = std::find_if(totals.begin(), totals.end(), [&event](const Total &total)
+            {
+                return total.name == event.name && (total.thread == PROFILER_GPU_THREAD) == (event.thread == PROFILER_GPU_THREAD);
+            });
+            if (it == totals.end())
+                totals.push_back({ event.name, event.thread, event.duration, 1 });
+            else
+            {
+                it->time += event.duration;
+                it->calls++;
+            }
+        }
+        std::sort(totals.begin(), totals.end(), [](const Total &a, const Total &b) { return a.time > b.time; });
+        Log(0, "PROFILER: frame %d", frame);
+        for (const Total &total : totals)
+            Log(0, "PROFILER:   %-4s %-28s %9.3f ms %6d calls", total.thread == PROFILER_GPU_THREAD ? "gpu" : "cpu",
+                total.name, total.time / 1e6, total.calls);
+    }
+
+    static int GetThreadId()
+    {
+        static std::atomic<int> next{0};
+        thread_local int id = -1;
+        if (id < 0)
+        {
+            id = next.fetch_add(1);
+            int worker = JobSystem::GetThreadIndex();
+            std::lock_guard<std::mutex> guard(m_threadLock);
+            if ((int)m_threadNames.size() <= id)
+                m_threadNames.resize(id + 1);
+            if (m_threadNames[id].empty())
+                m_threadNames[id] = worker > 0 ? "worker " + std::to_string(worker) : "thread " + std::to_string(id);
+        }
+        return id;
+    }
+
+    private:
+        struct GpuZone
+        {
+            GLuint query;
+            const char *name;
+            long long start;
+            int frame;
+        };
+
+        inline static std::atomic<bool> m_enabled{true};
+        inline static std::atomic<unsigned int> m_head{0};
+        inline static std::atomic<int> m_frame{0};
+        inline static ProfileEvent m_events[PROFILER_CAPACITY];
+        inline static long long m_frameStart = 0;
+        inline static std::mutex m_threadLock;
+        inline static std::vector<std::string> m_threadNames;
+
+        // GL thread only
+        inline static bool m_gpuSupported = false;
+        inline static bool m_gpuActive = false;
+        inline static std::vector<GLuint> m_queries;
+        inline static std::vector<GLuint> m_freeQueries;
+        inline static std::vector<GpuZone> m_pendingGpu;
+        inline static PFNGLGETQUERYOBJECTUI64VEXTPROC m_getQueryObjectui64v = nullptr;
+
+        // Oldest first
+        static std::vector<ProfileEvent> Snapshot()
+        {
+            unsigned int head = m_head.load(std::memory_order_acquire);
+            unsigned int count = std::min(head, (unsigned int)PROFILER_CAPACITY);
+            std::vector<ProfileEvent> events;
+            events.reserve(count);
+            for (unsigned int i = head - count; i != head; i++)
+                events.push_back(m_events[i % PROFILER_CAPACITY]);
+            return events;
+        }
+};
+
+class ProfileScope
+{
+    public:
+    explicit ProfileScope(const char *name)
+    {
+        m_name = Profiler::IsEnabled() ? name : nullptr;
+        if (m_name)
+            m_start = Timer::GetNanoseconds();
+    }
+    ~ProfileScope()
+    {
+        if (m_name)
+            Profiler::Record(m_name, m_start, Timer::GetNanoseconds() - m_start, Profiler::GetThreadId());
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope &operator=(const ProfileScope&) = delete;
+
+    private:
+        const char *m_name;
+        long long m_start = 0;
+};
+
+// GL timer queries do not nest: a GPU zone inside another one is skipped
+class ProfileGpuScope
+{
+    public:
+    explicit ProfileGpuScope(const char *name)
+    {
+        m_active = Profiler::BeginGPU(name);
+    }
+    ~ProfileGpuScope()
+    {
+        if (m_active)
+            Profiler::EndGPU();
+    }
+    ProfileGpuScope(const ProfileGpuScope&) = delete;
+    ProfileGpuScope &operator=(const ProfileGpuScope&) = delete;
+
+    private:
+        bool m_active;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if PROFILER_ENABLED
+    #define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+    #define PROFILE_GPU_SCOPE(name) ProfileGpuScope PROFILE_CONCAT(profileGpuScope, __LINE__)(name)
+#else
+    #define PROFILE_SCOPE(name)
+    #define PROFILE_GPU_SCOPE(name)
+#endif
@@ -5,9 +5,21 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
 #include "glad/glad.h"
 #include "utils.hpp"
 #include "math.hpp"
+#include "jobs.hpp"
+#include "glstate.hpp"
+#include "profiler.hpp"
+#include "pool.hpp"
+#include "simplify.hpp"
+#include "meshlet.hpp"
 #include "stb_image.h" 
 
 
@@ -229,87 +241,957 @@ struct Color
 	}
 };
 
+struct Image
+{
+    unsigned char *data = nullptr;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+};
+
+// Decodes an image file to 8 bit pixels, flipped for OpenGL. Safe to call from worker threads.
+inline bool LoadImage(const std::string &file_name, Image &image)
+{
+    MappedFile file(file_name.c_str());
+    if (!file.IsOpen())
+        return false;
+
+    stbi_set_flip_vertically_on_load_thread(1);
+    image.data = stbi_load_from_memory(file.Data(), (int)file.Size(), &image.width, &image.height, &image.components, STBI_default);
+
+    if (image.data == nullptr)
+    {
+        Log(2, "Failed to load image: %s", file_name.c_str());
+        return false;
+    }
+    MemoryTracker::Add(MEMORY_TEXTURE, (size_t)image.width * image.height * image.components);
+    return true;
+}
+
+// Reads the size and component count of an image file without decoding it
+inline bool GetImageInfo(const std::string &file_name, Image &image)
+{
+    MappedFile file(file_name.c_str());
+    if (!file.IsOpen())
+        return false;
+    image.data = nullptr;
+    return stbi_info_from_memory(file.Data(), (int)file.Size(), &image.width, &image.height, &image.components) != 0;
+}
+
+// Like LoadImage, but decodes into a caller owned buffer (e.g. a mapped pixel
+// unpack buffer) of at least width * height * components bytes. image.data
+// points at buffer on success and must not be passed to UnloadImage.
+inline bool LoadImageInto(const std::string &file_name, unsigned char *buffer, size_t capacity, Image &image)
+{
+    MappedFile file(file_name.c_str());
+    if (!file.IsOpen())
+        return false;
+
+    stbi_set_flip_vertically_on_load_thread(1);
+    image.data = stbi_load_from_memory_into(file.Data(), (int)file.Size(), buffer, capacity,
+                                            &image.width, &image.height, &image.components, STBI_default);
+    if (image.data == nullptr)
+    {
+        Log(2, "Failed to load image: %s (%s)", file_name.c_str(), stbi_failure_reason());
+        return false;
+    }
+    return true;
+}
+
+// Decodes a batch of files with one job per image, so a JPEG or PNG that
+// stb_image decodes on a single thread still overlaps with the others.
+// Returns how many loaded; failed entries are left empty.
+inline int LoadImages(const std::vector<std::string> &files, std::vector<Image> &images, JobSystem *jobs)
+{
+    images.assign(files.size(), Image());
+    std::atomic<int> loaded(0);
+    auto decode = [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+            if (LoadImage(files[i], images[i]))
+                loaded++;
+    };
+    if (jobs)
+        jobs->ParallelFor((int)files.size(), 1, decode);
+    else
+        decode(0, (int)files.size());
+    return loaded;
+}
+
+inline void UnloadImage(Image &image)
+{
+    if (image.data)
+    {
+        MemoryTracker::Remove(MEMORY_TEXTURE, (size_t)image.width * image.height * image.components);
+        stbi_image_free(image.data);
+    }
+    image.data = nullptr;
+}
+
+inline bool IsExtensionSupported(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+inline GLenum GetImageFormat(int components)
+{
+    switch (components)
+    {
+        case STBI_grey:       return GL_RED;
+        case STBI_grey_alpha: return GL_RG;
+        case STBI_rgb:        return GL_RGB;
+        case STBI_rgb_alpha:  return GL_RGBA;
+    }
+    return 0;
+}
+
+class Texture2D;
+class TextureUploadQueue;
+
+struct TextureRequest
+{
+    std::string fileName;
+    Image       image;
+    Texture2D  *texture = nullptr;  // cleared if the texture is destroyed first (GL thread only)
+    bool        failed = false;
+    int         pixelBuffer = -1;   // PixelBufferPool slot the worker decodes into, -1 for heap
+};
+
+
 class Texture2D
 {
     public:
     Texture2D()
     {
+        id = 0;
+        width = 0;
+        height = 0;
+        components = 0;
+        bytes = 0;
+    }
+    Texture2D(const Texture2D&) = delete;
+    Texture2D &operator=(const Texture2D&) = delete;
 
+    Texture2D(Texture2D &&other)
+    {
+        id = 0;
+        *this = std::move(other);
+    }
+    Texture2D &operator=(Texture2D &&other)
+    {
+        if (this == &other)
+            return *this;
+        if (m_request)
+            m_request->texture = nullptr;
+        if (id != 0)
+            GLState::DeleteTexture(id);
+
+        id = other.id;
+        width = other.width;
+        height = other.height;
+        components = other.components;
+        bytes = other.bytes;
+        m_request = std::move(other.m_request);
+        if (m_request)
+            m_request->texture = this;
+
+        other.id = 0;
+        other.width = 0;
+        other.height = 0;
+        other.components = 0;
+        other.bytes = 0;
+        return *this;
     }
+
     ~Texture2D()
     {
+         if (m_request)
+            m_request->texture = nullptr;
          if (id != 0) 
          {
-           glDeleteTextures(1, &id);
+           GLState::DeleteTexture(id);
            Log(0, "TEXTURE2D: [ID %i] Unload Opengl Texture2D", id);
         }
     }
     bool Load(const std::string &file_name)
     {
-        unsigned int bytesRead;
-       unsigned char *fileData =  LoadFileData(file_name.c_str(),&bytesRead);
-       if(!fileData)
+        PROFILE_SCOPE("Texture2D::Load");
+        Image image;
+        if (!LoadImage(file_name, image))
             return false;
 
-      stbi_set_flip_vertically_on_load(1);
-      unsigned char *data =  stbi_load_from_memory(fileData,bytesRead,&width, &height, &components, STBI_default);
-      
-      //unsigned char *data = stbi_load(file_name.c_str(), &width, &height, &components, STBI_default);
-      if (data == nullptr) 
-      {
-         Log(2,"Failed to load image: %s",file_name.c_str());
-         return false;
-      }
-
-      GLenum format;
-      switch (components) 
-      {
-         case STBI_grey:
-            format = GL_RED;
-            break;
-         case STBI_grey_alpha:
-            format = GL_RG;
-            break;
-         case STBI_rgb:
-            format = GL_RGB;
-            break;
-         case STBI_rgb_alpha:
-            format = GL_RGBA;
-            break;
-         default:
-            stbi_image_free(data);
+        bool result = Upload(image);
+        UnloadImage(image);
+        return result;
+    }
+
+    // Returns at once with a placeholder texture; the file is decoded on a worker
+    // and uploaded later by queue.Process() on the GL thread.
+    bool LoadAsync(const std::string &file_name, JobSystem &jobs, TextureUploadQueue &queue);
+
+    // (Re)specifies the texture from decoded pixels, keeping the same GL id.
+    // Pass mipmaps = false when the levels are supplied with UploadLevel().
+    bool Upload(const Image &image, bool mipmaps = true)
+    {
+        GLenum format = GetImageFormat(image.components);
+        if (format == 0)
             return false;
-      }
 
-        glGenTextures(1, &id);
-        glBindTexture(GL_TEXTURE_2D, id);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        bool created = BeginUpload();
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+        EndUpload(image, mipmaps, created);
+        return true;
+    }
+
+    // Same as Upload, but the pixels are read from offset 0 of a pixel unpack
+    // buffer, so the call returns without the driver copying client memory.
+    bool UploadFromBuffer(GLuint buffer, const Image &image, bool mipmaps = true)
+    {
+        GLenum format = GetImageFormat(image.components);
+        if (format == 0 || buffer == 0)
+            return false;
+
+        bool created = BeginUpload();
+        if (image.width != width || image.height != height || image.components != components)
+            glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+        GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, format, GL_UNSIGNED_BYTE, (const void*)0);
+        GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        EndUpload(image, mipmaps, created);
+        return true;
+    }
+
+    bool UploadLevel(int level, const Image &image)
+    {
+        GLenum format = GetImageFormat(image.components);
+        if (format == 0 || id == 0)
+            return false;
+
+        GLState::BindTexture(GL_TEXTURE_2D, id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, level, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+        GLState::BindTexture(GL_TEXTURE_2D, 0);
+        bytes += (size_t)image.width * image.height * image.components;
+        MemoryTracker::SetGPUSize(MEMORY_GPU_TEXTURE, id, bytes);
+        return true;
+    }
+
+    // Uploads one level of block compressed data (ETC2/EAC, ASTC). Level 0 (re)creates
+    // the texture; levels must then be given in order so the filter can be chosen.
+    bool UploadCompressed(int level, GLenum format, int w, int h, const void *data, int size, int levels = 1)
+    {
+        if (level == 0)
+        {
+            bool created = (id == 0);
+            if (created)
+                glGenTextures(1, &id);
+            GLState::BindTexture(GL_TEXTURE_2D, id);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+            width = w;
+            height = h;
+            components = 4;
+            bytes = 0;
+            if (created)
+                Log(0, "TEXTURE2D: [ID %i] Create compressed Opengl Texture2D (0x%04X)", id, format);
+        }
+        else if (id == 0)
+            return false;
+        else
+            GLState::BindTexture(GL_TEXTURE_2D, id);
 
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, format, w, h, 0, size, data);
+        GLState::BindTexture(GL_TEXTURE_2D, 0);
+        bytes += size;
+        MemoryTracker::SetGPUSize(MEMORY_GPU_TEXTURE, id, bytes);
+        return glGetError() == GL_NO_ERROR;
+    }
 
-        glBindTexture(GL_TEXTURE_2D, 0);
-        Log(0, "TEXTURE2D: [ID %i] Create Opengl Texture2D", id);
-        free(fileData);
-        stbi_image_free(data);
+    // False while an async load is still pending
+    bool IsReady() const
+    {
+        return !m_request;
     }
 
     void Bind(UINT unit) 
     {
-        glActiveTexture(GL_TEXTURE0 + unit);
-        glBindTexture(GL_TEXTURE_2D, id);
+        GLState::BindTextureUnit(unit, GL_TEXTURE_2D, id);
+    }
+
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+    UINT GetID() const { return id; }
+
+    // Video memory used by the uploaded levels
+    size_t GetMemorySize() const
+    {
+        return bytes;
     }
 
     private:
+        friend class TextureUploadQueue;
         UINT id;   
         int width;          
         int height;         
         int components;         
+        size_t bytes;
+        std::shared_ptr<TextureRequest> m_request;
+
+        bool BeginUpload()
+        {
+            bool created = (id == 0);
+            if (created)
+                glGenTextures(1, &id);
+            GLState::BindTexture(GL_TEXTURE_2D, id);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            return created;
+        }
+
+        void EndUpload(const Image &image, bool mipmaps, bool created)
+        {
+            if (mipmaps)
+                glGenerateMipmap(GL_TEXTURE_2D);
+
+            GLState::BindTexture(GL_TEXTURE_2D, 0);
+            width = image.width;
+            height = image.height;
+            components = image.components;
+            bytes = (size_t)width * height * components;
+            if (mipmaps)
+                bytes = bytes * 4 / 3;
+            MemoryTracker::SetGPUSize(MEMORY_GPU_TEXTURE, id, bytes);
+            if (created)
+                Log(0, "TEXTURE2D: [ID %i] Create Opengl Texture2D", id);
+        }
+
+        void CreatePlaceholder()
+        {
+            // 2x2 grey checker shown until the real pixels arrive
+            static const unsigned char pixels[] = { 160, 160, 160, 96, 96, 96, 96, 96, 96, 160, 160, 160 };
+            Image image;
+            image.data = (unsigned char*)pixels;
+            image.width = 2;
+            image.height = 2;
+            image.components = 3;
+            Upload(image);
+        }
+};
+
+// Fixed pool of pixel unpack buffers for streaming texture uploads. A slot is
+// mapped on the GL thread, filled by a worker, then unmapped and consumed by
+// glTexSubImage2D; a fence keeps it out of the pool until the GPU is done.
+class PixelBufferPool
+{
+    public:
+    PixelBufferPool()
+    {
+        m_size = 0;
+    }
+    ~PixelBufferPool()
+    {
+        Destroy();
+    }
+    PixelBufferPool(const PixelBufferPool&) = delete;
+    PixelBufferPool &operator=(const PixelBufferPool&) = delete;
+
+    bool Create(int count, size_t bytesPerBuffer)
+    {
+        Destroy();
+        m_size = bytesPerBuffer;
+        m_slots.resize(count);
+        for (Slot &slot : m_slots)
+        {
+            glGenBuffers(1, &slot.buffer);
+            GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)bytesPerBuffer, nullptr, GL_STREAM_DRAW);
+            MemoryTracker::SetGPUSize(MEMORY_GPU_BUFFER, slot.buffer, bytesPerBuffer);
+        }
+        GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        Log(0, "PBO: Created %d pixel buffers of %.1f MB", count, bytesPerBuffer / (1024.0 * 1024.0));
+        return glGetError() == GL_NO_ERROR;
+    }
+
+    void Destroy()
+    {
+        for (Slot &slot : m_slots)
+        {
+            if (slot.mapped)
+            {
+                GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+            if (slot.fence)
+                glDeleteSync(slot.fence);
+            GLState::DeleteBuffer(slot.buffer);
+        }
+        GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        m_slots.clear();
+        m_size = 0;
+    }
+
+    // GL thread. Maps a free buffer for writing; returns its slot or -1 when
+    // the request is too big or every buffer is still in use.
+    int Acquire(size_t bytes, unsigned char **data)
+    {
+        *data = nullptr;
+        if (bytes > m_size)
+            return -1;
+
+        for (int i = 0; i < (int)m_slots.size(); i++)
+        {
+            Slot &slot = m_slots[i];
+            if (slot.busy)
+                continue;
+            if (slot.fence)
+            {
+                if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                    continue;
+                glDeleteSync(slot.fence);
+                slot.fence = 0;
+            }
+
+            GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+            void *pointer = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)bytes,
+                                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            if (!pointer)
+                return -1;
+
+            slot.busy = true;
+            slot.mapped = true;
+            *data = (unsigned char*)pointer;
+            return i;
+        }
+        return -1;
+    }
+
+    // GL thread, once the worker is done writing. False if the contents were lost.
+    bool Unmap(int index)
+    {
+        Slot &slot = m_slots[index];
+        if (!slot.mapped)
+            return true;
+        GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        GLboolean intact = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        slot.mapped = false;
+        return intact == GL_TRUE;
+    }
+
+    // GL thread, after the commands reading the buffer were issued
+    void Release(int index)
+    {
+        Unmap(index);
+        Slot &slot = m_slots[index];
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.busy = false;
+    }
+
+    GLuint GetBuffer(int index) const { return m_slots[index].buffer; }
+    size_t GetBufferSize() const { return m_size; }
+    int GetCount() const { return (int)m_slots.size(); }
+
+    private:
+        struct Slot
+        {
+            GLuint buffer = 0;
+            GLsync fence = 0;
+            bool busy = false;
+            bool mapped = false;
+        };
+        std::vector<Slot> m_slots;
+        size_t m_size;
 };
 
+// Decoded images waiting for their GL upload. Workers push, the GL thread drains
+// a bounded amount per frame so big loads never stall a single frame.
+class TextureUploadQueue
+{
+    public:
+    TextureUploadQueue()
+    {
+        m_maxBytes = 16 * 1024 * 1024;
+        m_maxMs = 2.0;
+        m_pixelBuffers = nullptr;
+        m_outstanding = 0;
+    }
+    ~TextureUploadQueue()
+    {
+        // Decode jobs still running would Push into a destroyed queue
+        std::unique_lock<std::mutex> guard(m_lock);
+        m_drained.wait(guard, [this]() { return m_outstanding == 0; });
+        for (auto &request : m_ready)
+            Finish(*request);
+    }
+
+    // Workers decode straight into mapped buffers from this pool when one is
+    // free; the pool must outlive the queue. nullptr goes back to heap images.
+    void SetPixelBuffers(PixelBufferPool *pool)
+    {
+        m_pixelBuffers = pool;
+    }
+    PixelBufferPool *GetPixelBuffers() const
+    {
+        return m_pixelBuffers;
+    }
+
+    // 0 disables the limit; at least one texture is uploaded per Process() call
+    void SetBudget(size_t bytesPerFrame, double msPerFrame)
+    {
+        m_maxBytes = bytesPerFrame;
+        m_maxMs = msPerFrame;
+    }
+
+    // Called before a decode job is queued; the job's Push balances it
+    void Expect()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_outstanding++;
+    }
+
+    void Push(const std::shared_ptr<TextureRequest> &request)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_ready.push_back(request);
+        if (m_outstanding > 0 && --m_outstanding == 0)
+            m_drained.notify_all();
+    }
+
+    int Pending()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        return (int)m_ready.size();
+    }
+
+    // Call once per frame on the GL thread; returns the number of textures uploaded
+    int Process()
+    {
+        const Uint64 start = SDL_GetPerformanceCounter();
+        const double frequency = (double)SDL_GetPerformanceFrequency();
+        size_t bytes = 0;
+        int count = 0;
+
+        while (true)
+        {
+            std::shared_ptr<TextureRequest> request;
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                if (m_ready.empty())
+                    break;
+                if (count > 0)
+                {
+                    double elapsed = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+                    if (m_maxMs > 0.0 && elapsed >= m_maxMs) break;
+                    if (m_maxBytes > 0 && bytes >= m_maxBytes) break;
+                }
+                request = m_ready.front();
+                m_ready.pop_front();
+            }
+
+            Texture2D *texture = request->texture;
+            if (request->pixelBuffer >= 0 && !m_pixelBuffers->Unmap(request->pixelBuffer))
+                request->failed = true;
+            if (texture)
+            {
+                if (!request->failed)
+                {
+                    if (request->pixelBuffer >= 0)
+                        texture->UploadFromBuffer(m_pixelBuffers->GetBuffer(request->pixelBuffer), request->image);
+                    else
+                        texture->Upload(request->image);
+                    bytes += (size_t)request->image.width * request->image.height * request->image.components;
+                    count++;
+                }
+                texture->m_request.reset();
+            }
+            Finish(*request);
+        }
+        return count;
+    }
+
+    private:
+        std::mutex m_lock;
+        std::deque<std::shared_ptr<TextureRequest>> m_ready;
+        std::condition_variable m_drained;
+        int m_outstanding;
+        size_t m_maxBytes;
+        double m_maxMs;
+        PixelBufferPool *m_pixelBuffers;
+
+        void Finish(TextureRequest &request)
+        {
+            if (request.pixelBuffer >= 0)
+            {
+                // the pixels live in the buffer, there is nothing to free
+                m_pixelBuffers->Release(request.pixelBuffer);
+                request.pixelBuffer = -1;
+                request.image.data = nullptr;
+            }
+            UnloadImage(request.image);
+        }
+};
+
+typedef std::shared_ptr<Texture2D> TextureHandle;
+
+// Shares textures by canonical path. Handles are ref counted; textures no
+// longer referenced outside the cache are evicted LRU-first once the
+// resident size goes over the budget.
+class TextureCache
+{
+    public:
+    TextureCache()
+    {
+        m_budget = 256 * 1024 * 1024;
+        m_jobs = nullptr;
+        m_queue = nullptr;
+        m_hits = 0;
+        m_misses = 0;
+        m_evictions = 0;
+    }
+    ~TextureCache()
+    {
+        Clear();
+    }
+
+    // 0 disables eviction
+    void SetBudget(size_t bytes)
+    {
+        m_budget = bytes;
+        Trim();
+    }
+
+    // When set, misses are loaded with Texture2D::LoadAsync instead of Load
+    void SetAsync(JobSystem *jobs, TextureUploadQueue *queue)
+    {
+        m_jobs = jobs;
+        m_queue = queue;
+    }
+
+    TextureHandle Get(const std::string &file_name)
+    {
+        std::string key = GetCanonicalPath(file_name.c_str());
+
+        auto it = m_entries.find(key);
+        if (it != m_entries.end())
+        {
+            m_hits++;
+            m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+            return it->second.texture;
+        }
+
+        m_misses++;
+        TextureHandle texture = std::make_shared<Texture2D>();
+        bool loaded = (m_jobs && m_queue) ? texture->LoadAsync(file_name, *m_jobs, *m_queue)
+                                          : texture->Load(file_name);
+        if (!loaded)
+            return TextureHandle();
+
+        m_lru.push_front(key);
+        Entry entry;
+        entry.texture = texture;
+        entry.lru = m_lru.begin();
+        m_entries[key] = entry;
+
+        Trim();
+        return texture;
+    }
+
+    // Evicts unreferenced textures, least recently used first, until under budget
+    void Trim()
+    {
+        if (m_budget == 0)
+            return;
+
+        size_t resident = GetResidentBytes();
+        auto it = m_lru.end();
+        while (resident > m_budget && it != m_lru.begin())
+        {
+            --it;
+            auto entry = m_entries.find(*it);
+            if (entry->second.texture.use_count() > 1)
+                continue;
+
+            resident -= entry->second.texture->GetMemorySize();
+            m_entries.erase(entry);
+            it = m_lru.erase(it);
+            m_evictions++;
+        }
+    }
+
+    void Clear()
+    {
+        m_entries.clear();
+        m_lru.clear();
+    }
+
+    size_t GetResidentBytes() const
+    {
+        size_t bytes = 0;
+        for (auto &entry : m_entries)
+            bytes += entry.second.texture->GetMemorySize();
+        return bytes;
+    }
+
+    int GetHits() const { return m_hits; }
+    int GetMisses() const { return m_misses; }
+    int GetEvictions() const { return m_evictions; }
+    int GetCount() const { return (int)m_entries.size(); }
+
+    void LogStats() const
+    {
+        Log(0, "TEXCACHE: %d textures  %.2f MB resident (budget %.2f MB)  hits %d  misses %d  evictions %d",
+            GetCount(), GetResidentBytes() / (1024.0 * 1024.0), m_budget / (1024.0 * 1024.0),
+            m_hits, m_misses, m_evictions);
+    }
+
+    private:
+        struct Entry
+        {
+            TextureHandle texture;
+            std::list<std::string>::iterator lru;
+        };
+
+        std::map<std::string, Entry> m_entries;
+        std::list<std::string> m_lru;  // front is most recently used
+        size_t m_budget;
+        JobSystem *m_jobs;
+        TextureUploadQueue *m_queue;
+        int m_hits;
+        int m_misses;
+        int m_evictions;
+};
+
+// GL_TEXTURE_2D_ARRAY of equally sized RGBA layers. Materials keep a layer
+// index instead of a texture, so draws that only differ by texture can be
+// merged into one instanced draw with the layer passed per instance.
+class Texture2DArray
+{
+    public:
+    Texture2DArray()
+    {
+        id = 0;
+        width = 0;
+        height = 0;
+        layers = 0;
+        levels = 0;
+        m_dirty = false;
+    }
+    Texture2DArray(const Texture2DArray&) = delete;
+    Texture2DArray &operator=(const Texture2DArray&) = delete;
+
+    ~Texture2DArray()
+    {
+        if (id != 0)
+        {
+            GLState::DeleteTexture(id);
+            Log(0, "TEXTURE2DARRAY: [ID %i] Unload Opengl Texture2DArray", id);
+        }
+    }
+
+    // Allocates immutable storage for every layer (and the full mip chain)
+    bool Create(int w, int h, int layerCount, bool mipmaps = true)
+    {
+        if (id != 0)
+            GLState::DeleteTexture(id);
+
+        width = w;
+        height = h;
+        layers = layerCount;
+        levels = 1;
+        if (mipmaps)
+            while ((std::max(w, h) >> levels) > 0)
+                levels++;
+
+        glGenTextures(1, &id);
+        GLState::BindTexture(GL_TEXTURE_2D_ARRAY, id);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, width, height, layers);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        GLState::BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        m_free.clear();
+        for (int i = layers - 1; i >= 0; i--)
+            m_free.push_back(i);
+        m_dirty = false;
+
+        size_t bytes = 0;
+        for (int level = 0; level < levels; level++)
+            bytes += (size_t)std::max(width >> level, 1) * std::max(height >> level, 1) * 4 * layers;
+        MemoryTracker::SetGPUSize(MEMORY_GPU_TEXTURE, id, bytes);
+
+        Log(0, "TEXTURE2DARRAY: [ID %i] Create %dx%d with %d layers", id, width, height, layers);
+        return glGetError() == GL_NO_ERROR;
+    }
+
+    // Returns a free layer, or -1 when the array is full
+    int AllocateLayer()
+    {
+        if (m_free.empty())
+            return -1;
+        int layer = m_free.back();
+        m_free.pop_back();
+        return layer;
+    }
+
+    void FreeLayer(int layer)
+    {
+        if (layer >= 0 && layer < layers)
+            m_free.push_back(layer);
+    }
+
+    // The image must match the array size; RGB and grey images are expanded to RGBA
+    bool UploadLayer(int layer, const Image &image)
+    {
+        if (id == 0 || layer < 0 || layer >= layers || image.data == nullptr)
+            return false;
+        if (image.width != width || image.height != height)
+        {
+            Log(2, "TEXTURE2DARRAY: [ID %i] Layer image is %dx%d, expected %dx%d", id, image.width, image.height, width, height);
+            return false;
+        }
+
+        const unsigned char *pixels = image.data;
+        std::vector<unsigned char> expanded;
+        if (image.components != 4)
+        {
+            expanded.resize((size_t)width * height * 4);
+            for (size_t i = 0; i < (size_t)width * height; i++)
+            {
+                const unsigned char *src = image.data + i * image.components;
+                unsigned char *dst = &expanded[i * 4];
+                dst[0] = src[0];
+                dst[1] = image.components >= 3 ? src[1] : src[0];
+                dst[2] = image.components >= 3 ? src[2] : src[0];
+                dst[3] = image.components == 2 ? src[1] : 255;
+            }
+            pixels = expanded.data();
+        }
+
+        GLState::BindTexture(GL_TEXTURE_2D_ARRAY, id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        GLState::BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        m_dirty = true;
+        return true;
+    }
+
+    // AllocateLayer + UploadLayer; returns the layer or -1
+    int AddLayer(const Image &image)
+    {
+        int layer = AllocateLayer();
+        if (layer >= 0 && !UploadLayer(layer, image))
+        {
+            FreeLayer(layer);
+            return -1;
+        }
+        return layer;
+    }
+
+    int AddLayer(const std::string &file_name)
+    {
+        Image image;
+        if (!LoadImage(file_name, image))
+            return -1;
+        int layer = AddLayer(image);
+        UnloadImage(image);
+        return layer;
+    }
+
+    // Rebuilds the mip chain once after a batch of uploads
+    void GenerateMipmaps()
+    {
+        if (!m_dirty || levels <= 1)
+            return;
+        GLState::BindTexture(GL_TEXTURE_2D_ARRAY, id);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        GLState::BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        m_dirty = false;
+    }
+
+    void Bind(UINT unit)
+    {
+        GLState::BindTextureUnit(unit, GL_TEXTURE_2D_ARRAY, id);
+    }
+
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+    int GetLayerCount() const { return layers; }
+    int GetFreeLayers() const { return (int)m_free.size(); }
+    UINT GetID() const { return id; }
+
+    size_t GetMemorySize() const
+    {
+        size_t total = 0;
+        for (int level = 0; level < levels; level++)
+            total += (size_t)std::max(width >> level, 1) * std::max(height >> level, 1) * 4;
+        return total * layers;
+    }
+
+    private:
+        UINT id;
+        int width;
+        int height;
+        int layers;
+        int levels;
+        bool m_dirty;
+        std::vector<int> m_free;
+};
+
+inline bool Texture2D::LoadAsync(const std::string &file_name, JobSystem &jobs, TextureUploadQueue &queue)
+{
+    if (m_request)
+        m_request->texture = nullptr;
+
+    if (id == 0)
+        CreatePlaceholder();
+
+    std::shared_ptr<TextureRequest> request = std::make_shared<TextureRequest>();
+    request->fileName = file_name;
+    request->texture = this;
+    m_request = request;
+
+    // Reserve a mapped pixel buffer up front (mapping is GL thread only) so the
+    // worker can decode straight into it
+    unsigned char *buffer = nullptr;
+    size_t capacity = 0;
+    PixelBufferPool *pool = queue.GetPixelBuffers();
+    Image info;
+    if (pool && GetImageInfo(file_name, info))
+    {
+        capacity = (size_t)info.width * info.height * info.components;
+        request->pixelBuffer = pool->Acquire(capacity, &buffer);
+    }
+
+    TextureUploadQueue *target = &queue;
+    queue.Expect();
+    jobs.Run([request, target, buffer, capacity]()
+    {
+        if (buffer)
+            request->failed = !LoadImageInto(request->fileName, buffer, capacity, request->image);
+        else
+            request->failed = !LoadImage(request->fileName, request->image);
+        target->Push(request);
+    });
+    return true;
+}
+
 struct Vertex
 {
 	Vec3  pos;
@@ -324,6 +1206,14 @@ struct Vertex
 		: pos(pos), normal(normal), color(color), coord(tcoords) {}
 };
 
+// Per instance attributes read by Surface::RenderInstanced: the model matrix in
+// locations 4-7 and a Texture2DArray layer in location 8.
+struct InstanceData
+{
+    Mat4  model;
+    float layer = 0.0f;
+};
+
 class Shader
 {
     public:
@@ -333,8 +1223,18 @@ class Shader
     }
     ~Shader()
     {
-        glDeleteProgram(m_program);
+        Release();
+    }
+
+    // Frees the program so create() can be called again
+    void Release()
+    {
+        if (m_program == 0)
+            return;
+        GLState::DeleteProgram(m_program);
         Log(0, "SHADER: [ID %i] Unloaded shader program", m_program);
+        m_program = 0;
+        m_uniforms.clear();
     }
     
     bool operator ==(const Shader&      other) const { return m_program == other.m_program; }
@@ -366,78 +1266,118 @@ class Shader
 
         if (m_program>0)
             Log(0, "SHADER: [ID %i] Create shader program.", m_program);
+        if (MEMORY_TRACKING && m_program > 0)
+        {
+            // The closest thing GL reports to what the driver keeps per program
+            GLint binaryLength = 0;
+            glGetProgramiv(m_program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+            MemoryTracker::SetGPUSize(MEMORY_GPU_SHADER, m_program, (size_t)binaryLength);
+        }
         
         glDeleteShader(vertex);
         glDeleteShader(fragment);
         Bind();
         return true;
     }
-    
-    void Bind() 
+    
+    void Bind() 
+    { 
+        GLState::UseProgram(m_program);
+    }
+    void unBind() 
+    { 
+        GLState::UseProgram(0);
+    }
+    // The const char* setters take string literals without building a std::string
+    void setBool(const char *name, bool value) const
+    {         
+        glUniform1i(glGetUniformLocation(m_program, name), (int)value); 
+    }
+    void setInt(const char *name, int value) const
+    { 
+        glUniform1i(glGetUniformLocation(m_program, name), value); 
+    }
+    void setFloat(const char *name, float value) const
     { 
-        glUseProgram(m_program); 
+        glUniform1f(glGetUniformLocation(m_program, name), value); 
     }
-    void unBind() 
+    void setFloat4(const char *name, float x,float y, float z,float w) const
+    { 
+        glUniform4f(glGetUniformLocation(m_program, name), x,y,z,w); 
+    }
+    void setFloat3(const char *name, float x,float y, float z) const
+    { 
+        glUniform3f(glGetUniformLocation(m_program, name), x,y,z); 
+    }
+    void setVector3(const char *name, const Vec3 &v) const
     { 
-        glUseProgram(0); 
+        glUniform3f(glGetUniformLocation(m_program, name), v.x,v.y,v.z); 
     }
+    void setFloat2(const char *name, float x,float y) const
+    { 
+        glUniform2f(glGetUniformLocation(m_program, name), x,y); 
+    }
+    void setMatrix(const char *name, const GLfloat *value, GLboolean transpose = GL_FALSE) const
+    { 
+        glUniformMatrix4fv(glGetUniformLocation(m_program, name), 1 , transpose,value); 
+    }
+    void setMatrix4(const char *name, const Mat4 &mat, GLboolean transpose = GL_FALSE) const
+    { 
+       setMatrix(name, mat.x, transpose); 
+    }
+
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(m_program, name.c_str()), (int)value); 
+        setBool(name.c_str(), value); 
     }
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(m_program, name.c_str()), value); 
+        setInt(name.c_str(), value); 
     }
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(m_program, name.c_str()), value); 
+        setFloat(name.c_str(), value); 
     }
     void setFloat4(const std::string &name, float x,float y, float z,float w) const
     { 
-        glUniform4f(glGetUniformLocation(m_program, name.c_str()), x,y,z,w); 
+        setFloat4(name.c_str(), x,y,z,w); 
     }
     void setFloat3(const std::string &name, float x,float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(m_program, name.c_str()), x,y,z); 
+        setFloat3(name.c_str(), x,y,z); 
     }
     void setVector3(const std::string &name, const Vec3 &v) const
     { 
-        glUniform3f(glGetUniformLocation(m_program, name.c_str()), v.x,v.y,v.z); 
+        setVector3(name.c_str(), v); 
     }
     void setFloat2(const std::string &name, float x,float y) const
     { 
-        glUniform2f(glGetUniformLocation(m_program, name.c_str()), x,y); 
+        setFloat2(name.c_str(), x,y); 
     }
     
     void setMatrix(const std::string &name, const GLfloat *value, GLboolean transpose = GL_FALSE) const
     { 
-        glUniformMatrix4fv(glGetUniformLocation(m_program, name.c_str()), 1 , transpose,value); 
+        setMatrix(name.c_str(), value, transpose); 
     }
-    void setMatrix4(const std::string &name, Mat4 mat, GLboolean transpose = GL_FALSE) const
+    void setMatrix4(const std::string &name, const Mat4 &mat, GLboolean transpose = GL_FALSE) const
     { 
-       setMatrix(name, mat.x, transpose); 
+       setMatrix(name.c_str(), mat.x, transpose); 
     }
     
-    bool findUniform(const std::string name)const
+    bool findUniform(const char *name)const
     {
-        std::map<std::string, int>::const_iterator it = m_uniforms.begin();
-        while(it != m_uniforms.end())
-        {
-            if (strcmp(it->first.c_str(),name.c_str())==0)
-            {
-            return true;
-            }
-            it++;
-        }
-        return false;
+        return getUniform(name) != -1;
+    }
+    bool findUniform(const std::string &name)const
+    {
+        return findUniform(name.c_str());
     }
-    int  getUniform(const std::string name)const
+    int  getUniform(const char *name)const
     {
         std::map<std::string, int>::const_iterator it = m_uniforms.begin();
         while(it != m_uniforms.end())
         {
-            if (strcmp(it->first.c_str(),name.c_str())==0)
+            if (strcmp(it->first.c_str(),name)==0)
             {
             return it->second;
             }
@@ -446,16 +1386,24 @@ class Shader
         }
          return -1;
     }
-    int getUniformLocation(const std::string &uniformName) const
+    int  getUniform(const std::string &name)const
+    {
+        return getUniform(name.c_str());
+    }
+    int getUniformLocation(const char *uniformName) const
     {
         int location = -1;
         location =getUniform(uniformName);//uniforms[uniformName];
         if (location == -1)
-            Log(2, "SHADER: [ID %i] Failed to find shader uniform: %s", m_program, uniformName.c_str());
+            Log(2, "SHADER: [ID %i] Failed to find shader uniform: %s", m_program, uniformName);
 
     //  else SDL_Log( "SHADER: [ID %i] IShader uniform (%s) set at location: %i", id, uniformName, location);
         return location;
     }
+    int getUniformLocation(const std::string &uniformName) const
+    {
+        return getUniformLocation(uniformName.c_str());
+    }
 
     int getAttribLocation( const std::string &attribName) const
     {
@@ -601,35 +1549,34 @@ class VertexBuffer
         {
            
             glGenVertexArrays(1, &m_vao);
-            glBindVertexArray(m_vao);
+            GLState::BindVertexArray(m_vao);
             Log(0, "VAO: [ID %i] Create vertex array", m_vao);
         }
 
         ~VertexBuffer()
         {
-         glBindVertexArray(0);
-         glDeleteVertexArrays(1, &m_vao);
+         GLState::DeleteVertexArray(m_vao);
          Log(0, "VAO: [ID %i] Unloaded vertex array", m_vao);
         for (auto id: m_vbs)
         {
-                glDeleteBuffers(1, &id);
+                GLState::DeleteBuffer(id);
             Log(0, "VAO: [ID %i] Unloaded vertex data ", id);
         }
         }
 
         void Bind()
         {
-            glBindVertexArray(m_vao);
+            GLState::BindVertexArray(m_vao);
         }
         void Bind(int index)
         {
-            glBindVertexArray(m_vao);
+            GLState::BindVertexArray(m_vao);
         }
         void unBind()
         {
-            glBindVertexArray(0);
-            glBindBuffer(GL_ARRAY_BUFFER, 0); 
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+            GLState::BindVertexArray(0);
+            GLState::BindBuffer(GL_ARRAY_BUFFER, 0);
+            GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
         }
         
         void DrawArrays(int mode,int offset, int count)
@@ -644,15 +1591,23 @@ class VertexBuffer
 
         void UpdateBuffer(int bufferId, void *data, int dataSize, int offset)
         {
-            glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+            GLState::BindBuffer(GL_ARRAY_BUFFER, bufferId);
             glBufferSubData(GL_ARRAY_BUFFER, offset, dataSize, data);
         }
+        // The element binding belongs to the VAO, so it is bound first
+        void UpdateElementBuffer(int bufferId, void *data, int dataSize, int offset)
+        {
+            GLState::BindVertexArray(m_vao);
+            GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferId);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, dataSize, data);
+        }
         UINT LoadBuffer(void *buffer, int size, bool dynamic = false)
         {
             UINT id = 0;
             glGenBuffers(1, &id);
-            glBindBuffer(GL_ARRAY_BUFFER, id);
+            GLState::BindBuffer(GL_ARRAY_BUFFER, id);
             glBufferData(GL_ARRAY_BUFFER, size, buffer, dynamic? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+            MemoryTracker::SetGPUSize(MEMORY_GPU_BUFFER, id, size);
             Log(0, "VBO: [ID %i] Load vertex data ", id);
             m_vbs.push_back(id);
             return id;
@@ -661,8 +1616,9 @@ class VertexBuffer
         {
             UINT id = 0;
             glGenBuffers(1, &id);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
+            GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
             glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, buffer, dynamic? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+            MemoryTracker::SetGPUSize(MEMORY_GPU_BUFFER, id, size);
             Log(0, "VBO: [ID %i] Load vertex index data ", id);
             m_vbs.push_back(id);
             return id;
@@ -677,6 +1633,17 @@ class VertexBuffer
             glEnableVertexAttribArray(index);
 
         }
+        void SetVertexAttributeDivisor(UINT index, UINT divisor)
+        {
+            glVertexAttribDivisor(index, divisor);
+        }
+        // Respecifies the whole store of a buffer made by LoadBuffer, keeping its id
+        void ReloadBuffer(UINT id, void *buffer, int size, bool dynamic = false)
+        {
+            GLState::BindBuffer(GL_ARRAY_BUFFER, id);
+            glBufferData(GL_ARRAY_BUFFER, size, buffer, dynamic? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+            MemoryTracker::SetGPUSize(MEMORY_GPU_BUFFER, id, size);
+        }
         
     private:
             UINT m_vao;
@@ -685,12 +1652,22 @@ class VertexBuffer
 };
 
 
+// Geometry with a CPU copy in pooled vectors. The GL objects are created by
+// Build(), so surfaces can be filled on any thread and uploaded on the GL one.
 class Surface
 {
 private:
- std::vector<Vertex> vertices;
- std::vector<int>    indices;
+ GeometryVector<Vertex> vertices;
+ GeometryVector<int>    indices;
  VertexBuffer        *buffer;
+int  m_builtVertices;
+int  m_builtIndices;
+bool m_cpuReleased;
+UINT m_vertexBufferId;
+UINT m_indexBufferId;
+int  m_streamedIndices;
+UINT m_instanceBufferId;
+int  m_instanceCapacity;
 UINT m_iVertexCount;
 UINT m_iCountVertexDeclaration;
 UINT m_iVertexOffSetSize;// size of Vertex
@@ -700,10 +1677,18 @@ std::vector<VertexDeclaration> m_VertexDeclaration;
 public:
     Surface(long fvf=0)
     {
-        Log(0,"Create Surface");
-        buffer = new VertexBuffer();
+        buffer = nullptr;
+        m_builtVertices = 0;
+        m_builtIndices = 0;
+        m_cpuReleased = false;
+        m_vertexBufferId = 0;
+        m_indexBufferId = 0;
+        m_streamedIndices = -1;
+        m_instanceBufferId = 0;
+        m_instanceCapacity = 0;
         m_FVF = fvf;
         int sstride =  FVFDecodeLength(m_FVF);
+        m_VertexDeclaration.reserve(5);
 
 
 
@@ -796,14 +1781,12 @@ public:
         for (int i=0; i<m_iCountVertexDeclaration;i++)
         {
            m_iVertexOffSetSize += getTypeSize(m_VertexDeclaration[i].type) ;
-           SDL_Log("layer %d %d  %d %d",i,getTypeSize(m_VertexDeclaration[i].type) ,m_iVertexOffSetSize,sizeof(Vertex));
         }
 
     }
     ~Surface()
     {
         delete buffer;
-        Log(0,"Free Surface");
     }
 
     void* VertexData()
@@ -883,6 +1866,50 @@ public:
         return (int)vertices.size() -1;
     }
     
+    // Sizes the CPU arrays up front so adding does not reallocate
+    void Reserve(int vertexCount, int indexCount)
+    {
+        vertices.reserve(vertexCount);
+        indices.reserve(indexCount);
+    }
+
+    // Appends count vertices; returns the index of the first one
+    int AddVertices(const Vertex *data, int count)
+    {
+        int first = (int)vertices.size();
+        vertices.insert(vertices.end(), data, data + count);
+        return first;
+    }
+
+    // Appends triangleCount triangles (3 indices each), offset by baseVertex,
+    // e.g. the value AddVertices returned; returns the position of the first index
+    int AddTriangles(const int *data, int triangleCount, int baseVertex = 0)
+    {
+        size_t first = indices.size();
+        indices.resize(first + triangleCount * 3);
+        int *out = indices.data() + first;
+        for (int i = 0; i < triangleCount * 3; i++)
+            out[i] = data[i] + baseVertex;
+        return (int)first;
+    }
+
+    // Grows the vertex array by count and returns the new slots, for
+    // generators that write in place (from several threads if they like)
+    Vertex *AppendVertices(int count)
+    {
+        size_t first = vertices.size();
+        vertices.resize(first + count);
+        return vertices.data() + first;
+    }
+
+    // Same for indices; the values are used as they are written
+    int *AppendIndices(int count)
+    {
+        size_t first = indices.size();
+        indices.resize(first + count);
+        return indices.data() + first;
+    }
+
     int AddIndice(int i)
     {
         indices.push_back(i);
@@ -897,25 +1924,49 @@ public:
     }
     void VertexNormal(int index, float x, float y ,float z)
     {
-        if (index < 0 || index > CountVertices())
+        if (index < 0 || index >= (int)vertices.size())
             return;
         vertices[index].normal.set(x,y,z);
     }
     void VertexTexCoords(int index , float x, float y)
    {
-        if (index < 0 || index > CountVertices())
+        if (index < 0 || index >= (int)vertices.size())
             return;
         vertices[index].coord.set(x,y);
     }
 
+    const Vertex &GetVertex(int index) const
+    {
+        return vertices[index];
+    }
+
+    // After ReleaseCPUData() these are the uploaded counts
     int CountVertices() const
     {
-        return (int)vertices.size();
+        return m_cpuReleased ? m_builtVertices : (int)vertices.size();
     }
 
     int CountIndices() const
     {
-        return (int)indices.size();
+        return m_cpuReleased ? m_builtIndices : (int)indices.size();
+    }
+
+    bool HasCPUData() const
+    {
+        return !m_cpuReleased;
+    }
+
+    // Frees the CPU copy once it is on the GPU; GetVertex and Update can no longer be used
+    void ReleaseCPUData()
+    {
+        if (!buffer)
+        {
+            Log(1, "SURFACE: ReleaseCPUData before Build, keeping the data");
+            return;
+        }
+        GeometryVector<Vertex>().swap(vertices);
+        GeometryVector<int>().swap(indices);
+        m_cpuReleased = true;
     }
     		
     int  GetPrimitiveCount(UINT  mode) const
@@ -934,29 +1985,38 @@ public:
         return 0;
     }
     
-    void Build()
+    // Uploads to the GPU; must run on the GL thread. releaseCPUData drops the CPU copy after.
+    void Build(bool releaseCPUData = false)
     {
-        buffer->LoadBufferElement(IndicesData(),CountIndices() * sizeof(int), false);
-        buffer->LoadBuffer(VertexData(),CountVertices()*sizeof(Vertex));
-
-
-
-int offSet = 0;
+        if (m_cpuReleased)
+        {
+            Log(1, "SURFACE: Build after ReleaseCPUData ignored");
+            return;
+        }
+        if (!buffer)
+            buffer = new VertexBuffer();
+        else
+            buffer->Bind();
+        m_builtVertices = (int)vertices.size();
+        m_builtIndices = (int)indices.size();
+        m_streamedIndices = -1;
+        m_indexBufferId = buffer->LoadBufferElement(IndicesData(),CountIndices() * sizeof(int), false);
+        m_vertexBufferId = buffer->LoadBuffer(VertexData(),CountVertices()*sizeof(Vertex));
 
 
 
 for (int i=0; i<m_iCountVertexDeclaration;i++)
 {
 
+    // The buffer always holds Vertex structs, so each attribute is found by its
+    // field offset and enabled at its fixed location, whatever the FVF order
     int attribute = i;
-    buffer->EnableVertexAttribute(attribute);
-
-    void* pointer = reinterpret_cast<void*>(offSet);
 
      if( m_VertexDeclaration[i].element & VF_POSITION )
      {
       Log(0,"set position %d",attribute);
-      buffer->SetVertexAttribute(0, getTypeCount(m_VertexDeclaration[i].type), getTypeFormat(m_VertexDeclaration[i].type), false, m_iVertexOffSetSize, pointer);
+      buffer->EnableVertexAttribute(0);
+      buffer->SetVertexAttribute(0, getTypeCount(m_VertexDeclaration[i].type), getTypeFormat(m_VertexDeclaration[i].type), false, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex,pos)));
      }
 
     if( m_VertexDeclaration[i].element & VF_TEXCOORD1 )
@@ -964,6 +2024,7 @@ for (int i=0; i<m_iCountVertexDeclaration;i++)
         Log(0,"set uv  %d",attribute);
         //  buffer->SetVertexAttribute(1, 2, GL_FLOAT, GL_FALSE, m_iVertexOffSetSize, pointer);
        // buffer->SetVertexAttribute(1, 2, GL_FLOAT,  false,m_iVertexOffSetSize, pointer);
+      buffer->EnableVertexAttribute(1);
       buffer->SetVertexAttribute(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex,coord)));
       //glVertexAttribPointer(index, compSize, type, normalized, stride, pointer);
     }
@@ -971,19 +2032,19 @@ for (int i=0; i<m_iCountVertexDeclaration;i++)
     if( m_VertexDeclaration[i].element & VF_FLOATCOLOR )
     {
         Log(0,"set color %d",attribute);
-    buffer->SetVertexAttribute(2, getTypeCount(m_VertexDeclaration[i].type), getTypeFormat(m_VertexDeclaration[i].type), true, m_iVertexOffSetSize, pointer);
+    buffer->EnableVertexAttribute(2);
+    buffer->SetVertexAttribute(2, getTypeCount(m_VertexDeclaration[i].type), getTypeFormat(m_VertexDeclaration[i].type), true, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex,color)));
     }
 
     if( m_VertexDeclaration[i].element & VF_NORMAL )
     {
         Log(0,"set norma %d",attribute);
-    buffer->SetVertexAttribute(3, getTypeCount(m_VertexDeclaration[i].type), getTypeFormat(m_VertexDeclaration[i].type), false,m_iVertexOffSetSize, pointer);
+    buffer->EnableVertexAttribute(3);
+    buffer->SetVertexAttribute(3, getTypeCount(m_VertexDeclaration[i].type), getTypeFormat(m_VertexDeclaration[i].type), false, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex,normal)));
     }
 
 
 
-    
-    offSet += getTypeSize(m_VertexDeclaration[i].type);
 }
 
 
@@ -999,193 +2060,328 @@ for (int i=0; i<m_iCountVertexDeclaration;i++)
         // buffer->SetVertexAttribute(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex,normal)));
         // buffer->EnableVertexAttribute(3);
 
-        
-        
+        if (releaseCPUData)
+            ReleaseCPUData();
     }
+    // Re-uploads the vertices after they were edited; the count must not change since Build()
     void Update()
     {
-
+        if (m_cpuReleased)
+        {
+            Log(1, "SURFACE: Update after ReleaseCPUData ignored");
+            return;
+        }
+        if (m_vertexBufferId != 0)
+            buffer->UpdateBuffer(m_vertexBufferId, VertexData(), CountVertices() * sizeof(Vertex), 0);
     }
-    void Render(UINT  mode = GL_TRIANGLES)
+    // Overwrites the start of the uploaded index buffer with a per frame list
+    // (e.g. the visible meshlets) of at most the built count; Render then
+    // draws only those until the next StreamIndices or Build.
+    void StreamIndices(const int *data, int count)
     {
+        if (!buffer || count > m_builtIndices)
+        {
+            Log(1, "SURFACE: StreamIndices needs a built surface with at least %d indices", count);
+            return;
+        }
+        if (count > 0)
+            buffer->UpdateElementBuffer(m_indexBufferId, (void*)data, count * sizeof(int), 0);
+        m_streamedIndices = count;
+    }
 
-          const int indexCount = CountIndices();
-          int count = 0;
+    void Render(UINT  mode = GL_TRIANGLES)
+    {
+        PROFILE_SCOPE("Surface::Render");
+        // glDrawElements takes the number of indices whatever the primitive type
+        const int count = m_streamedIndices >= 0 ? m_streamedIndices : CountIndices();
+        if (!buffer)
+            return;
 
-         switch (mode)
-         {
-             case GL_POINTS:	        
-             {
-                count = indexCount;
-             }break;
-             case GL_LINE_STRIP:       
-             {
-                count = indexCount + 1;
-             }break;
-             case GL_LINE_LOOP: 
-             {
-                  count = indexCount;
-             }break;
-             case GL_LINES: 
-             {
-                 count = indexCount * 2;
-             }break;
-             case GL_TRIANGLE_STRIP  :
-             {
-              count =   indexCount + 2;
-             }break;
-             case GL_TRIANGLE_FAN: 
-             {
-                  count =  indexCount+2;
-             }break;
-             case GL_TRIANGLES:        
-             {
-               count =   indexCount * 3;
-             }break;
-         }
- 
         buffer->Bind();
         buffer->DrawElements(mode, 0, count, 0);
     }
 
+    // Uploads the per instance data for RenderInstanced
+    void SetInstances(const InstanceData *data, int count)
+    {
+        int size = count * (int)sizeof(InstanceData);
+        if (!buffer)
+        {
+            Log(1, "SURFACE: SetInstances before Build ignored");
+            return;
+        }
+        if (m_instanceBufferId == 0)
+        {
+            buffer->Bind();
+            m_instanceBufferId = buffer->LoadBuffer((void*)data, size, true);
+            for (int i = 0; i < 4; i++)
+            {
+                buffer->EnableVertexAttribute(4 + i);
+                buffer->SetVertexAttribute(4 + i, 4, GL_FLOAT, false, sizeof(InstanceData),
+                                           reinterpret_cast<void*>(offsetof(InstanceData, model) + i * 4 * sizeof(float)));
+                buffer->SetVertexAttributeDivisor(4 + i, 1);
+            }
+            buffer->EnableVertexAttribute(8);
+            buffer->SetVertexAttribute(8, 1, GL_FLOAT, false, sizeof(InstanceData), reinterpret_cast<void*>(offsetof(InstanceData, layer)));
+            buffer->SetVertexAttributeDivisor(8, 1);
+            m_instanceCapacity = count;
+        }
+        else if (count > m_instanceCapacity)
+        {
+            buffer->ReloadBuffer(m_instanceBufferId, (void*)data, size, true);
+            m_instanceCapacity = count;
+        }
+        else
+            buffer->UpdateBuffer(m_instanceBufferId, (void*)data, size, 0);
+    }
+
+    // One draw for 'count' copies of the surface, each with its own InstanceData
+    void RenderInstanced(int count, UINT mode = GL_TRIANGLES)
+    {
+        if (count <= 0 || !buffer)
+            return;
+        buffer->Bind();
+        glDrawElementsInstanced(mode, CountIndices(), GL_UNSIGNED_INT, 0, count);
+    }
+
     static Surface *CreateCube()
     {
-     Surface *surface = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
-    surface->AddVertex(-1.0,-1.0,-1.0);
-    surface->AddVertex(-1.0, 1.0,-1.0);
-    surface->AddVertex( 1.0, 1.0,-1.0);
-    surface->AddVertex( 1.0,-1.0,-1.0);
-
-    surface->AddVertex(-1.0,-1.0, 1.0);
-    surface->AddVertex(-1.0, 1.0, 1.0);
-    surface->AddVertex( 1.0, 1.0, 1.0);
-    surface->AddVertex( 1.0,-1.0, 1.0);
-
-    surface->AddVertex(-1.0,-1.0, 1.0);
-    surface->AddVertex(-1.0, 1.0, 1.0);
-    surface->AddVertex( 1.0, 1.0, 1.0);
-    surface->AddVertex( 1.0,-1.0, 1.0);
-
-    surface->AddVertex(-1.0,-1.0,-1.0);
-    surface->AddVertex(-1.0, 1.0,-1.0);
-    surface->AddVertex( 1.0, 1.0,-1.0);
-    surface->AddVertex( 1.0,-1.0,-1.0);
-
-    surface->AddVertex(-1.0,-1.0, 1.0);
-    surface->AddVertex(-1.0, 1.0, 1.0);
-    surface->AddVertex( 1.0, 1.0, 1.0);
-    surface->AddVertex( 1.0,-1.0, 1.0);
-
-    surface->AddVertex(-1.0,-1.0,-1.0);
-    surface->AddVertex(-1.0, 1.0,-1.0);
-    surface->AddVertex( 1.0, 1.0,-1.0);
-    surface->AddVertex( 1.0,-1.0,-1.0);
-
-    surface->VertexNormal(0,0.0,0.0,-1.0);
-    surface->VertexNormal(1,0.0,0.0,-1.0);
-    surface->VertexNormal(2,0.0,0.0,-1.0);
-    surface->VertexNormal(3,0.0,0.0,-1.0);
-
-    surface->VertexNormal(4,0.0,0.0,1.0);
-    surface->VertexNormal(5,0.0,0.0,1.0);
-    surface->VertexNormal(6,0.0,0.0,1.0);
-    surface->VertexNormal(7,0.0,0.0,1.0);
-
-    surface->VertexNormal(8,0.0,-1.0,0.0);
-    surface->VertexNormal(9,0.0,1.0,0.0);
-    surface->VertexNormal(10,0.0,1.0,0.0);
-    surface->VertexNormal(11,0.0,-1.0,0.0);
-
-    surface->VertexNormal(12,0.0,-1.0,0.0);
-    surface->VertexNormal(13,0.0,1.0,0.0);
-    surface->VertexNormal(14,0.0,1.0,0.0);
-    surface->VertexNormal(15,0.0,-1.0,0.0);
-
-    surface->VertexNormal(16,-1.0,0.0,0.0);
-    surface->VertexNormal(17,-1.0,0.0,0.0);
-    surface->VertexNormal(18,1.0,0.0,0.0);
-    surface->VertexNormal(19,1.0,0.0,0.0);
-
-    surface->VertexNormal(20,-1.0,0.0,0.0);
-    surface->VertexNormal(21,-1.0,0.0,0.0);
-    surface->VertexNormal(22,1.0,0.0,0.0);
-    surface->VertexNormal(23,1.0,0.0,0.0);
-
-    surface->VertexTexCoords(0,0.0,1.0);
-    surface->VertexTexCoords(1,0.0,0.0);
-    surface->VertexTexCoords(2,1.0,0.0);
-    surface->VertexTexCoords(3,1.0,1.0);
-
-    surface->VertexTexCoords(4,1.0,1.0);
-    surface->VertexTexCoords(5,1.0,0.0);
-    surface->VertexTexCoords(6,0.0,0.0);
-    surface->VertexTexCoords(7,0.0,1.0);
-
-    surface->VertexTexCoords(8,0.0,1.0);
-    surface->VertexTexCoords(9,0.0,0.0);
-    surface->VertexTexCoords(10,1.0,0.0);
-    surface->VertexTexCoords(11,1.0,1.0);
-
-    surface->VertexTexCoords(12,0.0,0.0);
-    surface->VertexTexCoords(13,0.0,1.0);
-    surface->VertexTexCoords(14,1.0,1.0);
-    surface->VertexTexCoords(15,1.0,0.0);
-
-    surface->VertexTexCoords(16,0.0,1.0);
-    surface->VertexTexCoords(17,0.0,0.0);
-    surface->VertexTexCoords(18,1.0,0.0);
-    surface->VertexTexCoords(19,1.0,1.0);
-
-    surface->VertexTexCoords(20,1.0,1.0);
-    surface->VertexTexCoords(21,1.0,0.0);
-    surface->VertexTexCoords(22,0.0,0.0);
-    surface->VertexTexCoords(23,0.0,1.0);
-
-
-    surface->AddTriangle(0,1,2); // front
-    surface->AddTriangle(0,2,3);
-    surface->AddTriangle(6,5,4); // back
-    surface->AddTriangle(7,6,4);
-    surface->AddTriangle(6+8,5+8,1+8); // top
-    surface->AddTriangle(2+8,6+8,1+8);
-    surface->AddTriangle(0+8,4+8,7+8); // bottom
-    surface->AddTriangle(0+8,7+8,3+8);
-    surface->AddTriangle(6+16,2+16,3+16); // right
-    surface->AddTriangle(7+16,6+16,3+16);
-    surface->AddTriangle(0+16,1+16,5+16); // left
-    surface->AddTriangle(0+16,5+16,4+16);
-    surface->Build();
-     return surface;
-    }
-
-static Surface *CreatePlane(float w,float d)
-{
-    Surface *surf = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+        // position, normal, texcoord
+        static const float data[24][8] =
+        {
+            {-1,-1,-1,  0, 0,-1,  0,1}, {-1, 1,-1,  0, 0,-1,  0,0}, { 1, 1,-1,  0, 0,-1,  1,0}, { 1,-1,-1,  0, 0,-1,  1,1},
+            {-1,-1, 1,  0, 0, 1,  1,1}, {-1, 1, 1,  0, 0, 1,  1,0}, { 1, 1, 1,  0, 0, 1,  0,0}, { 1,-1, 1,  0, 0, 1,  0,1},
+            {-1,-1, 1,  0,-1, 0,  0,1}, {-1, 1, 1,  0, 1, 0,  0,0}, { 1, 1, 1,  0, 1, 0,  1,0}, { 1,-1, 1,  0,-1, 0,  1,1},
+            {-1,-1,-1,  0,-1, 0,  0,0}, {-1, 1,-1,  0, 1, 0,  0,1}, { 1, 1,-1,  0, 1, 0,  1,1}, { 1,-1,-1,  0,-1, 0,  1,0},
+            {-1,-1, 1, -1, 0, 0,  0,1}, {-1, 1, 1, -1, 0, 0,  0,0}, { 1, 1, 1,  1, 0, 0,  1,0}, { 1,-1, 1,  1, 0, 0,  1,1},
+            {-1,-1,-1, -1, 0, 0,  1,1}, {-1, 1,-1, -1, 0, 0,  1,0}, { 1, 1,-1,  1, 0, 0,  0,0}, { 1,-1,-1,  1, 0, 0,  0,1},
+        };
+        static const int triangles[36] =
+        {
+            0, 1, 2,    0, 2, 3,        // front
+            6, 5, 4,    7, 6, 4,        // back
+            14, 13, 9,  10, 14, 9,      // top
+            8, 12, 15,  8, 15, 11,      // bottom
+            22, 18, 19, 23, 22, 19,     // right
+            16, 17, 21, 16, 21, 20,     // left
+        };
+
+        Surface *surface = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+        surface->Reserve(24, 36);
+        Vertex *out = surface->AppendVertices(24);
+        for (int i = 0; i < 24; i++)
+        {
+            const float *v = data[i];
+            out[i] = Vertex(v[0], v[1], v[2], v[3], v[4], v[5], Color(), v[6], v[7]);
+        }
+        surface->AddTriangles(triangles, 12);
+        surface->Build();
+        return surface;
+    }
+
+    static Surface *CreatePlane(float w, float d)
+    {
+        const Vertex data[4] =
+        {
+            Vertex(-w, 0.0f, -d, 0.0f, 1.0f, 0.0f, Color(), 0.0f, 1.0f),
+            Vertex(-w, 0.0f,  d, 0.0f, 1.0f, 0.0f, Color(), 0.0f, 0.0f),
+            Vertex( w, 0.0f,  d, 0.0f, 1.0f, 0.0f, Color(), 1.0f, 0.0f),
+            Vertex( w, 0.0f, -d, 0.0f, 1.0f, 0.0f, Color(), 1.0f, 1.0f),
+        };
+        static const int triangles[6] = { 0, 1, 2, 0, 2, 3 };
+
+        Surface *surface = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+        surface->Reserve(4, 6);
+        surface->AddVertices(data, 4);
+        surface->AddTriangles(triangles, 2);
+        surface->Build();
+        return surface;
+    }
+
+    // Appends a (columns+1) x (rows+1) grid of vertices, vertex(column, row, out)
+    // filling each one, with two triangles per cell. Triangles face the side
+    // cross(d/drow, d/dcolumn) points to. Sizes the arrays once and writes in
+    // place; with jobs the rows are filled in parallel strips. No GL calls,
+    // so it can run on any thread.
+    template<typename F>
+    static void GenerateLattice(Surface &surface, int columns, int rows, JobSystem *jobs, const F &vertex)
+    {
+        if (!surface.HasCPUData() || columns < 1 || rows < 1)
+            return;
+        const int row = columns + 1;
+        const int base = surface.CountVertices();
+        surface.Reserve(base + row * (rows + 1), surface.CountIndices() + columns * rows * 6);
+        Vertex *out = surface.AppendVertices(row * (rows + 1));
+        int *indices = surface.AppendIndices(columns * rows * 6);
+
+        auto fill = [&](int begin, int end)
+        {
+            for (int z = begin; z < end; z++)
+            {
+                Vertex *line = out + (size_t)z * row;
+                for (int x = 0; x <= columns; x++)
+                    vertex(x, z, line[x]);
+                if (z == rows)
+                    continue;
+                int *cell = indices + (size_t)z * columns * 6;
+                for (int x = 0; x < columns; x++, cell += 6)
+                {
+                    int a = base + z * row + x, b = a + 1, c = a + row, d = c + 1;
+                    cell[0] = a; cell[1] = c; cell[2] = b;
+                    cell[3] = b; cell[4] = c; cell[5] = d;
+                }
+            }
+        };
+        if (jobs)
+            jobs->ParallelFor(rows + 1, std::max(1, 16384 / row), fill);
+        else
+            fill(0, rows + 1);
+    }
+
+    // Flat grid over -w..w, -d..d facing up (CreatePlane with slices)
+    static void GenerateGrid(Surface &surface, float w, float d, int slicesX, int slicesZ, JobSystem *jobs = nullptr)
+    {
+        const float stepX = 2.0f * w / slicesX, stepZ = 2.0f * d / slicesZ;
+        GenerateLattice(surface, slicesX, slicesZ, jobs, [=](int x, int z, Vertex &v)
+        {
+            v = Vertex(-w + x * stepX, 0.0f, -d + z * stepZ, 0.0f, 1.0f, 0.0f, Color(),
+                       (float)x / slicesX, 1.0f - (float)z / slicesZ);
+        });
+    }
 
+    // UV sphere; rings run from pole to pole, segments around the Y axis
+    static void GenerateSphere(Surface &surface, float radius, int rings, int segments, JobSystem *jobs = nullptr)
+    {
+        GenerateLattice(surface, segments, rings, jobs, [=](int x, int z, Vertex &v)
+        {
+            float theta = PI * z / rings, phi = 2.0f * PI * x / segments;
+            float nx = sinf(theta) * cosf(phi), ny = cosf(theta), nz = -sinf(theta) * sinf(phi);
+            v = Vertex(nx * radius, ny * radius, nz * radius, nx, ny, nz, Color(),
+                       (float)x / segments, 1.0f - (float)z / rings);
+        });
+    }
 
-	surf->AddVertex(-w,0.0,-d);
-	surf->AddVertex(-w,0.0, d);
-	surf->AddVertex( w,0.0, d);
-	surf->AddVertex( w,0.0,-d);
+    // Open tube around the Y axis, centered on the origin, plus flat caps if asked
+    static void GenerateCylinder(Surface &surface, float radius, float height, int segments, int stacks, bool caps = true, JobSystem *jobs = nullptr)
+    {
+        const float top = height * 0.5f;
+        GenerateLattice(surface, segments, stacks, jobs, [=](int x, int z, Vertex &v)
+        {
+            float phi = 2.0f * PI * x / segments;
+            float nx = cosf(phi), nz = -sinf(phi);
+            v = Vertex(nx * radius, top - height * z / stacks, nz * radius, nx, 0.0f, nz, Color(),
+                       (float)x / segments, 1.0f - (float)z / stacks);
+        });
+        if (!caps || !surface.HasCPUData() || segments < 1)
+            return;
 
+        for (int side = 0; side < 2; side++)
+        {
+            float y = side == 0 ? top : -top;
+            float ny = side == 0 ? 1.0f : -1.0f;
+            int center = surface.CountVertices();
+            Vertex *out = surface.AppendVertices(segments + 2);
+            out[0] = Vertex(0.0f, y, 0.0f, 0.0f, ny, 0.0f, Color(), 0.5f, 0.5f);
+            for (int i = 0; i <= segments; i++)
+            {
+                float phi = 2.0f * PI * i / segments;
+                float cx = cosf(phi), sz = sinf(phi);
+                out[i + 1] = Vertex(cx * radius, y, -sz * radius, 0.0f, ny, 0.0f, Color(),
+                                    0.5f + cx * 0.5f, 0.5f + sz * 0.5f);
+            }
+            int *fan = surface.AppendIndices(segments * 3);
+            for (int i = 0; i < segments; i++, fan += 3)
+            {
+                fan[0] = center;
+                fan[1] = center + 1 + (side == 0 ? i : i + 1);
+                fan[2] = center + 1 + (side == 0 ? i + 1 : i);
+            }
+        }
+    }
 
-	surf->VertexNormal(0,0.0,1.0,0.0);
-	surf->VertexNormal(1,0.0,1.0,0.0);
-	surf->VertexNormal(2,0.0,1.0,0.0);
-	surf->VertexNormal(3,0.0,1.0,0.0);
+    // Ring of 'radius' around the Y axis with a tube of 'tube'
+    static void GenerateTorus(Surface &surface, float radius, float tube, int rings, int sides, JobSystem *jobs = nullptr)
+    {
+        GenerateLattice(surface, rings, sides, jobs, [=](int x, int z, Vertex &v)
+        {
+            float phi = 2.0f * PI * x / rings, theta = 2.0f * PI * z / sides;
+            float cp = cosf(phi), sp = -sinf(phi), ct = cosf(theta), st = -sinf(theta);
+            float r = radius + tube * ct;
+            v = Vertex(r * cp, tube * st, r * sp, ct * cp, st, ct * sp, Color(),
+                       (float)x / rings, 1.0f - (float)z / sides);
+        });
+    }
 
-	surf->VertexTexCoords(0,0.0,1.0);
-	surf->VertexTexCoords(1,0.0,0.0);
-	surf->VertexTexCoords(2,1.0,0.0);
-	surf->VertexTexCoords(3,1.0,1.0);
+    static Surface *CreateGrid(float w, float d, int slicesX, int slicesZ, JobSystem *jobs = nullptr)
+    {
+        Surface *surface = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+        GenerateGrid(*surface, w, d, slicesX, slicesZ, jobs);
+        surface->Build();
+        return surface;
+    }
 
-	surf->AddTriangle(0,1,2); // front
-	surf->AddTriangle(0,2,3);
+    static Surface *CreateSphere(float radius, int rings, int segments, JobSystem *jobs = nullptr)
+    {
+        Surface *surface = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+        GenerateSphere(*surface, radius, rings, segments, jobs);
+        surface->Build();
+        return surface;
+    }
 
-	 surf->Build();
-     return surf;
-}
+    static Surface *CreateCylinder(float radius, float height, int segments, int stacks = 1, bool caps = true, JobSystem *jobs = nullptr)
+    {
+        Surface *surface = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+        GenerateCylinder(*surface, radius, height, segments, stacks, caps, jobs);
+        surface->Build();
+        return surface;
+    }
 
+    static Surface *CreateTorus(float radius, float tube, int rings, int sides, JobSystem *jobs = nullptr)
+    {
+        Surface *surface = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+        GenerateTorus(*surface, radius, tube, rings, sides, jobs);
+        surface->Build();
+        return surface;
+    }
+
+};
+
+#define MESH_MAX_LODS   8
+
+// Camera data for picking a level of detail. projectionScale turns a size at
+// distance 1 into pixels: half the viewport height times the projection's
+// y scale (1 / tan(fovY / 2)). A level is used when its error projects to at
+// most pixelError pixels.
+struct LODView
+{
+    Vec3  cameraPosition;
+    float projectionScale;
+    float pixelError;
+    bool  enabled;
+
+    LODView(const Vec3 &camera, const Mat4 &projection, int viewportHeight, float pixelError = 1.0f)
+        : cameraPosition(camera), projectionScale(viewportHeight * 0.5f * projection.c[1][1]), pixelError(pixelError), enabled(true) {}
+};
+
+// Triangles drawn through Mesh::Render(view, model) since the last Reset;
+// fullTriangles is what the same draws cost at full detail
+struct LODStats
+{
+    int objects;
+    long renderedTriangles;
+    long fullTriangles;
+    int levels[MESH_MAX_LODS + 1];
+
+    LODStats() { Reset(); }
+
+    void Reset()
+    {
+        objects = 0;
+        renderedTriangles = 0;
+        fullTriangles = 0;
+        for (int i = 0; i <= MESH_MAX_LODS; i++)
+            levels[i] = 0;
+    }
 };
 
 class Mesh
@@ -1206,22 +2402,51 @@ class Mesh
         Vec2 c_uv;
     } ;
 
+    struct LODLevel
+    {
+        Surface *surface;
+        float error;        // model units
+        int triangles;
+    };
+
+    struct Clusters
+    {
+        Surface *surface;           // welded copy, indices in meshlet order
+        std::vector<Meshlet> meshlets;
+        std::vector<int> indices;
+        std::vector<int> visible;   // compacted each frame
+    };
+
     std::vector<Surface*> surfaces;
+    std::vector<std::vector<LODLevel>> lods;   // per surface, level 0 is the surface itself
+    std::vector<Clusters> clusters;
+    Vec3 m_center;
+    float m_radius;
+
     public:
         Mesh()
         {
-
+            m_radius = 0.0f;
         }
         ~Mesh()
         {
+            ReleaseLODs();
+            ReleaseMeshlets();
             for (int i = 0; i <(int) surfaces.size(); i++) 
             {
                 delete surfaces[i];
             }
             surfaces.clear();
          }
+
+        // Takes ownership
+        void AddSurface(Surface *surface)
+        {
+            surfaces.push_back(surface);
+        }
         bool LoadObj(const std::string &file_name)
         {
+            PROFILE_SCOPE("Mesh::LoadObj");
             if (!FileExists(file_name.c_str()))
             {
                 Log(2," File %s don't exists",file_name.c_str());
@@ -1233,13 +2458,26 @@ class Mesh
                 std::vector<Face>    faces;    
 
             Surface *surf = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
-            FILE* file;
-            file = fopen(file_name.c_str(), "r");
-            if (!file)
+            MappedFile file(file_name.c_str());
+            if (!file.IsOpen())
+            {
+                delete surf;
                 return false;
+            }
+            const char *cursor = (const char*)file.Data();
+            const char *end = cursor + file.Size();
             char line[1024];
-             while (fgets(line, 1024, file)) 
+            while (cursor < end)
             {
+                // sscanf needs a terminated string and the mapping has none, so copy one line at a time
+                const char *eol = (const char*)memchr(cursor, '\n', end - cursor);
+                size_t length = (eol ? eol : end) - cursor;
+                if (length >= sizeof(line))
+                    length = sizeof(line) - 1;
+                memcpy(line, cursor, length);
+                line[length] = '\0';
+                cursor = eol ? eol + 1 : end;
+
                 // Vertex information
                 if (strncmp(line, "v ", 2) == 0) 
                 {
@@ -1312,8 +2550,6 @@ class Mesh
                 surf->AddTriangle(f0,f1,f2);
             }
 
-            fclose(file);
-
             surf->Build();
             surfaces.push_back(surf);
             return true;
@@ -1327,5 +2563,267 @@ class Mesh
                 surf->Render();
             }
         }
+
+        // Bakes up to maxLevels simplified copies of every surface, each with
+        // about ratio times the triangles of the one before, stopping early
+        // when the geometric error would pass maxError (model units) or the
+        // simplifier makes no more progress. Needs the CPU copy of the surfaces.
+        // Returns the number of levels made for the first surface.
+        int GenerateLODs(int maxLevels = 4, float ratio = 0.5f, float maxError = FLT_MAX)
+        {
+            PROFILE_SCOPE("Mesh::GenerateLODs");
+            ReleaseLODs();
+            maxLevels = std::min(maxLevels, MESH_MAX_LODS);
+            ComputeBounds();
+            lods.resize(surfaces.size());
+            for (size_t i = 0; i < surfaces.size(); i++)
+            {
+                Surface *surface = surfaces[i];
+                lods[i].push_back({ surface, 0.0f, surface->CountIndices() / 3 });
+                if (!surface->HasCPUData())
+                {
+                    Log(1, "MESH: surface %d has no CPU data, no LODs made", (int)i);
+                    continue;
+                }
+
+                // OBJ surfaces are one vertex per corner; weld identical ones first
+                std::vector<Vertex> vertices;
+                std::vector<int> indices;
+                WeldVertices(*surface, vertices, indices);
+                if (vertices.empty() || indices.empty())
+                    continue;
+
+                std::vector<int> simplified(indices.size());
+                int previous = (int)indices.size();
+                float target = (float)indices.size();
+                for (int level = 1; level <= maxLevels; level++)
+                {
+                    target *= ratio;
+                    float error = 0.0f;
+                    int count = MeshSimplifier::Simplify(&vertices[0].pos.x, sizeof(Vertex), (int)vertices.size(), indices.data(),
+                                                         (int)indices.size(), (int)target / 3 * 3, maxError, simplified.data(), &error);
+                    if (count == 0 || count > previous * 0.9f)
+                        break;
+                    lods[i].push_back({ BuildLOD(vertices, simplified.data(), count), error, count / 3 });
+                    previous = count;
+                }
+                Log(0, "MESH: surface %d, %d LOD levels, %d -> %d triangles, error %f", (int)i, (int)lods[i].size() - 1,
+                    lods[i].front().triangles, lods[i].back().triangles, lods[i].back().error);
+            }
+            return lods.empty() ? 0 : (int)lods[0].size() - 1;
+        }
+
+        void ReleaseLODs()
+        {
+            for (auto &chain : lods)
+                for (size_t level = 1; level < chain.size(); level++)
+                    delete chain[level].surface;
+            lods.clear();
+        }
+
+        int CountLODs(int surface = 0) const
+        {
+            return surface < (int)lods.size() ? (int)lods[surface].size() - 1 : 0;
+        }
+
+        // Coarsest level whose error, seen from the camera, stays under view.pixelError.
+        // Distance is taken to the bounding sphere, so inside it level 0 is used.
+        int SelectLOD(int surface, const LODView &view, const Mat4 &model) const
+        {
+            if (!view.enabled || surface >= (int)lods.size())
+                return 0;
+            Vec3 scale = model.getScale();
+            float maxScale = std::max(std::max(scale.x, scale.y), scale.z);
+            Vec3 center = model * m_center;
+            float distance = (view.cameraPosition - center).length() - m_radius * maxScale;
+            if (distance <= 0.0f)
+                return 0;
+            const std::vector<LODLevel> &chain = lods[surface];
+            float limit = view.pixelError * distance / (view.projectionScale * maxScale);
+            int level = 0;
+            while (level + 1 < (int)chain.size() && chain[level + 1].error <= limit)
+                level++;
+            return level;
+        }
+
+        // Draws each surface at the level picked by SelectLOD; the caller sets the model matrix on its shader
+        void Render(const LODView &view, const Mat4 &model, LODStats *stats = nullptr)
+        {
+            for (int i = 0; i < (int)surfaces.size(); i++)
+            {
+                int level = SelectLOD(i, view, model);
+                Surface *surface = level > 0 ? lods[i][level].surface : surfaces[i];
+                surface->Render();
+                if (stats)
+                {
+                    stats->renderedTriangles += surface->CountIndices() / 3;
+                    stats->fullTriangles += surfaces[i]->CountIndices() / 3;
+                    stats->levels[level]++;
+                }
+            }
+            if (stats)
+                stats->objects++;
+        }
+
+        static void LogStats(const LODStats &stats)
+        {
+            // Objects per level, up to the coarsest level drawn
+            int last = 0;
+            for (int level = 0; level <= MESH_MAX_LODS; level++)
+                if (stats.levels[level] > 0)
+                    last = level;
+            char levels[128];
+            int length = 0;
+            for (int level = 0; level <= last; level++)
+                length += snprintf(levels + length, sizeof(levels) - length, level ? "/%d" : "%d", stats.levels[level]);
+
+            Log(0, "MESH: %d objects, %ld triangles with LOD, %ld without (%.1f%%), levels %s",
+                stats.objects, stats.renderedTriangles, stats.fullTriangles,
+                stats.fullTriangles > 0 ? 100.0 * stats.renderedTriangles / stats.fullTriangles : 0.0, levels);
+        }
+
+        // Splits every surface into meshlets for RenderClusters. Needs the CPU
+        // copy; OBJ surfaces are welded first so neighbouring triangles share
+        // vertices. Returns the total number of meshlets.
+        int BuildMeshlets(int maxVertices = MESHLET_MAX_VERTICES, int maxTriangles = MESHLET_MAX_TRIANGLES)
+        {
+            PROFILE_SCOPE("Mesh::BuildMeshlets");
+            ReleaseMeshlets();
+            ComputeBounds();
+            int total = 0;
+            for (size_t i = 0; i < surfaces.size(); i++)
+            {
+                if (!surfaces[i]->HasCPUData())
+                {
+                    Log(1, "MESH: surface %d has no CPU data, no meshlets made", (int)i);
+                    continue;
+                }
+                std::vector<Vertex> vertices;
+                std::vector<int> indices;
+                WeldVertices(*surfaces[i], vertices, indices);
+                if (vertices.empty() || indices.empty())
+                    continue;
+
+                Clusters entry;
+                MeshletBuilder::Build(&vertices[0].pos.x, sizeof(Vertex), (int)vertices.size(), indices.data(), (int)indices.size(),
+                                      entry.meshlets, entry.indices, maxVertices, maxTriangles);
+                entry.surface = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+                entry.surface->AddVertices(vertices.data(), (int)vertices.size());
+                entry.surface->AddTriangles(entry.indices.data(), (int)entry.indices.size() / 3);
+                entry.surface->Build();
+                entry.visible.resize(entry.indices.size());
+                Log(0, "MESH: surface %d, %d triangles in %d meshlets (%.1f triangles each)", (int)i, (int)indices.size() / 3,
+                    (int)entry.meshlets.size(), entry.meshlets.empty() ? 0.0 : indices.size() / 3.0 / entry.meshlets.size());
+                total += (int)entry.meshlets.size();
+                clusters.push_back(std::move(entry));
+            }
+            return total;
+        }
+
+        void ReleaseMeshlets()
+        {
+            for (Clusters &entry : clusters)
+                delete entry.surface;
+            clusters.clear();
+        }
+
+        // Culls the meshlets against the frustum and their normal cones, streams
+        // the survivors' indices and draws them. camera is in world space; the
+        // caller sets the model matrix on its shader.
+        void RenderClusters(const Mat4 &viewProjection, const Mat4 &model, const Vec3 &camera, MeshletStats *stats = nullptr)
+        {
+            PROFILE_SCOPE("Mesh::RenderClusters");
+            Frustum frustum;
+            frustum.buildViewFrustum(viewProjection * model);
+            Vec3 localCamera = MeshletCuller::ToModelSpace(model, camera);
+            for (Clusters &entry : clusters)
+            {
+                int count = MeshletCuller::Cull(entry.meshlets, entry.indices.data(), frustum, localCamera, entry.visible.data(), 0, stats);
+                entry.surface->StreamIndices(entry.visible.data(), count);
+                if (count > 0)
+                    entry.surface->Render();
+            }
+        }
+
+        static void LogStats(const MeshletStats &stats)
+        {
+            Log(0, "MESH: %d meshlets, %d outside the frustum, %d back facing, %ld of %ld triangles rejected (%.1f%%)",
+                stats.meshlets, stats.frustumCulled, stats.backfaceCulled, stats.trianglesRejected, stats.triangles,
+                stats.triangles > 0 ? 100.0 * stats.trianglesRejected / stats.triangles : 0.0);
+        }
+
+        const Vec3 &GetCenter() const { return m_center; }
+        float GetRadius() const { return m_radius; }
+
+    private:
+        void ComputeBounds()
+        {
+            Vec3 mins(FLT_MAX, FLT_MAX, FLT_MAX), maxs(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+            for (Surface *surface : surfaces)
+            {
+                if (!surface->HasCPUData())
+                    continue;
+                for (int v = 0; v < surface->CountVertices(); v++)
+                {
+                    const Vec3 &p = surface->GetVertex(v).pos;
+                    mins = Vec3(std::min(mins.x, p.x), std::min(mins.y, p.y), std::min(mins.z, p.z));
+                    maxs = Vec3(std::max(maxs.x, p.x), std::max(maxs.y, p.y), std::max(maxs.z, p.z));
+                }
+            }
+            if (mins.x > maxs.x)
+            {
+                m_center = Vec3(0, 0, 0);
+                m_radius = 0.0f;
+                return;
+            }
+            m_center = (mins + maxs) * 0.5f;
+            m_radius = (maxs - m_center).length();
+        }
+
+        // Sorts the corners so identical vertices end up next to each other
+        static void WeldVertices(const Surface &surface, std::vector<Vertex> &vertices, std::vector<int> &indices)
+        {
+            const int vertexCount = surface.CountVertices();
+            const int *source = (const int*)surface.ConstIndicesData();
+            std::vector<int> order(vertexCount), remap(vertexCount);
+            for (int v = 0; v < vertexCount; v++)
+                order[v] = v;
+            std::sort(order.begin(), order.end(), [&surface](int a, int b)
+            {
+                return memcmp(&surface.GetVertex(a), &surface.GetVertex(b), sizeof(Vertex)) < 0;
+            });
+            vertices.clear();
+            for (int k = 0; k < vertexCount; k++)
+            {
+                const Vertex &vertex = surface.GetVertex(order[k]);
+                if (k == 0 || memcmp(&vertex, &vertices.back(), sizeof(Vertex)) != 0)
+                    vertices.push_back(vertex);
+                remap[order[k]] = (int)vertices.size() - 1;
+            }
+            indices.resize(surface.CountIndices());
+            for (size_t i = 0; i < indices.size(); i++)
+                indices[i] = remap[source[i]];
+        }
+
+        // New surface with only the vertices the simplified indices use
+        static Surface *BuildLOD(const std::vector<Vertex> &vertices, const int *indices, int count)
+        {
+            std::vector<int> remap(vertices.size(), -1);
+            int used = 0;
+            for (int i = 0; i < count; i++)
+                if (remap[indices[i]] < 0)
+                    remap[indices[i]] = used++;
+
+            Surface *surface = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+            Vertex *destination = surface->AppendVertices(used);
+            for (size_t v = 0; v < vertices.size(); v++)
+                if (remap[v] >= 0)
+                    destination[remap[v]] = vertices[v];
+            int *destinationIndices = surface->AppendIndices(count);
+            for (int i = 0; i < count; i++)
+                destinationIndices[i] = remap[indices[i]];
+            surface->Build();
+            return surface;
+        }
   
 };
\ No newline at end of file
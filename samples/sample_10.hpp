@@ -0,0 +1,180 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <chrono>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+#include "../atlas.hpp"
+
+// Draws a grid of quads that each use a different small texture, first with
+// one texture per quad and then from a TextureAtlas, and compares texture
+// binds and frame time. Space switches mode, the report is logged every 120 frames.
+
+const int screenWidth = 1024;
+const int screenHeight = 768;
+const int gridSide = 12;
+
+const char *atlasVertexShader = R"(
+#version 300 es
+precision mediump float;
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+uniform vec2 offset;
+uniform float scale;
+out vec2 TexCoord;
+void main()
+{
+    TexCoord = aTexCoord;
+    gl_Position = vec4(aPos.xy * scale + offset, 0.0, 1.0);
+})";
+
+const char *atlasFragmentShader = R"(
+#version 300 es
+precision mediump float;
+uniform sampler2D tex;
+in vec2 TexCoord;
+out vec4 FragColor;
+void main()
+{
+    FragColor = texture(tex, TexCoord);
+})";
+
+static void MakeTile(int index, std::vector<unsigned char> &pixels, Image &image)
+{
+    int w = 16 + (index * 37) % 113;
+    int h = 16 + (index * 53) % 97;
+    pixels.resize((size_t)w * h * 4);
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            unsigned char *p = &pixels[((size_t)y * w + x) * 4];
+            bool border = x < 2 || y < 2 || x >= w - 2 || y >= h - 2;
+            p[0] = border ? 255 : (unsigned char)(index * 47);
+            p[1] = border ? 255 : (unsigned char)(x * 255 / w);
+            p[2] = border ? 255 : (unsigned char)(y * 255 / h);
+            p[3] = 255;
+        }
+    }
+    image.data = pixels.data();
+    image.width = w;
+    image.height = h;
+    image.components = 4;
+}
+
+static Surface *CreateQuad()
+{
+    Surface *surf = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+    surf->AddVertex(Vec3(-1, -1, 0), Vec3(0, 0, 1), Vec2(0, 0));
+    surf->AddVertex(Vec3( 1, -1, 0), Vec3(0, 0, 1), Vec2(1, 0));
+    surf->AddVertex(Vec3( 1,  1, 0), Vec3(0, 0, 1), Vec2(1, 1));
+    surf->AddVertex(Vec3(-1,  1, 0), Vec3(0, 0, 1), Vec2(0, 1));
+    surf->AddTriangle(0, 1, 2);
+    surf->AddTriangle(0, 2, 3);
+    surf->Build();
+    return surf;
+}
+
+int run_sample()
+{
+    App app;
+    app.CreateWindow(screenWidth, screenHeight, "Texture atlas", false);
+
+    Shader shader;
+    shader.create(atlasVertexShader, atlasFragmentShader);
+
+    const int count = gridSide * gridSide;
+    std::vector<Texture2D> textures(count);
+    std::vector<Surface*> separate(count), atlased(count);
+    TextureAtlas atlas(1024, 4);
+    std::vector<int> regions(count);
+
+    std::vector<unsigned char> pixels;
+    for (int i = 0; i < count; i++)
+    {
+        Image image;
+        MakeTile(i, pixels, image);
+        textures[i].Upload(image);
+        regions[i] = atlas.Add(image);
+        separate[i] = CreateQuad();
+        atlased[i] = CreateQuad();
+    }
+    atlas.Build();
+    for (int i = 0; i < count; i++)
+        atlas.RemapUV(*atlased[i], regions[i]);
+    atlas.LogStats();
+
+    bool useAtlas = false;
+    int frames = 0;
+    int binds = 0;
+    double frameMs = 0.0;
+    glClearColor(0.1f, 0.1f, 0.15f, 1.0f);
+    while (!app.ShouldClose())
+    {
+        const Uint8 *keys = SDL_GetKeyboardState(NULL);
+        static bool spaceDown = false;
+        if (keys[SDL_SCANCODE_SPACE] && !spaceDown)
+        {
+            useAtlas = !useAtlas;
+            frames = 0;
+            frameMs = 0.0;
+        }
+        spaceDown = keys[SDL_SCANCODE_SPACE];
+
+        auto start = std::chrono::steady_clock::now();
+        glClear(GL_COLOR_BUFFER_BIT);
+        shader.Bind();
+        shader.setInt("tex", 0);
+        shader.setFloat("scale", 0.9f / gridSide);
+
+        binds = 0;
+        int boundPage = -1;
+        for (int i = 0; i < count; i++)
+        {
+            if (useAtlas)
+            {
+                int page = atlas.GetRegion(regions[i]).page;
+                if (page != boundPage)
+                {
+                    atlas.GetPage(page).Bind(0);
+                    boundPage = page;
+                    binds++;
+                }
+            }
+            else
+            {
+                textures[i].Bind(0);
+                binds++;
+            }
+            float x = -1.0f + (2.0f * (i % gridSide) + 1.0f) / gridSide;
+            float y = -1.0f + (2.0f * (i / gridSide) + 1.0f) / gridSide;
+            shader.setFloat2("offset", x, y);
+            (useAtlas ? atlased[i] : separate[i])->Render();
+        }
+        glFinish();
+        frameMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        app.Swap();
+
+        if (++frames == 120)
+        {
+            Log(0, "ATLAS: %-8s %3d draws %3d binds per frame, %.3f ms", useAtlas ? "atlas" : "separate",
+                count, binds, frameMs / frames);
+            frames = 0;
+            frameMs = 0.0;
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        delete separate[i];
+        delete atlased[i];
+    }
+    return 0;
+}
@@ -0,0 +1,197 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <chrono>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+
+// Cubes that each use their own texture: one Texture2D::Bind and draw per
+// cube, against a Texture2DArray where the layer travels with the instance
+// data and the whole set is a single glDrawElementsInstanced. Space switches.
+
+const int screenWidth = 1024;
+const int screenHeight = 768;
+const int cubeSide = 16;
+const int layerSize = 128;
+
+const char *separateVertexShader = R"(
+#version 300 es
+precision mediump float;
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+uniform mat4 model;
+uniform mat4 viewProjection;
+out vec2 TexCoord;
+void main()
+{
+    TexCoord = aTexCoord;
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
+})";
+
+const char *separateFragmentShader = R"(
+#version 300 es
+precision mediump float;
+uniform sampler2D tex;
+in vec2 TexCoord;
+out vec4 FragColor;
+void main()
+{
+    FragColor = texture(tex, TexCoord);
+})";
+
+const char *arrayVertexShader = R"(
+#version 300 es
+precision mediump float;
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 4) in mat4 aModel;
+layout (location = 8) in float aLayer;
+uniform mat4 viewProjection;
+out vec3 TexCoord;
+void main()
+{
+    TexCoord = vec3(aTexCoord, aLayer);
+    gl_Position = viewProjection * aModel * vec4(aPos, 1.0);
+})";
+
+const char *arrayFragmentShader = R"(
+#version 300 es
+precision mediump float;
+precision mediump sampler2DArray;
+uniform sampler2DArray tex;
+in vec3 TexCoord;
+out vec4 FragColor;
+void main()
+{
+    FragColor = texture(tex, TexCoord);
+})";
+
+static void MakeLayerImage(int index, std::vector<unsigned char> &pixels, Image &image)
+{
+    pixels.resize((size_t)layerSize * layerSize * 3);
+    for (int y = 0; y < layerSize; y++)
+    {
+        for (int x = 0; x < layerSize; x++)
+        {
+            unsigned char *p = &pixels[((size_t)y * layerSize + x) * 3];
+            bool checker = ((x / 16) + (y / 16)) % 2 == 0;
+            p[0] = (unsigned char)(index * 67);
+            p[1] = checker ? 220 : (unsigned char)(index * 29);
+            p[2] = (unsigned char)(255 - index * 13);
+        }
+    }
+    image.data = pixels.data();
+    image.width = layerSize;
+    image.height = layerSize;
+    image.components = 3;
+}
+
+int run_sample()
+{
+    App app;
+    app.CreateWindow(screenWidth, screenHeight, "Texture arrays", false);
+
+    Shader separateShader;
+    separateShader.create(separateVertexShader, separateFragmentShader);
+    Shader arrayShader;
+    arrayShader.create(arrayVertexShader, arrayFragmentShader);
+
+    const int count = cubeSide * cubeSide;
+    std::vector<Texture2D> textures(count);
+    Texture2DArray array;
+    array.Create(layerSize, layerSize, count);
+
+    std::vector<InstanceData> instances(count);
+    std::vector<unsigned char> pixels;
+    for (int i = 0; i < count; i++)
+    {
+        Image image;
+        MakeLayerImage(i, pixels, image);
+        textures[i].Upload(image);
+        instances[i].layer = (float)array.AddLayer(image);
+    }
+    array.GenerateMipmaps();
+    Log(0, "ARRAYBENCH: %d layers, %.1f MB, %d free", array.GetLayerCount(),
+        array.GetMemorySize() / (1024.0 * 1024.0), array.GetFreeLayers());
+
+    Surface *cube = Surface::CreateCube();
+    Mat4 projection = Mat4::ProjectionMatrix(45.0f * PI / 180.0f, (float)screenWidth / screenHeight, 0.1f, 1000.0f);
+    Mat4 view = Mat4::LookAt(Vec3(0, 0, cubeSide * 3.2f), Vec3(0, 0, 0), Vec3(0, 1, 0));
+    Mat4 viewProjection = projection * view;
+
+    bool useArray = false;
+    bool spaceDown = false;
+    int frames = 0;
+    double frameMs = 0.0;
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.1f, 0.1f, 0.15f, 1.0f);
+    while (!app.ShouldClose())
+    {
+        const Uint8 *keys = SDL_GetKeyboardState(NULL);
+        if (keys[SDL_SCANCODE_SPACE] && !spaceDown)
+        {
+            useArray = !useArray;
+            frames = 0;
+            frameMs = 0.0;
+        }
+        spaceDown = keys[SDL_SCANCODE_SPACE];
+
+        float time = SDL_GetTicks() / 1000.0f;
+        for (int i = 0; i < count; i++)
+        {
+            float x = (i % cubeSide - cubeSide / 2) * 3.0f;
+            float y = (i / cubeSide - cubeSide / 2) * 3.0f;
+            instances[i].model = Mat4::Translate(x, y, 0) * Mat4::Rotate(Vec3(0, 1, 0), time + i * 0.1f);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        int draws = 0, binds = 0;
+        if (useArray)
+        {
+            array.Bind(0);
+            arrayShader.Bind();
+            arrayShader.setInt("tex", 0);
+            arrayShader.setMatrix4("viewProjection", viewProjection);
+            cube->SetInstances(instances.data(), count);
+            cube->RenderInstanced(count);
+            draws = 1;
+            binds = 1;
+        }
+        else
+        {
+            separateShader.Bind();
+            separateShader.setInt("tex", 0);
+            separateShader.setMatrix4("viewProjection", viewProjection);
+            for (int i = 0; i < count; i++)
+            {
+                textures[i].Bind(0);
+                separateShader.setMatrix4("model", instances[i].model);
+                cube->Render();
+            }
+            draws = count;
+            binds = count;
+        }
+        glFinish();
+        frameMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        app.Swap();
+
+        if (++frames == 120)
+        {
+            Log(0, "ARRAYBENCH: %-9s %4d draws %4d binds per frame, %.3f ms", useArray ? "array" : "separate",
+                draws, binds, frameMs / frames);
+            frames = 0;
+            frameMs = 0.0;
+        }
+    }
+
+    delete cube;
+    return 0;
+}
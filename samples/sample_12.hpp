@@ -0,0 +1,223 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <math.h>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+#include "../commands.hpp"
+
+// Command buffer benchmark: 12500 objects, each a texture bind, two uniforms
+// and a draw (50k commands per frame). "direct" updates, culls and issues GL
+// per object on the main thread; "recorded" does the same work on the job
+// system into one CommandBuffer per chunk and replays them on the GL thread.
+// Space switches mode; timings are logged every 120 frames. Before the window
+// loop the recording alone is timed serially and in parallel.
+
+const int screenWidth = 1024;
+const int screenHeight = 768;
+const int objectSide = 125;
+const int objectCount = objectSide * 100;
+const int textureCount = 8;
+const int recordGrain = 512;
+
+const char *commandVertexShader = R"(
+#version 300 es
+precision mediump float;
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+uniform mat4 model;
+uniform mat4 viewProjection;
+out vec2 TexCoord;
+void main()
+{
+    TexCoord = aTexCoord;
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
+})";
+
+const char *commandFragmentShader = R"(
+#version 300 es
+precision mediump float;
+uniform sampler2D tex;
+uniform vec4 tint;
+in vec2 TexCoord;
+out vec4 FragColor;
+void main()
+{
+    FragColor = texture(tex, TexCoord) * tint;
+})";
+
+struct CommandObject
+{
+    Vec3 position;
+    float phase;
+    int texture;
+};
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The per object work both paths share: animate, build the matrix, cull
+static bool PrepareObject(const CommandObject &object, float time, const Mat4 &viewProjection, Mat4 &model)
+{
+    model = Mat4::Translate(object.position.x, object.position.y, object.position.z) *
+            Mat4::Rotate(Vec3(0, 1, 0), time + object.phase) * Mat4::Scale(0.4f, 0.4f, 0.4f);
+    Vec4 clip = viewProjection * Vec4(object.position);
+    return clip.w > 0.0f && fabsf(clip.x) <= clip.w * 1.1f && fabsf(clip.y) <= clip.w * 1.1f;
+}
+
+int run_sample()
+{
+    App app;
+    app.CreateWindow(screenWidth, screenHeight, "Command buffers", false);
+    JobSystem &jobs = app.GetJobs();
+
+    Shader shader;
+    shader.create(commandVertexShader, commandFragmentShader);
+    shader.addUniform("model");
+    shader.addUniform("tint");
+    int modelLocation = shader.getUniformLocation("model");
+    int tintLocation = shader.getUniformLocation("tint");
+
+    std::vector<Texture2D> textures(textureCount);
+    std::vector<unsigned char> pixels(64 * 64 * 3);
+    for (int i = 0; i < textureCount; i++)
+    {
+        for (size_t p = 0; p < pixels.size(); p += 3)
+        {
+            pixels[p] = (unsigned char)(i * 31);
+            pixels[p + 1] = (unsigned char)(p * 7);
+            pixels[p + 2] = (unsigned char)(255 - i * 29);
+        }
+        Image image;
+        image.data = pixels.data();
+        image.width = 64;
+        image.height = 64;
+        image.components = 3;
+        textures[i].Upload(image);
+    }
+
+    std::vector<CommandObject> objects(objectCount);
+    for (int i = 0; i < objectCount; i++)
+    {
+        objects[i].position = Vec3((i % objectSide - objectSide / 2) * 1.0f, (i / objectSide - 50) * 1.0f, 0.0f);
+        objects[i].phase = i * 0.01f;
+        objects[i].texture = (i / 16) % textureCount;
+    }
+
+    Surface *cube = Surface::CreateCube();
+    Mat4 projection = Mat4::ProjectionMatrix(45.0f * PI / 180.0f, (float)screenWidth / screenHeight, 0.1f, 1000.0f);
+    Mat4 view = Mat4::LookAt(Vec3(0, 0, 150.0f), Vec3(0, 0, 0), Vec3(0, 1, 0));
+    Mat4 viewProjection = projection * view;
+
+    auto recordRange = [&](CommandBuffer &buffer, int begin, int end, float time)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            Mat4 model;
+            if (!PrepareObject(objects[i], time, viewProjection, model))
+                continue;
+            buffer.BindTexture(0, &textures[objects[i].texture]);
+            buffer.SetMatrix4(modelLocation, model);
+            buffer.SetFloat4(tintLocation, 1.0f, 1.0f - (i % 7) * 0.1f, 1.0f, 1.0f);
+            buffer.Draw(cube);
+        }
+    };
+
+    // Recording cost without GL, one thread against the job system
+    {
+        CommandBuffer serial;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < 10; r++)
+        {
+            serial.Clear();
+            recordRange(serial, 0, objectCount, 0.0f);
+        }
+        double serialMs = ElapsedMs(start) / 10;
+
+        std::vector<CommandBuffer> buffers;
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < 10; r++)
+            RecordParallel(jobs, objectCount, recordGrain, buffers, [&](CommandBuffer &buffer, int begin, int end)
+            {
+                recordRange(buffer, begin, end, 0.0f);
+            });
+        double parallelMs = ElapsedMs(start) / 10;
+        Log(0, "COMMANDBENCH: %d commands (%.1f KB) recorded in %.3f ms on 1 thread, %.3f ms on %d threads",
+            serial.GetCount(), serial.GetSize() / 1024.0, serialMs, parallelMs, jobs.GetWorkerCount() + 1);
+    }
+
+    std::vector<CommandBuffer> buffers;
+    bool recorded = false;
+    bool spaceDown = false;
+    int frames = 0;
+    double prepareMs = 0.0, submitMs = 0.0;
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.1f, 0.1f, 0.15f, 1.0f);
+    while (!app.ShouldClose())
+    {
+        const Uint8 *keys = SDL_GetKeyboardState(NULL);
+        if (keys[SDL_SCANCODE_SPACE] && !spaceDown)
+        {
+            recorded = !recorded;
+            frames = 0;
+            prepareMs = submitMs = 0.0;
+        }
+        spaceDown = keys[SDL_SCANCODE_SPACE];
+
+        float time = SDL_GetTicks() / 1000.0f;
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        shader.Bind();
+        shader.setInt("tex", 0);
+        shader.setMatrix4("viewProjection", viewProjection);
+
+        auto start = std::chrono::steady_clock::now();
+        if (recorded)
+        {
+            RecordParallel(jobs, objectCount, recordGrain, buffers, [&](CommandBuffer &buffer, int begin, int end)
+            {
+                recordRange(buffer, begin, end, time);
+            });
+            prepareMs += ElapsedMs(start);
+            start = std::chrono::steady_clock::now();
+            CommandBuffer::Execute(buffers);
+        }
+        else
+        {
+            for (int i = 0; i < objectCount; i++)
+            {
+                Mat4 model;
+                if (!PrepareObject(objects[i], time, viewProjection, model))
+                    continue;
+                textures[objects[i].texture].Bind(0);
+                shader.setMatrix4("model", model);
+                shader.setFloat4("tint", 1.0f, 1.0f - (i % 7) * 0.1f, 1.0f, 1.0f);
+                cube->Render();
+            }
+        }
+        glFinish();
+        submitMs += ElapsedMs(start);
+        app.Swap();
+
+        if (++frames == 120)
+        {
+            Log(0, "COMMANDBENCH: %-8s prepare %.3f ms  submit %.3f ms  frame %.3f ms  (%d binds issued, %d skipped)",
+                recorded ? "recorded" : "direct", prepareMs / frames, submitMs / frames, (prepareMs + submitMs) / frames,
+                GLState::GetFrameCalls(), GLState::GetFrameSkipped());
+            frames = 0;
+            prepareMs = submitMs = 0.0;
+        }
+    }
+
+    delete cube;
+    return 0;
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <math.h>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+#include "../commands.hpp"
+
+// Render thread: the same frame (simulated game update of a few ms, then
+// 10k cubes recorded into a FramePacket) drawn either on the update thread
+// in App::Swap, or by the render thread while the next frame is updated.
+// The sample code is identical in both modes. Space toggles, timings are
+// logged every 120 frames.
+
+const int screenWidth = 1024;
+const int screenHeight = 768;
+const int cubeSide = 100;
+const int cubeCount = cubeSide * cubeSide;
+const double updateLoadMs = 6.0;
+
+const char *packetVertexShader = R"(
+#version 300 es
+precision mediump float;
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in vec3 aNormal;
+uniform mat4 model;
+uniform mat4 viewProjection;
+out vec3 Normal;
+void main()
+{
+    Normal = mat3(model) * aNormal;
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
+})";
+
+const char *packetFragmentShader = R"(
+#version 300 es
+precision mediump float;
+uniform vec4 color;
+in vec3 Normal;
+out vec4 FragColor;
+void main()
+{
+    float light = 0.3 + 0.7 * max(dot(normalize(Normal), normalize(vec3(0.3, 0.5, 1.0))), 0.0);
+    FragColor = vec4(color.rgb * light, 1.0);
+})";
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Stands in for game logic: burns updateLoadMs of CPU on the update thread
+static void SimulateUpdate()
+{
+    auto start = std::chrono::steady_clock::now();
+    volatile float sink = 0.0f;
+    int i = 0;
+    while (ElapsedMs(start) < updateLoadMs)
+        for (int k = 0; k < 1000; k++)
+            sink = sink + sinf((float)(i++));
+}
+
+int run_sample()
+{
+    App app;
+    app.CreateWindow(screenWidth, screenHeight, "Render thread", false);
+
+    // GL objects are created before the render thread takes the context and
+    // destroyed after it gives it back
+    Shader shader;
+    shader.create(packetVertexShader, packetFragmentShader);
+    shader.addUniform("model");
+    shader.addUniform("viewProjection");
+    shader.addUniform("color");
+    int modelLocation = shader.getUniformLocation("model");
+    int viewProjectionLocation = shader.getUniformLocation("viewProjection");
+    int colorLocation = shader.getUniformLocation("color");
+    Surface *cube = Surface::CreateCube();
+    glEnable(GL_DEPTH_TEST);
+
+    Mat4 projection = Mat4::ProjectionMatrix(45.0f * PI / 180.0f, (float)screenWidth / screenHeight, 0.1f, 1000.0f);
+    Mat4 view = Mat4::LookAt(Vec3(0, 0, 260.0f), Vec3(0, 0, 0), Vec3(0, 1, 0));
+    Mat4 viewProjection = projection * view;
+
+    bool spaceDown = false;
+    int frames = 0;
+    double updateMs = 0.0, frameMs = 0.0;
+    auto frameStart = std::chrono::steady_clock::now();
+    while (!app.ShouldClose())
+    {
+        const Uint8 *keys = SDL_GetKeyboardState(NULL);
+        if (keys[SDL_SCANCODE_SPACE] && !spaceDown)
+        {
+            if (app.IsRenderThreadRunning())
+                app.StopRenderThread();
+            else
+                app.StartRenderThread(3);
+            frames = 0;
+            updateMs = frameMs = 0.0;
+        }
+        spaceDown = keys[SDL_SCANCODE_SPACE];
+
+        auto start = std::chrono::steady_clock::now();
+        SimulateUpdate();
+        float time = SDL_GetTicks() / 1000.0f;
+
+        FramePacket &packet = app.BeginFrame();
+        packet.clearColor[0] = 0.1f;
+        packet.clearColor[1] = 0.1f;
+        packet.clearColor[2] = 0.15f;
+        packet.commands.BindShader(&shader);
+        packet.commands.SetMatrix4(viewProjectionLocation, viewProjection);
+        RecordParallel(app.GetJobs(), cubeCount, 1024, packet.buffers, [&](CommandBuffer &buffer, int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                float x = (i % cubeSide - cubeSide / 2) * 2.0f;
+                float y = (i / cubeSide - cubeSide / 2) * 2.0f;
+                Mat4 model = Mat4::Translate(x, y, 0) * Mat4::Rotate(Vec3(0.6f, 0.8f, 0.0f), time + i * 0.01f) * Mat4::Scale(0.7f, 0.7f, 0.7f);
+                buffer.SetMatrix4(modelLocation, model);
+                buffer.SetFloat4(colorLocation, (i % 7) / 7.0f, (i % 11) / 11.0f, 0.8f, 1.0f);
+                buffer.Draw(cube);
+            }
+        });
+        updateMs += ElapsedMs(start);
+        app.Swap();
+
+        frameMs += ElapsedMs(frameStart);
+        frameStart = std::chrono::steady_clock::now();
+        if (++frames == 120)
+        {
+            Log(0, "RENDERTHREAD: %-6s update %.2f ms  render %.2f ms  frame %.2f ms (%.0f fps)",
+                app.IsRenderThreadRunning() ? "thread" : "inline", updateMs / frames,
+                app.GetRenderFrameTime() * 1000.0, frameMs / frames, 1000.0 * frames / frameMs);
+            frames = 0;
+            updateMs = frameMs = 0.0;
+        }
+    }
+
+    app.StopRenderThread();
+    delete cube;
+    return 0;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <math.h>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+#include "../timer.hpp"
+
+// Frame pacing: a 120 fps loop with a few hundred microseconds of varying
+// work, paced by the old SDL_GetTicks/SDL_Delay scheme and by Timer::Wait.
+// Logs min/avg/p99 frame times and how far frames land from the target.
+// No window needed.
+
+const int pacingFps = 120;
+const int pacingFrames = 600;
+
+static void BusyWork(int frame)
+{
+    long long end = Timer::GetNanoseconds() + 200000 + (frame * 7919 % 5) * 100000;
+    while (Timer::GetNanoseconds() < end)
+        ;
+}
+
+static void MeasurePacing(const char *label, bool precise)
+{
+    const double target = 1.0 / pacingFps;
+    FrameStats stats(pacingFrames);
+    double error = 0.0;
+
+    long long previous = Timer::GetNanoseconds();
+    for (int frame = 0; frame < pacingFrames; frame++)
+    {
+        BusyWork(frame);
+        if (precise)
+        {
+            double elapsed = (Timer::GetNanoseconds() - previous) * 1e-9;
+            if (elapsed < target)
+                Timer::Wait(target - elapsed);
+        }
+        else
+        {
+            // What App did before: millisecond clock, whole millisecond sleeps
+            static Uint32 last = SDL_GetTicks();
+            double elapsed = (SDL_GetTicks() - last) / 1000.0;
+            if (elapsed < target)
+                SDL_Delay((int)((target - elapsed) * 1000.0f));
+            last = SDL_GetTicks();
+        }
+
+        long long now = Timer::GetNanoseconds();
+        double frameTime = (now - previous) * 1e-9;
+        previous = now;
+        stats.Add(frameTime);
+        error += fabs(frameTime - target);
+    }
+
+    stats.LogStats(label);
+    Log(0, "TIMER: %s mean error from %.3f ms target: %.3f ms", label, target * 1000.0, error / pacingFrames * 1000.0);
+}
+
+int run_sample()
+{
+    long long first = Timer::GetNanoseconds(), next;
+    do
+        next = Timer::GetNanoseconds();
+    while (next == first);
+    Log(0, "TIMER: smallest observable clock step %lld ns (SDL_GetTicks: 1000000 ns)", next - first);
+
+    MeasurePacing("SDL_Delay", false);
+    MeasurePacing("Timer::Wait", true);
+    return 0;
+}
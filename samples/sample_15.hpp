@@ -0,0 +1,123 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+
+// Logger throughput: N threads each log the kind of message the loaders
+// print (an id, a file name, a float), first through a copy of the old
+// synchronous Log and then through the queued one. Output goes to a file so
+// the terminal is not the bottleneck. No window needed.
+
+const int logMessagesPerThread = 100000;
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The previous Log: time/localtime/strftime, two format strings, the write
+// and an unused vsprintf, all on the calling thread
+static FILE *legacyFile = nullptr;
+static void LegacyLog(int severity, const char *fmt, ...)
+{
+    const char *type = severity == 0 ? "info" : severity == 1 ? "warning" : "error";
+    time_t rawTime;
+    time(&rawTime);
+    struct tm *timeInfo = localtime(&rawTime);
+    char timeBuffer[80];
+    strftime(timeBuffer, sizeof(timeBuffer), "[%H:%M:%S]", timeInfo);
+
+    char consoleFormat[1024];
+    snprintf(consoleFormat, 1024, "%s%s %s%s%s: %s\n", CONSOLE_COLOR_CYAN, timeBuffer, CONSOLE_COLOR_GREEN, type, CONSOLE_COLOR_RESET, fmt);
+    char fileFormat[1024];
+    snprintf(fileFormat, 1024, "%s %s: %s\n", timeBuffer, type, fmt);
+
+    va_list argptr;
+    va_start(argptr, fmt);
+    vfprintf(legacyFile, consoleFormat, argptr);
+    va_end(argptr);
+
+    char buf[4096];
+    va_start(argptr, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, argptr);
+    va_end(argptr);
+}
+
+template <typename F>
+static void MeasureLog(const char *label, int threads, const F &log)
+{
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back([t, &log]()
+        {
+            for (int i = 0; i < logMessagesPerThread; i++)
+                log(t, i);
+        });
+    for (std::thread &worker : workers)
+        worker.join();
+    double callMs = ElapsedMs(start);
+    LogFlush();
+    double totalMs = ElapsedMs(start);
+
+    double calls = (double)threads * logMessagesPerThread;
+    SetLogConsole(true);
+    Log(0, "LOGBENCH: %-6s %2d threads  %7.1f ns/call  %6.2f M calls/s  (%.1f M/s until written)", label, threads,
+        callMs * 1e6 / calls * threads, calls / callMs / 1000.0, calls / totalMs / 1000.0);
+    SetLogConsole(false);
+}
+
+int run_sample()
+{
+    int hardware = (int)std::thread::hardware_concurrency();
+    legacyFile = fopen("logbench_legacy.log", "w");
+    SetLogFile("logbench.log");
+    SetLogConsole(false);
+
+    static std::mutex legacyLock;
+    for (int threads = 1; threads <= hardware && threads <= 8; threads *= 2)
+    {
+        MeasureLog("legacy", threads, [](int t, int i)
+        {
+            std::lock_guard<std::mutex> guard(legacyLock);
+            LegacyLog(0, "VBO: [ID %i] Load vertex data from %s (%.2f ms)", i, "assets/cube.obj", t * 0.5f);
+        });
+        MeasureLog("queued", threads, [](int t, int i)
+        {
+            Log(0, "VBO: [ID %i] Load vertex data from %s (%.2f ms)", i, "assets/cube.obj", t * 0.5f);
+        });
+    }
+
+    // Cost seen by the caller while the queue has room, e.g. a load burst
+    const int burst = LOG_QUEUE_SIZE / 2;
+    double bestNs = 0.0;
+    for (int r = 0; r < 20; r++)
+    {
+        LogFlush();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < burst; i++)
+            Log(0, "VBO: [ID %i] Load vertex data from %s (%.2f ms)", i, "assets/cube.obj", r * 0.5f);
+        double ns = ElapsedMs(start) * 1e6 / burst;
+        if (r == 0 || ns < bestNs)
+            bestNs = ns;
+    }
+    LogFlush();
+    SetLogConsole(true);
+    Log(0, "LOGBENCH: queued, bursts of %d: %.1f ns/call", burst, bestNs);
+
+    SetLogFile(nullptr);
+    fclose(legacyFile);
+    remove("logbench.log");
+    remove("logbench_legacy.log");
+    return 0;
+}
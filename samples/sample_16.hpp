@@ -0,0 +1,118 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+
+// Text helpers: the buffer returning functions against the string_view ones
+// on typical asset path work (format a path, split it, take the directory,
+// name and extension, lowercase, check the extension). Then the same loop
+// on every hardware thread, checking each result, to show both sets are safe
+// to call concurrently. No window needed.
+
+const int textIterations = 200000;
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Returns a checksum so the work is not optimised away; 0 means a wrong result
+static size_t LegacyPathWork(int i)
+{
+    const char *path = TextFormat("assets/textures/level_%d/Brick_%04d.PNG", i % 16, i);
+    int count = 0;
+    const char **parts = TextSplit(path, '/', &count);
+    const char *directory = GetDirectoryPath(path);
+    const char *name = GetFileNameWithoutExt(path);
+    const char *lower = TextToLower(GetFileName(path));
+    bool isImage = IsFileExtension(path, ".png;.jpg");
+
+    char expected[32];
+    snprintf(expected, sizeof(expected), "Brick_%04d", i);
+    if (count != 4 || !TextIsEqual(name, expected) || !TextIsEqual(parts[1], "textures") || !isImage)
+        return 0;
+    return strlen(directory) + strlen(lower) + count;
+}
+
+static size_t ViewPathWork(int i)
+{
+    char path[128];
+    int length = TextFormatTo(path, sizeof(path), "assets/textures/level_%d/Brick_%04d.PNG", i % 16, i);
+    std::string_view view(path, length);
+    std::string_view parts[8];
+    int count = TextSplit(view, '/', parts, 8);
+    std::string_view directory = GetDirectoryPathView(view);
+    std::string_view name = GetFileNameWithoutExtView(view);
+    char lowerBuffer[64];
+    std::string_view lower = TextToLower(GetFileNameView(view), lowerBuffer, sizeof(lowerBuffer));
+    bool isImage = IsFileExtension(path, ".png;.jpg");
+
+    char expected[32];
+    int expectedLength = snprintf(expected, sizeof(expected), "Brick_%04d", i);
+    if (count != 4 || name != std::string_view(expected, expectedLength) || parts[1] != "textures" || !isImage)
+        return 0;
+    return directory.size() + lower.size() + count;
+}
+
+template<typename Work>
+static double Measure(Work work, int threadCount, bool *correct)
+{
+    std::atomic<bool> ok(true);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            size_t sum = 0;
+            for (int i = t; i < textIterations; i += threadCount)
+            {
+                size_t result = work(i);
+                if (result == 0)
+                    ok = false;
+                sum += result;
+            }
+            static std::atomic<size_t> sink;
+            sink += sum;
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    *correct = ok;
+    return ElapsedMs(start);
+}
+
+int run_sample()
+{
+    int threadCount = (int)std::thread::hardware_concurrency();
+    if (threadCount < 2)
+        threadCount = 2;
+
+    bool correct = false;
+    double legacy = Measure(LegacyPathWork, 1, &correct);
+    Log(0, "TEXT: legacy  1 thread   %8.2f ms (%.0f ns/path) %s", legacy, legacy * 1e6 / textIterations, correct ? "ok" : "WRONG");
+    double views = Measure(ViewPathWork, 1, &correct);
+    Log(0, "TEXT: views   1 thread   %8.2f ms (%.0f ns/path) %s", views, views * 1e6 / textIterations, correct ? "ok" : "WRONG");
+
+    legacy = Measure(LegacyPathWork, threadCount, &correct);
+    Log(0, "TEXT: legacy  %d threads  %8.2f ms %s", threadCount, legacy, correct ? "ok" : "WRONG");
+    views = Measure(ViewPathWork, threadCount, &correct);
+    Log(0, "TEXT: views   %d threads  %8.2f ms %s", threadCount, views, correct ? "ok" : "WRONG");
+
+    std::string_view first = TextFormatView("%s/%d", "arena", 1);
+    std::string_view second = TextFormatView("%s/%d", "arena", 2);
+    Log(0, "TEXT: arena views stay valid: %.*s %.*s", (int)first.size(), first.data(), (int)second.size(), second.data());
+    return 0;
+}
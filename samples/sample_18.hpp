@@ -0,0 +1,162 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <math.h>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+#include "../pool.hpp"
+
+// Geometry memory: builds 100k small procedural patches (2x2 to 7x7 quads)
+// three ways and frees them: std::vector with one push_back per element (what
+// Surface did), Surface::AddVertex/AddTriangle on pooled vectors, and
+// Surface::Reserve plus AddVertices/AddTriangles. The bulk path also runs on
+// the worker pool, since surfaces no longer need GL until Build(). Finally
+// 1000 surfaces are uploaded with Build(true) to show the CPU copy going away.
+
+const int patchCount = 100000;
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int PatchSide(int i)
+{
+    return 2 + i % 6;
+}
+
+static Vertex PatchVertex(int x, int z, int side)
+{
+    float u = (float)x / side, v = (float)z / side;
+    return Vertex(Vec3(u - 0.5f, 0.0f, v - 0.5f), Vec3(0, 1, 0), Color(), Vec2(u, v));
+}
+
+static void PatchTriangle(int x, int z, int side, int *out)
+{
+    int row = side + 1;
+    int a = z * row + x, b = a + 1, c = a + row, d = c + 1;
+    out[0] = a; out[1] = c; out[2] = b;
+    out[3] = b; out[4] = c; out[5] = d;
+}
+
+struct LegacyPatch
+{
+    std::vector<Vertex> vertices;
+    std::vector<int> indices;
+};
+
+static LegacyPatch *BuildLegacy(int i)
+{
+    int side = PatchSide(i);
+    LegacyPatch *patch = new LegacyPatch();
+    for (int z = 0; z <= side; z++)
+        for (int x = 0; x <= side; x++)
+            patch->vertices.push_back(PatchVertex(x, z, side));
+    for (int z = 0; z < side; z++)
+        for (int x = 0; x < side; x++)
+        {
+            int quad[6];
+            PatchTriangle(x, z, side, quad);
+            for (int k = 0; k < 6; k++)
+                patch->indices.push_back(quad[k]);
+        }
+    return patch;
+}
+
+static Surface *BuildPerElement(int i)
+{
+    int side = PatchSide(i);
+    Surface *surface = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+    for (int z = 0; z <= side; z++)
+        for (int x = 0; x <= side; x++)
+            surface->AddVertex(PatchVertex(x, z, side));
+    for (int z = 0; z < side; z++)
+        for (int x = 0; x < side; x++)
+        {
+            int quad[6];
+            PatchTriangle(x, z, side, quad);
+            surface->AddTriangle(quad[0], quad[1], quad[2]);
+            surface->AddTriangle(quad[3], quad[4], quad[5]);
+        }
+    return surface;
+}
+
+static Surface *BuildBulk(int i)
+{
+    int side = PatchSide(i);
+    Vertex vertices[8 * 8];
+    int indices[7 * 7 * 6];
+    int vertexCount = 0, triangleCount = 0;
+    for (int z = 0; z <= side; z++)
+        for (int x = 0; x <= side; x++)
+            vertices[vertexCount++] = PatchVertex(x, z, side);
+    for (int z = 0; z < side; z++)
+        for (int x = 0; x < side; x++, triangleCount += 2)
+            PatchTriangle(x, z, side, indices + triangleCount * 3);
+
+    Surface *surface = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+    surface->Reserve(vertexCount, triangleCount * 3);
+    int base = surface->AddVertices(vertices, vertexCount);
+    surface->AddTriangles(indices, triangleCount, base);
+    return surface;
+}
+
+// Builds all patches with build, frees them with destroy; the second round
+// shows the cost once the allocator has warm memory to recycle
+template<typename T, typename Build>
+static void MeasureBuild(const char *label, std::vector<T*> &items, Build build)
+{
+    for (int round = 0; round < 2; round++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < patchCount; i++)
+            items[i] = build(i);
+        double buildMs = ElapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        for (T *item : items)
+            delete item;
+        Log(0, "GEOMETRY: %-24s %s %8.2f ms build  %6.2f ms free", label, round == 0 ? "cold" : "warm", buildMs, ElapsedMs(start));
+    }
+}
+
+int run_sample()
+{
+    App app;
+    app.CreateWindow(800, 600, "Geometry pool", false);
+
+    std::vector<LegacyPatch*> patches(patchCount);
+    std::vector<Surface*> surfaces(patchCount);
+    MeasureBuild("std::vector push_back", patches, BuildLegacy);
+    MeasureBuild("pooled AddVertex", surfaces, BuildPerElement);
+    MeasureBuild("pooled bulk", surfaces, BuildBulk);
+
+    auto start = std::chrono::steady_clock::now();
+    app.GetJobs().ParallelFor(patchCount, 1024, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+            surfaces[i] = BuildBulk(i);
+    });
+    Log(0, "GEOMETRY: pooled bulk on %d threads  %8.2f ms build", app.GetJobs().GetWorkerCount() + 1, ElapsedMs(start));
+    GeometryPool::LogStats();
+
+    // Upload a few and drop their CPU copies
+    const int uploadCount = 1000;
+    size_t before = GeometryPool::GetPooledBytes();
+    for (int i = 0; i < uploadCount; i++)
+        surfaces[i]->Build(true);
+    Log(0, "GEOMETRY: Build(true) on %d surfaces freed %zu KB of CPU geometry", uploadCount,
+        (before - GeometryPool::GetPooledBytes()) / 1024);
+
+    for (Surface *surface : surfaces)
+        delete surface;
+    GeometryPool::LogStats();
+    return 0;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <math.h>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+
+// Memory accounting: loads textures, builds a few hundred surfaces and reads a
+// shader file with budgets set on the texture and GPU tags, dumps the per tag
+// table, frees everything and dumps again (current back down, peaks kept).
+// M dumps the table at any time. Build with make MEMORY_TRACKING=1, otherwise
+// the dumps only log that tracking is off.
+
+const int screenWidth = 1024;
+const int screenHeight = 768;
+
+const char *memoryVertexShader = R"(
+#version 300 es
+precision mediump float;
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+uniform mat4 mvp;
+out vec2 TexCoord;
+void main()
+{
+    TexCoord = aTexCoord;
+    gl_Position = mvp * vec4(aPos, 1.0);
+})";
+
+const char *memoryFragmentShader = R"(
+#version 300 es
+precision mediump float;
+uniform sampler2D tex;
+in vec2 TexCoord;
+out vec4 FragColor;
+void main()
+{
+    FragColor = texture(tex, TexCoord);
+})";
+
+int run_sample()
+{
+    App app;
+    app.CreateWindow(screenWidth, screenHeight, "Memory tracking", false);
+
+    MemoryTracker::SetBudget(MEMORY_TEXTURE, 16 * 1024 * 1024);
+    MemoryTracker::SetBudget(MEMORY_GPU_TEXTURE, 8 * 1024 * 1024);
+    MemoryTracker::SetBudget(MEMORY_GPU_BUFFER, 4 * 1024 * 1024);
+
+    Shader shader;
+    shader.create(memoryVertexShader, memoryFragmentShader);
+    shader.LoadDefaults();
+
+    std::vector<Texture2D*> textures;
+    const char *files[] = { "assets/container2.png", "assets/f117.png" };
+    for (const char *file : files)
+    {
+        Texture2D *texture = new Texture2D();
+        if (texture->Load(file))
+            textures.push_back(texture);
+        else
+            delete texture;
+    }
+
+    std::vector<Surface*> surfaces;
+    for (int i = 0; i < 300; i++)
+    {
+        Surface *surface = (i % 2) ? Surface::CreateCube() : Surface::CreatePlane(1.0f + i * 0.01f, 1.0f);
+        surfaces.push_back(surface);
+    }
+
+    unsigned int bytesRead = 0;
+    unsigned char *data = LoadFileData("assets/cube.obj", &bytesRead);
+    char *text = TextInsert("memory tracking", "per tag ", 7);
+    Log(0, "MEMORY: loaded %u bytes, built \"%s\"", bytesRead, text);
+    MemoryTracker::Dump();
+
+    UnloadFileData(data);
+    MemFree(text);
+    for (Surface *surface : surfaces)
+        delete surface;
+    surfaces.clear();
+    MemoryTracker::Dump();
+
+    glClearColor(0.1f, 0.1f, 0.15f, 1.0f);
+    Surface *plane = Surface::CreatePlane(1.0f, 1.0f);
+    bool dumpDown = false;
+    while (!app.ShouldClose())
+    {
+        const Uint8 *keys = SDL_GetKeyboardState(NULL);
+        if (keys[SDL_SCANCODE_M] && !dumpDown)
+            MemoryTracker::Dump();
+        dumpDown = keys[SDL_SCANCODE_M];
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        shader.Bind();
+        shader.setMatrix4("mvp", Mat4::Rotate(Vec3(1, 0, 0), -1.2f));
+        shader.setInt("tex", 0);
+        if (!textures.empty())
+            textures[0]->Bind(0);
+        plane->Render();
+        app.Swap();
+    }
+
+    delete plane;
+    for (Texture2D *texture : textures)
+        delete texture;
+    return 0;
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <math.h>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+
+// Procedural shapes: times a 4096x4096 grid built one AddVertex/VertexNormal/
+// VertexTexCoords/AddTriangle call at a time, with GenerateGrid on one thread
+// and with GenerateGrid split in row strips over the worker pool, then draws a
+// grid, sphere, cylinder and torus built by the Create* helpers.
+
+const int screenWidth = 1024;
+const int screenHeight = 768;
+const int bigGridSlices = 4096;
+
+const char *shapesVertexShader = R"(
+#version 300 es
+precision mediump float;
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 3) in vec3 aNormal;
+uniform mat4 model;
+uniform mat4 viewProjection;
+out vec3 Normal;
+out vec2 TexCoord;
+void main()
+{
+    Normal = mat3(model) * aNormal;
+    TexCoord = aTexCoord;
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
+})";
+
+const char *shapesFragmentShader = R"(
+#version 300 es
+precision mediump float;
+uniform vec4 color;
+in vec3 Normal;
+in vec2 TexCoord;
+out vec4 FragColor;
+void main()
+{
+    float light = 0.3 + 0.7 * max(dot(normalize(Normal), normalize(vec3(0.3, 0.8, 0.5))), 0.0);
+    float checker = mod(floor(TexCoord.x * 16.0) + floor(TexCoord.y * 16.0), 2.0) * 0.2 + 0.8;
+    FragColor = vec4(color.rgb * light * checker, color.a);
+})";
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static Surface *BuildGridPerElement(int slices)
+{
+    Surface *surface = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+    const int row = slices + 1;
+    for (int z = 0; z <= slices; z++)
+        for (int x = 0; x <= slices; x++)
+        {
+            int i = surface->AddVertex(-1.0f + 2.0f * x / slices, 0.0f, -1.0f + 2.0f * z / slices);
+            surface->VertexNormal(i, 0.0f, 1.0f, 0.0f);
+            surface->VertexTexCoords(i, (float)x / slices, 1.0f - (float)z / slices);
+        }
+    for (int z = 0; z < slices; z++)
+        for (int x = 0; x < slices; x++)
+        {
+            int a = z * row + x;
+            surface->AddTriangle(a, a + row, a + 1);
+            surface->AddTriangle(a + 1, a + row, a + row + 1);
+        }
+    return surface;
+}
+
+int run_sample()
+{
+    App app;
+    app.CreateWindow(screenWidth, screenHeight, "Procedural shapes", false);
+
+    auto start = std::chrono::steady_clock::now();
+    Surface *grid = BuildGridPerElement(bigGridSlices);
+    Log(0, "SHAPES: %dx%d grid per element      %8.1f ms", bigGridSlices, bigGridSlices, ElapsedMs(start));
+    delete grid;
+
+    start = std::chrono::steady_clock::now();
+    grid = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+    Surface::GenerateGrid(*grid, 1.0f, 1.0f, bigGridSlices, bigGridSlices);
+    Log(0, "SHAPES: %dx%d grid bulk, 1 thread   %8.1f ms", bigGridSlices, bigGridSlices, ElapsedMs(start));
+    delete grid;
+
+    start = std::chrono::steady_clock::now();
+    grid = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+    Surface::GenerateGrid(*grid, 1.0f, 1.0f, bigGridSlices, bigGridSlices, &app.GetJobs());
+    Log(0, "SHAPES: %dx%d grid bulk, %d threads  %8.1f ms (%d vertices, %d triangles)", bigGridSlices, bigGridSlices,
+        app.GetJobs().GetWorkerCount() + 1, ElapsedMs(start), grid->CountVertices(), grid->CountIndices() / 3);
+    delete grid;
+
+    Shader shader;
+    shader.create(shapesVertexShader, shapesFragmentShader);
+    shader.LoadDefaults();
+
+    Surface *shapes[4] =
+    {
+        Surface::CreateGrid(6.0f, 6.0f, 64, 64, &app.GetJobs()),
+        Surface::CreateSphere(1.0f, 32, 64),
+        Surface::CreateCylinder(0.8f, 2.0f, 48, 4),
+        Surface::CreateTorus(1.0f, 0.35f, 64, 24),
+    };
+    const Vec3 positions[4] = { Vec3(0, -1.5f, 0), Vec3(-3, 0, 0), Vec3(0, 0, 0), Vec3(3, 0, 0) };
+    const Color colors[4] = { Color(0.5f, 0.5f, 0.5f, 1), Color(0.9f, 0.4f, 0.3f, 1), Color(0.3f, 0.8f, 0.4f, 1), Color(0.3f, 0.5f, 0.9f, 1) };
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glClearColor(0.1f, 0.1f, 0.15f, 1.0f);
+
+    Mat4 projection = Mat4::ProjectionMatrix(45.0f * PI / 180.0f, (float)screenWidth / screenHeight, 0.1f, 100.0f);
+    while (!app.ShouldClose())
+    {
+        float time = SDL_GetTicks() / 1000.0f;
+        Vec3 eye(sinf(time * 0.3f) * 10.0f, 4.0f, cosf(time * 0.3f) * 10.0f);
+        Mat4 viewProjection = projection * Mat4::LookAt(eye, Vec3(0, 0, 0), Vec3(0, 1, 0));
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        shader.Bind();
+        shader.setMatrix4("viewProjection", viewProjection);
+        for (int i = 0; i < 4; i++)
+        {
+            shader.setMatrix4("model", Mat4::Translate(positions[i].x, positions[i].y, positions[i].z));
+            shader.setFloat4("color", colors[i].r, colors[i].g, colors[i].b, colors[i].a);
+            shapes[i]->Render();
+        }
+        app.Swap();
+    }
+
+    for (Surface *shape : shapes)
+        delete shape;
+    return 0;
+}
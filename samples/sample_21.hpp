@@ -0,0 +1,129 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <math.h>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+#include "../terrain.hpp"
+
+// Terrain: an endless landscape streamed in tiles around a camera flying over
+// it. Heights come from fractal value noise generated on the workers (point
+// Init at a "tile_%d_%d.png" pattern to stream heightmaps from disk instead).
+// W/S change the speed, space pauses; stats are logged every 120 frames.
+
+const int screenWidth = 1024;
+const int screenHeight = 768;
+
+static float NoiseHash(int x, int z)
+{
+    unsigned int h = (unsigned int)x * 374761393u + (unsigned int)z * 668265263u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return (float)((h ^ (h >> 16)) & 0xffff) / 65535.0f;
+}
+
+static float ValueNoise(float x, float z)
+{
+    int ix = (int)floorf(x), iz = (int)floorf(z);
+    float fx = x - ix, fz = z - iz;
+    fx = fx * fx * (3.0f - 2.0f * fx);
+    fz = fz * fz * (3.0f - 2.0f * fz);
+    float a = NoiseHash(ix, iz), b = NoiseHash(ix + 1, iz);
+    float c = NoiseHash(ix, iz + 1), d = NoiseHash(ix + 1, iz + 1);
+    return (a + (b - a) * fx) + ((c + (d - c) * fx) - (a + (b - a) * fx)) * fz;
+}
+
+// Samples are placed by world sample index, so neighbouring tiles share their edges
+static bool GenerateTile(int tileX, int tileZ, int samples, float *heights)
+{
+    const int tileSize = samples - 1;
+    for (int z = 0; z < samples; z++)
+        for (int x = 0; x < samples; x++)
+        {
+            float wx = (float)(tileX * tileSize + x) / 256.0f;
+            float wz = (float)(tileZ * tileSize + z) / 256.0f;
+            float height = 0.0f, amplitude = 0.5f;
+            for (int octave = 0; octave < 6; octave++)
+            {
+                height += ValueNoise(wx, wz) * amplitude;
+                wx *= 2.03f;
+                wz *= 2.03f;
+                amplitude *= 0.5f;
+            }
+            heights[z * samples + x] = height * height;
+        }
+    return true;
+}
+
+int run_sample()
+{
+    App app;
+    app.CreateWindow(screenWidth, screenHeight, "Terrain", false);
+
+    TerrainSettings settings;
+    settings.tileSize = 256;
+    settings.patchSize = 32;
+    settings.spacing = 2.0f;
+    settings.heightScale = 220.0f;
+    settings.lodDistance = 192.0f;
+    settings.loadRadius = 3;
+
+    Terrain terrain;
+    if (!terrain.Init(settings, GenerateTile, &app.GetJobs()))
+        return 1;
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glClearColor(0.55f, 0.7f, 0.9f, 1.0f);
+
+    Mat4 projection = Mat4::ProjectionMatrix(60.0f * PI / 180.0f, (float)screenWidth / screenHeight, 1.0f, 4000.0f);
+    Vec3 eye(0.0f, 100.0f, 0.0f);
+    float heading = 0.0f;
+    float speed = 60.0f;
+    bool paused = false;
+    bool spaceDown = false;
+    int frames = 0;
+    Uint32 last = SDL_GetTicks();
+    while (!app.ShouldClose())
+    {
+        Uint32 now = SDL_GetTicks();
+        float dt = (now - last) / 1000.0f;
+        last = now;
+
+        const Uint8 *keys = SDL_GetKeyboardState(NULL);
+        if (keys[SDL_SCANCODE_W]) speed = std::min(speed * 1.02f, 2000.0f);
+        if (keys[SDL_SCANCODE_S]) speed = std::max(speed / 1.02f, 5.0f);
+        if (keys[SDL_SCANCODE_SPACE] && !spaceDown)
+            paused = !paused;
+        spaceDown = keys[SDL_SCANCODE_SPACE];
+
+        if (!paused)
+        {
+            heading += dt * 0.05f;
+            eye.x += cosf(heading) * speed * dt;
+            eye.z += sinf(heading) * speed * dt;
+            float ground = terrain.GetHeight(eye.x, eye.z);
+            eye.y += (ground + 40.0f - eye.y) * std::min(dt * 2.0f, 1.0f);
+        }
+        Vec3 target(eye.x + cosf(heading) * 100.0f, eye.y - 25.0f, eye.z + sinf(heading) * 100.0f);
+        Mat4 viewProjection = projection * Mat4::LookAt(eye, target, Vec3(0, 1, 0));
+
+        terrain.Update(eye);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        terrain.Render(viewProjection, eye);
+        app.Swap();
+
+        if (++frames == 120)
+        {
+            terrain.LogStats();
+            frames = 0;
+        }
+    }
+    return 0;
+}
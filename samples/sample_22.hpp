@@ -0,0 +1,133 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <math.h>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+
+// Mesh LOD: a dense torus (or assets/lod.obj when present) baked into a chain
+// of simplified levels, drawn 24x24 times over a field the camera flies along.
+// Each copy picks the coarsest level whose error stays under a pixel. L turns
+// LOD selection off and on; triangles with and without LOD are logged every
+// 120 frames.
+
+const int screenWidth = 1024;
+const int screenHeight = 768;
+const int fieldSize = 24;
+const float fieldSpacing = 6.0f;
+
+const char *lodVertexShader = R"(
+#version 300 es
+precision mediump float;
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in vec3 aNormal;
+uniform mat4 model;
+uniform mat4 viewProjection;
+out vec3 Normal;
+void main()
+{
+    Normal = mat3(model) * aNormal;
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
+})";
+
+const char *lodFragmentShader = R"(
+#version 300 es
+precision mediump float;
+uniform vec4 color;
+in vec3 Normal;
+out vec4 FragColor;
+void main()
+{
+    float light = 0.3 + 0.7 * max(dot(normalize(Normal), normalize(vec3(0.3, 0.8, 0.5))), 0.0);
+    FragColor = vec4(color.rgb * light, color.a);
+})";
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int run_sample()
+{
+    App app;
+    app.CreateWindow(screenWidth, screenHeight, "Mesh LOD", false);
+
+    Mesh mesh;
+    if (!FileExists("assets/lod.obj") || !mesh.LoadObj("assets/lod.obj"))
+    {
+        Surface *torus = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+        Surface::GenerateTorus(*torus, 1.5f, 0.6f, 256, 128, &app.GetJobs());
+        torus->Build();
+        mesh.AddSurface(torus);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int levels = mesh.GenerateLODs(5, 0.4f);
+    Log(0, "LOD: baked %d levels in %.1f ms", levels, ElapsedMs(start));
+    // Fit the model to the field spacing whatever its size
+    float fit = mesh.GetRadius() > 0.0f ? 2.0f / mesh.GetRadius() : 1.0f;
+
+    Shader shader;
+    shader.create(lodVertexShader, lodFragmentShader);
+    shader.LoadDefaults();
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glClearColor(0.1f, 0.1f, 0.15f, 1.0f);
+
+    Mat4 projection = Mat4::ProjectionMatrix(1.0f, (float)screenWidth / screenHeight, 0.1f, 500.0f);
+    const Color levelColors[6] = { Color(0.9f, 0.9f, 0.9f, 1), Color(0.3f, 0.8f, 0.4f, 1), Color(0.3f, 0.6f, 0.9f, 1),
+                                   Color(0.9f, 0.8f, 0.3f, 1), Color(0.9f, 0.5f, 0.2f, 1), Color(0.9f, 0.3f, 0.3f, 1) };
+    LODStats stats;
+    bool useLOD = true;
+    bool lDown = false;
+    int frames = 0;
+    while (!app.ShouldClose())
+    {
+        const Uint8 *keys = SDL_GetKeyboardState(NULL);
+        if (keys[SDL_SCANCODE_L] && !lDown)
+        {
+            useLOD = !useLOD;
+            Log(0, "LOD: %s", useLOD ? "on" : "off");
+        }
+        lDown = keys[SDL_SCANCODE_L];
+
+        float time = SDL_GetTicks() / 1000.0f;
+        float half = fieldSize * fieldSpacing * 0.5f;
+        Vec3 eye(sinf(time * 0.2f) * half * 0.5f, 6.0f, -half - 10.0f + (1.0f - cosf(time * 0.15f)) * half);
+        Mat4 viewProjection = projection * Mat4::LookAt(eye, Vec3(eye.x * 0.5f, 0, eye.z + 40.0f), Vec3(0, 1, 0));
+
+        LODView view(eye, projection, screenHeight, 1.0f);
+        view.enabled = useLOD;
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        shader.Bind();
+        shader.setMatrix4("viewProjection", viewProjection);
+        for (int z = 0; z < fieldSize; z++)
+            for (int x = 0; x < fieldSize; x++)
+            {
+                Mat4 model = Mat4::Translate(x * fieldSpacing - half, 0.0f, z * fieldSpacing - half) * Mat4::Scale(fit, fit, fit);
+                const Color &color = levelColors[std::min(mesh.SelectLOD(0, view, model), 5)];
+                shader.setMatrix4("model", model);
+                shader.setFloat4("color", color.r, color.g, color.b, color.a);
+                mesh.Render(view, model, &stats);
+            }
+        app.Swap();
+
+        if (++frames == 120)
+        {
+            Mesh::LogStats(stats);
+            stats.Reset();
+            frames = 0;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <math.h>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+
+// Meshlets: a dense mesh (assets/scan.obj when present, otherwise a bumpy
+// sphere of about a million triangles) split into clusters of at most 64
+// vertices and 124 triangles. The camera skims the surface, so most clusters
+// are off screen or facing away; each frame only the survivors' indices are
+// streamed and drawn. C switches between cluster culling and drawing the whole
+// mesh; the last frame's rejection stats are logged every 120 frames.
+
+const int screenWidth = 1024;
+const int screenHeight = 768;
+
+const char *meshletVertexShader = R"(
+#version 300 es
+precision mediump float;
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in vec3 aNormal;
+uniform mat4 model;
+uniform mat4 viewProjection;
+out vec3 Normal;
+void main()
+{
+    Normal = mat3(model) * aNormal;
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
+})";
+
+const char *meshletFragmentShader = R"(
+#version 300 es
+precision mediump float;
+in vec3 Normal;
+out vec4 FragColor;
+void main()
+{
+    float light = 0.25 + 0.75 * max(dot(normalize(Normal), normalize(vec3(0.3, 0.8, 0.5))), 0.0);
+    FragColor = vec4(vec3(0.8, 0.75, 0.7) * light, 1.0);
+})";
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int run_sample()
+{
+    App app;
+    app.CreateWindow(screenWidth, screenHeight, "Meshlets", false);
+
+    Mesh mesh;
+    if (!FileExists("assets/scan.obj") || !mesh.LoadObj("assets/scan.obj"))
+    {
+        Surface *sphere = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+        Surface::GenerateSphere(*sphere, 1.0f, 512, 1024, &app.GetJobs());
+        Vertex *vertices = (Vertex*)sphere->VertexData();
+        for (int i = 0; i < sphere->CountVertices(); i++)
+            vertices[i].pos = vertices[i].pos * (1.0f + 0.03f * sinf(vertices[i].pos.x * 23.0f) * cosf(vertices[i].pos.z * 19.0f));
+        sphere->Build();
+        mesh.AddSurface(sphere);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int meshlets = mesh.BuildMeshlets();
+    Log(0, "MESHLET: built %d meshlets in %.1f ms", meshlets, ElapsedMs(start));
+    float fit = mesh.GetRadius() > 0.0f ? 1.0f / mesh.GetRadius() : 1.0f;
+    Mat4 model = Mat4::Scale(fit, fit, fit) * Mat4::Translate(-mesh.GetCenter().x, -mesh.GetCenter().y, -mesh.GetCenter().z);
+
+    Shader shader;
+    shader.create(meshletVertexShader, meshletFragmentShader);
+    shader.LoadDefaults();
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glClearColor(0.1f, 0.1f, 0.15f, 1.0f);
+
+    Mat4 projection = Mat4::ProjectionMatrix(1.0f, (float)screenWidth / screenHeight, 0.01f, 100.0f);
+    MeshletStats stats;
+    bool useClusters = true;
+    bool cDown = false;
+    int frames = 0;
+    double cullMs = 0.0;
+    while (!app.ShouldClose())
+    {
+        const Uint8 *keys = SDL_GetKeyboardState(NULL);
+        if (keys[SDL_SCANCODE_C] && !cDown)
+        {
+            useClusters = !useClusters;
+            Log(0, "MESHLET: cluster culling %s", useClusters ? "on" : "off");
+        }
+        cDown = keys[SDL_SCANCODE_C];
+
+        float time = SDL_GetTicks() / 1000.0f;
+        Vec3 eye(sinf(time * 0.2f) * 1.3f, 0.3f, cosf(time * 0.2f) * 1.3f);
+        Vec3 target(sinf(time * 0.2f + 0.8f) * 1.0f, 0.0f, cosf(time * 0.2f + 0.8f) * 1.0f);
+        Mat4 viewProjection = projection * Mat4::LookAt(eye, target, Vec3(0, 1, 0));
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        shader.Bind();
+        shader.setMatrix4("viewProjection", viewProjection);
+        shader.setMatrix4("model", model);
+        stats.Reset();
+        if (useClusters)
+        {
+            start = std::chrono::steady_clock::now();
+            mesh.RenderClusters(viewProjection, model, eye, &stats);
+            cullMs += ElapsedMs(start);
+        }
+        else
+            mesh.Render();
+        app.Swap();
+
+        if (++frames == 120)
+        {
+            if (useClusters)
+            {
+                Mesh::LogStats(stats);
+                Log(0, "MESHLET: cull and stream %.2f ms per frame", cullMs / frames);
+            }
+            cullMs = 0.0;
+            frames = 0;
+        }
+    }
+    return 0;
+}
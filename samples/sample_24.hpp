@@ -0,0 +1,287 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <math.h>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+#include "../occlusion.hpp"
+
+// Occlusion culling: a city of 48x48 blocks, each with a building and a few
+// props, seen from street level. Every frame the nearest buildings in view are
+// rasterized into a 320x192 CPU depth buffer and all other objects that pass
+// frustum culling are tested against it before drawing. At startup the raster
+// and test passes are timed on one thread and on the worker pool. O toggles
+// occlusion culling; draw counts with and without it are logged every 120
+// frames.
+
+const int screenWidth = 1024;
+const int screenHeight = 768;
+const int cityBlocks = 48;
+const float blockSize = 24.0f;
+const int propsPerBlock = 8;
+const int maxOccluders = 48;
+
+const char *cityVertexShader = R"(
+#version 300 es
+precision mediump float;
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in vec3 aNormal;
+uniform mat4 model;
+uniform mat4 viewProjection;
+out vec3 Normal;
+void main()
+{
+    Normal = mat3(model) * aNormal;
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
+})";
+
+const char *cityFragmentShader = R"(
+#version 300 es
+precision mediump float;
+uniform vec4 color;
+in vec3 Normal;
+out vec4 FragColor;
+void main()
+{
+    float light = 0.35 + 0.65 * max(dot(normalize(Normal), normalize(vec3(0.4, 0.8, 0.3))), 0.0);
+    FragColor = vec4(color.rgb * light, 1.0);
+})";
+
+struct CityObject
+{
+    Mat4  model;
+    Vec3  mins;
+    Vec3  maxs;
+    Color color;
+    bool  building;
+};
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static float CityRandom(unsigned int &seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) / 16777216.0f;
+}
+
+// The unit cube spans -1..1, so the model is a translate and a half extent scale
+static CityObject MakeBox(const Vec3 &mins, const Vec3 &maxs, const Color &color, bool building)
+{
+    CityObject object;
+    Vec3 center = (mins + maxs) * 0.5f, half = (maxs - mins) * 0.5f;
+    object.model = Mat4::Translate(center.x, center.y, center.z) * Mat4::Scale(half.x, half.y, half.z);
+    object.mins = mins;
+    object.maxs = maxs;
+    object.color = color;
+    object.building = building;
+    return object;
+}
+
+static void BuildCity(std::vector<CityObject> &objects)
+{
+    unsigned int seed = 7;
+    const float half = cityBlocks * blockSize * 0.5f;
+    for (int bz = 0; bz < cityBlocks; bz++)
+        for (int bx = 0; bx < cityBlocks; bx++)
+        {
+            // 6 unit streets between blocks
+            float x0 = bx * blockSize - half + 3.0f, z0 = bz * blockSize - half + 3.0f;
+            float size = blockSize - 6.0f;
+            float width = size * (0.6f + 0.4f * CityRandom(seed)), depth = size * (0.6f + 0.4f * CityRandom(seed));
+            float height = 12.0f + 60.0f * CityRandom(seed) * CityRandom(seed);
+            float grey = 0.45f + 0.3f * CityRandom(seed);
+            Vec3 mins(x0 + (size - width) * 0.5f, 0.0f, z0 + (size - depth) * 0.5f);
+            objects.push_back(MakeBox(mins, mins + Vec3(width, height, depth), Color(grey, grey, grey * 1.05f, 1), true));
+
+            for (int p = 0; p < propsPerBlock; p++)
+            {
+                float px = x0 + size * CityRandom(seed), pz = z0 + size * CityRandom(seed);
+                float s = 0.5f + 1.5f * CityRandom(seed);
+                Vec3 propMins(px, 0.0f, pz);
+                objects.push_back(MakeBox(propMins, propMins + Vec3(s, s * 1.5f, s), Color(0.8f, 0.4f + 0.4f * CityRandom(seed), 0.2f, 1), false));
+            }
+        }
+}
+
+struct CityFrame
+{
+    std::vector<int> inFrustum;
+    std::vector<int> occluders;
+    std::vector<Vec3> mins;
+    std::vector<Vec3> maxs;
+    std::vector<int> tested;
+    std::vector<unsigned char> visible;
+};
+
+// Frustum culls, rasterizes the nearest buildings and tests everything else
+static void CullCity(const std::vector<CityObject> &objects, const Surface *cube, const Mat4 &viewProjection, const Vec3 &eye,
+                     OcclusionBuffer &occlusion, JobSystem *jobs, CityFrame &frame)
+{
+    Frustum frustum;
+    frustum.buildViewFrustum(viewProjection);
+    frame.inFrustum.clear();
+    for (int i = 0; i < (int)objects.size(); i++)
+        if (!frustum.cullBox(objects[i].mins, objects[i].maxs))
+            frame.inFrustum.push_back(i);
+
+    frame.occluders.clear();
+    for (int i : frame.inFrustum)
+        if (objects[i].building)
+            frame.occluders.push_back(i);
+    auto distance = [&](int i) { Vec3 center = (objects[i].mins + objects[i].maxs) * 0.5f; return (center - eye).length_squared(); };
+    if ((int)frame.occluders.size() > maxOccluders)
+    {
+        std::nth_element(frame.occluders.begin(), frame.occluders.begin() + maxOccluders, frame.occluders.end(),
+                         [&](int a, int b) { return distance(a) < distance(b); });
+        frame.occluders.resize(maxOccluders);
+    }
+
+    occlusion.BeginFrame(viewProjection);
+    for (int i : frame.occluders)
+        occlusion.AddOccluder(cube, objects[i].model);
+    occlusion.Rasterize(jobs);
+
+    frame.mins.clear();
+    frame.maxs.clear();
+    frame.tested.clear();
+    for (int i : frame.inFrustum)
+        if (std::find(frame.occluders.begin(), frame.occluders.end(), i) == frame.occluders.end())
+        {
+            frame.tested.push_back(i);
+            frame.mins.push_back(objects[i].mins);
+            frame.maxs.push_back(objects[i].maxs);
+        }
+    frame.visible.resize(frame.tested.size());
+    occlusion.TestBoxes(frame.mins.data(), frame.maxs.data(), (int)frame.tested.size(), frame.visible.data(), jobs);
+}
+
+int run_sample()
+{
+    App app;
+    app.CreateWindow(screenWidth, screenHeight, "Occlusion culling", false);
+
+    std::vector<CityObject> objects;
+    BuildCity(objects);
+    Surface *cube = Surface::CreateCube();
+
+    OcclusionBuffer occlusion;
+    occlusion.Init(320, 192);
+
+    Mat4 projection = Mat4::ProjectionMatrix(1.0f, (float)screenWidth / screenHeight, 0.5f, 2000.0f);
+    const float half = cityBlocks * blockSize * 0.5f;
+    CityFrame frame;
+
+    // Benchmark from a fixed street corner
+    {
+        Vec3 eye(-half + 1.5f, 2.0f, -half + 1.5f);
+        Mat4 viewProjection = projection * Mat4::LookAt(eye, Vec3(0, 2.0f, 0), Vec3(0, 1, 0));
+        const int runs = 50;
+        for (int threads = 0; threads < 2; threads++)
+        {
+            JobSystem *jobs = threads ? &app.GetJobs() : nullptr;
+            double raster = 0.0, tests = 0.0;
+            for (int run = 0; run < runs; run++)
+            {
+                CullCity(objects, cube, viewProjection, eye, occlusion, jobs, frame);
+                raster += occlusion.GetStats().setupMs + occlusion.GetStats().rasterMs;
+                tests += occlusion.GetStats().testMs;
+            }
+            Log(0, "CITY: %d threads, raster %.3f ms, %d box tests %.3f ms", jobs ? jobs->GetWorkerCount() + 1 : 1,
+                raster / runs, occlusion.GetStats().tests, tests / runs);
+        }
+        occlusion.LogStats();
+        int drawn = (int)frame.occluders.size();
+        for (unsigned char visible : frame.visible)
+            drawn += visible;
+        Log(0, "CITY: %d objects, %d in the frustum, %d drawn with occlusion culling (%d draws eliminated)",
+            (int)objects.size(), (int)frame.inFrustum.size(), drawn, (int)frame.inFrustum.size() - drawn);
+    }
+
+    Shader shader;
+    shader.create(cityVertexShader, cityFragmentShader);
+    shader.LoadDefaults();
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glClearColor(0.6f, 0.7f, 0.85f, 1.0f);
+
+    bool useOcclusion = true;
+    bool oDown = false;
+    int frames = 0;
+    long frustumDraws = 0, occlusionDraws = 0;
+    double cullMs = 0.0;
+    while (!app.ShouldClose())
+    {
+        const Uint8 *keys = SDL_GetKeyboardState(NULL);
+        if (keys[SDL_SCANCODE_O] && !oDown)
+        {
+            useOcclusion = !useOcclusion;
+            Log(0, "CITY: occlusion culling %s", useOcclusion ? "on" : "off");
+        }
+        oDown = keys[SDL_SCANCODE_O];
+
+        // Drive down the street between the first two rows of blocks, turning at the ends
+        float time = SDL_GetTicks() / 1000.0f;
+        float along = fmodf(time * 20.0f, cityBlocks * blockSize * 2.0f);
+        float x = along < cityBlocks * blockSize ? along - half : half - (along - cityBlocks * blockSize);
+        float direction = along < cityBlocks * blockSize ? 1.0f : -1.0f;
+        Vec3 eye(x, 2.0f, -half + blockSize);
+        Mat4 viewProjection = projection * Mat4::LookAt(eye, Vec3(x + direction * 10.0f, 2.0f, -half + blockSize + 3.0f * sinf(time * 0.3f)), Vec3(0, 1, 0));
+
+        auto start = std::chrono::steady_clock::now();
+        CullCity(objects, cube, viewProjection, eye, occlusion, &app.GetJobs(), frame);
+        cullMs += ElapsedMs(start);
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        shader.Bind();
+        shader.setMatrix4("viewProjection", viewProjection);
+        auto draw = [&](const CityObject &object)
+        {
+            shader.setMatrix4("model", object.model);
+            shader.setFloat4("color", object.color.r, object.color.g, object.color.b, object.color.a);
+            cube->Render();
+        };
+        int drawn = 0;
+        for (int i : frame.occluders)
+        {
+            draw(objects[i]);
+            drawn++;
+        }
+        for (size_t k = 0; k < frame.tested.size(); k++)
+            if (frame.visible[k] || !useOcclusion)
+            {
+                draw(objects[frame.tested[k]]);
+                drawn++;
+            }
+        app.Swap();
+
+        frustumDraws += (long)frame.inFrustum.size();
+        occlusionDraws += drawn;
+        if (++frames == 120)
+        {
+            occlusion.LogStats();
+            Log(0, "CITY: %.0f draws after frustum culling, %.0f drawn (%.1f%% eliminated), culling %.2f ms per frame",
+                (double)frustumDraws / frames, (double)occlusionDraws / frames,
+                frustumDraws > 0 ? 100.0 * (frustumDraws - occlusionDraws) / frustumDraws : 0.0, cullMs / frames);
+            frustumDraws = 0;
+            occlusionDraws = 0;
+            cullMs = 0.0;
+            frames = 0;
+        }
+    }
+
+    delete cube;
+    return 0;
+}
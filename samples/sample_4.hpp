@@ -104,11 +104,13 @@ Camera camera;
 camera.SetPosition(0, 1, 10);
 
 
+TextureUploadQueue uploads;
+
 Texture2D texture; 
-texture.Load("assets/f117.png");
+texture.LoadAsync("assets/f117.png", app.GetJobs(), uploads);
 
 Texture2D texture2; 
-texture2.Load("assets/container2.png");
+texture2.LoadAsync("assets/container2.png", app.GetJobs(), uploads);
 
 
 Surface *cube = Surface::CreateCube();
@@ -127,6 +129,7 @@ mesh.LoadObj("assets/cube.obj");
 
   while (!app.ShouldClose()) 
   {
+        uploads.Process();
         
        float deltaTime = app.GetFrameTime();
         
@@ -153,10 +156,20 @@ mesh.LoadObj("assets/cube.obj");
           camera.ProcessMouseMovement(MouseX, -MouseY);
         } 
 
+        // P dumps the last frame's zones and writes a Chrome trace
+        static bool profileDown = false;
+        if (keys[SDL_SCANCODE_P] && !profileDown)
+        {
+          Profiler::LogFrame();
+          Profiler::ExportChromeTrace("profile.json");
+        }
+        profileDown = keys[SDL_SCANCODE_P];
+
  
              
        
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        bool sceneQuery = Profiler::BeginGPU("Scene");
        
 
         Mat4 view =camera.GetViewMatrix();
@@ -204,6 +217,8 @@ mesh.LoadObj("assets/cube.obj");
         shader.setFloat3("color",1.0f, 1.0f, 1.0f);
         mesh.Render();
 
+        if (sceneQuery)
+          Profiler::EndGPU();
         app.Swap();
 
 
@@ -0,0 +1,149 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <chrono>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+#include "../jobs.hpp"
+
+// Job system scaling benchmark: transform propagation + frustum culling
+// on a synthetic scene of 1M objects (1000 roots with 999 children each).
+
+const int sceneRoots    = 1000;
+const int sceneChildren = 999;
+const int sceneObjects  = sceneRoots * (sceneChildren + 1);
+const int sceneGrain    = 4096;
+
+struct SceneObject
+{
+    Vec3  position;
+    float angle;
+    float scale;
+    int   parent;
+    Mat4  world;
+    float radius;
+    bool  visible;
+};
+
+static void BuildScene(std::vector<SceneObject> &objects)
+{
+    objects.resize(sceneObjects);
+    srand(1234);
+    // Roots first so every parent is updated before its children
+    for (int i = 0; i < sceneRoots; i++)
+    {
+        SceneObject &o = objects[i];
+        o.position = Vec3(MATH_RANDOM_MINUS1_1() * 500.0f, 0.0f, MATH_RANDOM_MINUS1_1() * 500.0f);
+        o.angle    = MATH_RANDOM_0_1() * MATH_PIX2;
+        o.scale    = 1.0f;
+        o.parent   = -1;
+        o.radius   = 1.0f;
+    }
+    for (int i = sceneRoots; i < sceneObjects; i++)
+    {
+        SceneObject &o = objects[i];
+        o.position = Vec3(MATH_RANDOM_MINUS1_1() * 20.0f, MATH_RANDOM_0_1() * 10.0f, MATH_RANDOM_MINUS1_1() * 20.0f);
+        o.angle    = MATH_RANDOM_0_1() * MATH_PIX2;
+        o.scale    = 0.5f + MATH_RANDOM_0_1();
+        o.parent   = (i - sceneRoots) % sceneRoots;
+        o.radius   = 1.0f;
+    }
+}
+
+static void UpdateObjects(std::vector<SceneObject> &objects, int begin, int end, float time)
+{
+    for (int i = begin; i < end; i++)
+    {
+        SceneObject &o = objects[i];
+        Mat4 local = Mat4::Translate(o.position.x, o.position.y, o.position.z) *
+                     Mat4::Rotate(Vec3(0, 1, 0), o.angle + time) *
+                     Mat4::Scale(o.scale, o.scale, o.scale);
+        o.world = (o.parent < 0) ? local : objects[o.parent].world * local;
+    }
+}
+
+static void CullObjects(std::vector<SceneObject> &objects, const Frustum &frustum, int begin, int end)
+{
+    for (int i = begin; i < end; i++)
+    {
+        SceneObject &o = objects[i];
+        o.visible = !frustum.cullSphere(o.world.getTrans(), o.radius * o.scale);
+    }
+}
+
+static double RunFrame(JobSystem &jobs, std::vector<SceneObject> &objects, const Frustum &frustum, float time, int *visible)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    jobs.ParallelFor(sceneRoots, sceneGrain, [&](int begin, int end)
+    {
+        UpdateObjects(objects, begin, end, time);
+    });
+    jobs.ParallelFor(sceneObjects - sceneRoots, sceneGrain, [&](int begin, int end)
+    {
+        UpdateObjects(objects, sceneRoots + begin, sceneRoots + end, time);
+    });
+    jobs.ParallelFor(sceneObjects, sceneGrain, [&](int begin, int end)
+    {
+        CullObjects(objects, frustum, begin, end);
+    });
+
+    auto stop = std::chrono::steady_clock::now();
+
+    int count = 0;
+    for (int i = 0; i < sceneObjects; i++)
+        if (objects[i].visible) count++;
+    *visible = count;
+
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+int run_sample()
+{
+    std::vector<SceneObject> objects;
+    BuildScene(objects);
+
+    Camera camera;
+    camera.SetPosition(0, 50, 300);
+    Mat4 projection = Mat4::ProjectionMatrix(45.0f * PI / 180.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+    Frustum frustum;
+    frustum.buildViewFrustum(projection * camera.GetViewMatrix());
+
+    const int frames = 10;
+    int maxThreads = (int)std::thread::hardware_concurrency();
+    if (maxThreads < 1) maxThreads = 1;
+
+    // 1, 2, 4... and always the full count last
+    std::vector<int> counts;
+    for (int threads = 1; threads < maxThreads; threads *= 2)
+        counts.push_back(threads);
+    counts.push_back(maxThreads);
+
+    double baseline = 0.0;
+    for (int threads : counts)
+    {
+        JobSystem jobs;
+        if (threads > 1)
+            jobs.Init(threads - 1);
+
+        int visible = 0;
+        double total = 0.0;
+        RunFrame(jobs, objects, frustum, 0.0f, &visible);   // warm up
+        for (int f = 0; f < frames; f++)
+            total += RunFrame(jobs, objects, frustum, f * 0.016f, &visible);
+
+        double average = total / frames;
+        if (threads == 1) baseline = average;
+        Log(0, "JOBS: %2d threads  %8.2f ms/frame  speedup %.2fx  visible %d/%d",
+            threads, average, baseline / average, visible, sceneObjects);
+    }
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <chrono>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+#include "../mipmap.hpp"
+
+// Mip chain benchmark: glGenerateMipmap against the CPU generator (box and
+// Kaiser, single threaded and on the job system) plus level by level upload.
+// Run it on llvmpipe (LIBGL_ALWAYS_SOFTWARE=1) to compare with software GL.
+
+const int screenWidth = 320;
+const int screenHeight = 240;
+const int imageSize = 2048;
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void MakeTestImage(std::vector<unsigned char> &pixels, Image &image)
+{
+    pixels.resize((size_t)imageSize * imageSize * 4);
+    for (int y = 0; y < imageSize; y++)
+    {
+        for (int x = 0; x < imageSize; x++)
+        {
+            unsigned char *p = &pixels[((size_t)y * imageSize + x) * 4];
+            bool checker = ((x / 8) + (y / 8)) % 2 == 0;
+            p[0] = checker ? 255 : (unsigned char)(x & 255);
+            p[1] = checker ? 255 : (unsigned char)(y & 255);
+            p[2] = (unsigned char)((x ^ y) & 255);
+            p[3] = 255;
+        }
+    }
+    image.data = pixels.data();
+    image.width = imageSize;
+    image.height = imageSize;
+    image.components = 4;
+}
+
+static double TimeCPU(const Image &image, MipFilter filter, JobSystem *jobs, MipChain &chain)
+{
+    auto start = std::chrono::steady_clock::now();
+    GenerateMipChain(image, chain, filter, true, jobs);
+    return ElapsedMs(start);
+}
+
+int run_sample()
+{
+    App app;
+    app.CreateWindow(screenWidth, screenHeight, "Mipmap benchmark");
+
+    std::vector<unsigned char> pixels;
+    Image image;
+    MakeTestImage(pixels, image);
+
+    // Driver path: level 0 upload, then glGenerateMipmap
+    {
+        Texture2D texture;
+        texture.Upload(image, false);
+        glFinish();
+        auto start = std::chrono::steady_clock::now();
+        texture.Bind(0);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glFinish();
+        Log(0, "MIPBENCH: glGenerateMipmap          %8.2f ms", ElapsedMs(start));
+    }
+
+    MipChain chain;
+    Log(0, "MIPBENCH: CPU box    1 thread       %8.2f ms", TimeCPU(image, MIP_BOX, nullptr, chain));
+    Log(0, "MIPBENCH: CPU box    %2d threads     %8.2f ms", app.GetJobs().GetWorkerCount() + 1, TimeCPU(image, MIP_BOX, &app.GetJobs(), chain));
+    Log(0, "MIPBENCH: CPU kaiser 1 thread       %8.2f ms", TimeCPU(image, MIP_KAISER, nullptr, chain));
+    Log(0, "MIPBENCH: CPU kaiser %2d threads     %8.2f ms", app.GetJobs().GetWorkerCount() + 1, TimeCPU(image, MIP_KAISER, &app.GetJobs(), chain));
+
+    {
+        Texture2D texture;
+        glFinish();
+        auto start = std::chrono::steady_clock::now();
+        UploadMipChain(texture, chain);
+        glFinish();
+        Log(0, "MIPBENCH: upload %d levels           %8.2f ms", chain.CountLevels(), ElapsedMs(start));
+    }
+
+    {
+        auto start = std::chrono::steady_clock::now();
+        SaveMipChain("mipbench.mips", chain);
+        double save = ElapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        MipChain cached;
+        LoadMipChain("mipbench.mips", cached);
+        Log(0, "MIPBENCH: cache save %.2f ms  load %.2f ms  (%.2f MB)", save, ElapsedMs(start), cached.data.size() / (1024.0 * 1024.0));
+    }
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <chrono>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+#include "../ktx.hpp"
+
+// Compares the PNG path (stb_image + glTexImage2D + glGenerateMipmap) with the
+// ETC2 KTX path (glCompressedTexImage2D) for load time and video memory.
+// Create the .ktx files first with "make ktx".
+
+const int screenWidth = 320;
+const int screenHeight = 240;
+
+static const char *compareTextures[] =
+{
+    "assets/container2",
+    "assets/f117",
+};
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int run_sample()
+{
+    App app;
+    app.CreateWindow(screenWidth, screenHeight, "KTX compare");
+
+    size_t totalPng = 0, totalKtx = 0;
+    for (const char *name : compareTextures)
+    {
+        std::string png = std::string(name) + ".png";
+        std::string ktx = std::string(name) + ".ktx";
+
+        Texture2D uncompressed;
+        auto start = std::chrono::steady_clock::now();
+        bool pngLoaded = uncompressed.Load(png);
+        glFinish();
+        double pngMs = ElapsedMs(start);
+
+        Texture2D compressed;
+        start = std::chrono::steady_clock::now();
+        bool ktxLoaded = LoadKTX(compressed, ktx);
+        glFinish();
+        double ktxMs = ElapsedMs(start);
+
+        if (!pngLoaded || !ktxLoaded)
+        {
+            Log(1, "KTXBENCH: skipping %s (png %d, ktx %d)", name, pngLoaded, ktxLoaded);
+            continue;
+        }
+
+        totalPng += uncompressed.GetMemorySize();
+        totalKtx += compressed.GetMemorySize();
+        Log(0, "KTXBENCH: %-20s png %7.2f ms %8.1f KB | ktx %7.2f ms %8.1f KB",
+            name, pngMs, uncompressed.GetMemorySize() / 1024.0, ktxMs, compressed.GetMemorySize() / 1024.0);
+    }
+
+    if (totalKtx > 0)
+        Log(0, "KTXBENCH: video memory %.1f KB -> %.1f KB (%.1f:1)",
+            totalPng / 1024.0, totalKtx / 1024.0, (double)totalPng / totalKtx);
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <chrono>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+
+// Streams 100 2048x2048 textures through Texture2D::LoadAsync, first with heap
+// images and glTexImage2D, then decoding into a PixelBufferPool. Reports the
+// total time and the worst GL thread stall per frame. For a headless run use
+// SDL_VIDEODRIVER=offscreen (or Xvfb) with LIBGL_ALWAYS_SOFTWARE=1.
+
+const int screenWidth = 320;
+const int screenHeight = 240;
+const int streamSize = 2048;
+const int streamCount = 100;
+const int streamFiles = 8;
+const int streamInFlight = 8;
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string StreamFileName(int index)
+{
+    return "pbobench_" + std::to_string(index) + ".ppm";
+}
+
+// Binary PPM keeps the decode cheap so the numbers are about the upload
+static bool WriteStreamFiles()
+{
+    std::string header = "P6\n" + std::to_string(streamSize) + " " + std::to_string(streamSize) + "\n255\n";
+    std::vector<unsigned char> file(header.size() + (size_t)streamSize * streamSize * 3);
+    memcpy(file.data(), header.data(), header.size());
+    for (int i = 0; i < streamFiles; i++)
+    {
+        unsigned char *p = file.data() + header.size();
+        for (int y = 0; y < streamSize; y++)
+        {
+            for (int x = 0; x < streamSize; x++, p += 3)
+            {
+                p[0] = (unsigned char)(x + i * 32);
+                p[1] = (unsigned char)(y);
+                p[2] = (unsigned char)((x ^ y) + i);
+            }
+        }
+        if (!SaveFileData(StreamFileName(i).c_str(), file.data(), (unsigned int)file.size()))
+            return false;
+    }
+    return true;
+}
+
+static void StreamTextures(App &app, PixelBufferPool *pool, const char *label)
+{
+    TextureUploadQueue queue;
+    queue.SetPixelBuffers(pool);
+    std::vector<Texture2D> textures(streamCount);
+
+    int issued = 0;
+    int frames = 0;
+    double worstMs = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    while (true)
+    {
+        int ready = 0;
+        int inFlight = 0;
+        for (int i = 0; i < issued; i++)
+        {
+            if (textures[i].IsReady()) ready++;
+            else inFlight++;
+        }
+        if (ready == streamCount)
+            break;
+
+        while (issued < streamCount && inFlight < streamInFlight)
+        {
+            textures[issued].LoadAsync(StreamFileName(issued % streamFiles), app.GetJobs(), queue);
+            issued++;
+            inFlight++;
+        }
+
+        auto frameStart = std::chrono::steady_clock::now();
+        glClear(GL_COLOR_BUFFER_BIT);
+        queue.Process();
+        double frameMs = ElapsedMs(frameStart);
+        if (frameMs > worstMs)
+            worstMs = frameMs;
+        app.Swap();
+        frames++;
+    }
+    glFinish();
+    double totalMs = ElapsedMs(start);
+
+    Log(0, "PBOBENCH: %-10s %4d textures %8.1f ms total, %5d frames, worst GL stall %6.2f ms",
+        label, streamCount, totalMs, frames, worstMs);
+}
+
+int run_sample()
+{
+    App app;
+    app.CreateWindow(screenWidth, screenHeight, "PBO streaming", false);
+
+    if (!WriteStreamFiles())
+        return 1;
+
+    StreamTextures(app, nullptr, "heap");
+
+    {
+        PixelBufferPool pool;
+        pool.Create(streamInFlight, (size_t)streamSize * streamSize * 4);
+        StreamTextures(app, &pool, "pbo");
+    }
+
+    for (int i = 0; i < streamFiles; i++)
+        remove(StreamFileName(i).c_str());
+    return 0;
+}
@@ -0,0 +1,329 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <math.h>
+
+#include "../glad/glad.h"
+#include "../utils.hpp"
+#include "../render.hpp"
+#include "../math.hpp"
+#include "../camera.hpp"
+#include "../core.hpp"
+
+// Image decode throughput. Writes a corpus of PNGs (smooth gradients, noisy
+// "photos" and flat UI-like art, RGB and RGBA, every row filter type in use)
+// and decodes it on one thread and then one image per job. Any .jpg files in
+// assets/ are measured the same way. No GL needed.
+
+const int corpusSize = 1024;
+const int corpusCount = 12;
+const int corpusRepeats = 3;
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Minimal zlib writer: greedy LZ77 with one hash candidate and fixed Huffman
+// codes. Far from optimal, but produces the length/distance mix real files have.
+struct DeflateWriter
+{
+    std::vector<unsigned char> &out;
+    unsigned int bits = 0;
+    int count = 0;
+
+    explicit DeflateWriter(std::vector<unsigned char> &buffer) : out(buffer) {}
+
+    void Put(unsigned int value, int n)
+    {
+        bits |= value << count;
+        count += n;
+        while (count >= 8)
+        {
+            out.push_back((unsigned char)bits);
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+    void PutCode(unsigned int code, int n)
+    {
+        unsigned int reversed = 0;
+        for (int i = 0; i < n; i++)
+            reversed |= ((code >> i) & 1) << (n - 1 - i);
+        Put(reversed, n);
+    }
+    void Literal(int symbol)
+    {
+        if (symbol < 144)      PutCode(0x30 + symbol, 8);
+        else if (symbol < 256) PutCode(0x190 + symbol - 144, 9);
+        else if (symbol < 280) PutCode(symbol - 256, 7);
+        else                   PutCode(0xC0 + symbol - 280, 8);
+    }
+    void Match(int length, int distance)
+    {
+        static const int lengthBase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+        static const int lengthExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+        static const int distBase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+        static const int distExtra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+        int l = 28;
+        while (lengthBase[l] > length) l--;
+        Literal(257 + l);
+        Put(length - lengthBase[l], lengthExtra[l]);
+        int d = 29;
+        while (distBase[d] > distance) d--;
+        PutCode(d, 5);
+        Put(distance - distBase[d], distExtra[d]);
+    }
+    void Flush()
+    {
+        if (count > 0)
+            out.push_back((unsigned char)bits);
+        bits = 0;
+        count = 0;
+    }
+};
+
+static void ZlibCompress(const std::vector<unsigned char> &data, std::vector<unsigned char> &out)
+{
+    const int window = 32768, hashSize = 1 << 15;
+    std::vector<int> head(hashSize, -1);
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    DeflateWriter writer(out);
+    writer.Put(1, 1);   // final block
+    writer.Put(1, 2);   // fixed Huffman
+    int size = (int)data.size();
+    int i = 0;
+    while (i < size)
+    {
+        int best = 0, distance = 0;
+        if (i + 3 <= size)
+        {
+            unsigned int h = ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & (hashSize - 1);
+            int candidate = head[h];
+            head[h] = i;
+            if (candidate >= 0 && i - candidate <= window)
+            {
+                int limit = size - i < 258 ? size - i : 258;
+                while (best < limit && data[candidate + best] == data[i + best])
+                    best++;
+                distance = i - candidate;
+            }
+        }
+        if (best >= 3)
+        {
+            writer.Match(best, distance);
+            i += best;
+        }
+        else
+            writer.Literal(data[i++]);
+    }
+    writer.Literal(256);
+    writer.Flush();
+
+    unsigned int a = 1, b = 0;
+    for (unsigned char c : data)
+    {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    unsigned int adler = (b << 16) | a;
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((unsigned char)(adler >> shift));
+}
+
+static unsigned int PngCrc(const unsigned char *data, size_t size, unsigned int crc = 0xFFFFFFFF)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for (int k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+    return crc;
+}
+
+static void PngChunk(std::vector<unsigned char> &file, const char *type, const std::vector<unsigned char> &data)
+{
+    unsigned int size = (unsigned int)data.size();
+    for (int shift = 24; shift >= 0; shift -= 8)
+        file.push_back((unsigned char)(size >> shift));
+    size_t start = file.size();
+    file.insert(file.end(), type, type + 4);
+    file.insert(file.end(), data.begin(), data.end());
+    unsigned int crc = PngCrc(&file[start], file.size() - start) ^ 0xFFFFFFFF;
+    for (int shift = 24; shift >= 0; shift -= 8)
+        file.push_back((unsigned char)(crc >> shift));
+}
+
+static int PngPaeth(int a, int b, int c)
+{
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+// Picks the filter with the smallest sum of absolute residuals per row, the usual encoder heuristic
+static bool SavePNG(const char *fileName, const unsigned char *pixels, int width, int height, int components)
+{
+    int stride = width * components;
+    std::vector<unsigned char> raw;
+    raw.reserve((size_t)(stride + 1) * height);
+    std::vector<unsigned char> zero(stride, 0), candidate(stride), best(stride);
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char *row = pixels + (size_t)y * stride;
+        const unsigned char *prior = y > 0 ? row - stride : zero.data();
+        int bestFilter = 0;
+        long bestCost = -1;
+        for (int filter = 0; filter < 5; filter++)
+        {
+            long cost = 0;
+            for (int i = 0; i < stride; i++)
+            {
+                int a = i >= components ? row[i - components] : 0;
+                int b = prior[i];
+                int c = i >= components ? prior[i - components] : 0;
+                int predict = filter == 0 ? 0 : filter == 1 ? a : filter == 2 ? b : filter == 3 ? (a + b) / 2 : PngPaeth(a, b, c);
+                candidate[i] = (unsigned char)(row[i] - predict);
+                cost += abs((signed char)candidate[i]);
+            }
+            if (bestCost < 0 || cost < bestCost)
+            {
+                bestCost = cost;
+                bestFilter = filter;
+                best.swap(candidate);
+            }
+        }
+        raw.push_back((unsigned char)bestFilter);
+        raw.insert(raw.end(), best.begin(), best.end());
+    }
+
+    std::vector<unsigned char> header(13), idat;
+    for (int i = 0; i < 4; i++)
+    {
+        header[i] = (unsigned char)(width >> (24 - i * 8));
+        header[4 + i] = (unsigned char)(height >> (24 - i * 8));
+    }
+    header[8] = 8;
+    header[9] = components == 4 ? 6 : 2;
+    ZlibCompress(raw, idat);
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::vector<unsigned char> file(signature, signature + 8);
+    PngChunk(file, "IHDR", header);
+    PngChunk(file, "IDAT", idat);
+    PngChunk(file, "IEND", std::vector<unsigned char>());
+    return SaveFileData(fileName, file.data(), (unsigned int)file.size());
+}
+
+static void MakeCorpusImage(int index, std::vector<unsigned char> &pixels, int components)
+{
+    pixels.resize((size_t)corpusSize * corpusSize * components);
+    unsigned int seed = 12345u + index;
+    for (int y = 0; y < corpusSize; y++)
+    {
+        for (int x = 0; x < corpusSize; x++)
+        {
+            unsigned char *p = &pixels[((size_t)y * corpusSize + x) * components];
+            seed = seed * 1664525u + 1013904223u;
+            int noise = (int)(seed >> 28) - 8;
+            for (int c = 0; c < components; c++)
+            {
+                int v;
+                switch (index % 3)
+                {
+                    case 0:  v = (x + y * 2 + c * 60) / 6; break;                                  // gradient
+                    case 1:  v = 128 + (int)(90 * sinf(x * 0.013f + c) * cosf(y * 0.021f)) + noise; break; // photo-like
+                    default: v = ((x / 64 + y / 48) % 4) * 60 + c * 10; break;                     // flat art
+                }
+                p[c] = (unsigned char)(v < 0 ? 0 : v > 255 ? 255 : v);
+            }
+            if (components == 4)
+                p[3] = (unsigned char)(255 - ((x ^ y) & 63));
+        }
+    }
+}
+
+static size_t TotalFileBytes(const std::vector<std::string> &files)
+{
+    size_t total = 0;
+    for (const std::string &file : files)
+    {
+        struct stat info;
+        if (stat(file.c_str(), &info) == 0)
+            total += (size_t)info.st_size;
+    }
+    return total;
+}
+
+static void MeasureDecode(const char *label, const std::vector<std::string> &files, JobSystem &jobs)
+{
+    if (files.empty())
+        return;
+
+    size_t fileBytes = TotalFileBytes(files);
+    for (int threaded = 0; threaded < 2; threaded++)
+    {
+        double bestMs = 0.0;
+        size_t pixelBytes = 0;
+        for (int r = 0; r < corpusRepeats; r++)
+        {
+            std::vector<Image> images;
+            auto start = std::chrono::steady_clock::now();
+            LoadImages(files, images, threaded ? &jobs : nullptr);
+            double ms = ElapsedMs(start);
+            if (r == 0 || ms < bestMs)
+                bestMs = ms;
+
+            pixelBytes = 0;
+            for (Image &image : images)
+            {
+                pixelBytes += (size_t)image.width * image.height * image.components;
+                UnloadImage(image);
+            }
+        }
+        Log(0, "DECODEBENCH: %-4s %2d files %2d threads %8.1f ms  %7.1f MB/s in  %7.1f MB/s out",
+            label, (int)files.size(), threaded ? jobs.GetWorkerCount() + 1 : 1, bestMs,
+            fileBytes / (1024.0 * 1024.0) / (bestMs / 1000.0), pixelBytes / (1024.0 * 1024.0) / (bestMs / 1000.0));
+    }
+}
+
+int run_sample()
+{
+    JobSystem jobs;
+    jobs.Init();
+
+    std::vector<std::string> pngFiles;
+    std::vector<unsigned char> pixels;
+    for (int i = 0; i < corpusCount; i++)
+    {
+        int components = (i / 3) % 2 ? 4 : 3;
+        MakeCorpusImage(i, pixels, components);
+        std::string name = "decodebench_" + std::to_string(i) + ".png";
+        if (SavePNG(name.c_str(), pixels.data(), corpusSize, corpusSize, components))
+            pngFiles.push_back(name);
+    }
+
+    std::vector<std::string> jpgFiles;
+    if (DirectoryExists("assets"))
+    {
+        int count = 0;
+        char **files = GetDirectoryFiles("assets", &count);
+        for (int i = 0; i < count; i++)
+            if (IsFileExtension(files[i], ".jpg;.jpeg"))
+                jpgFiles.push_back(std::string("assets/") + files[i]);
+        ClearDirectoryFiles();
+    }
+
+    MeasureDecode("png", pngFiles, jobs);
+    MeasureDecode("jpg", jpgFiles, jobs);
+
+    for (const std::string &file : pngFiles)
+        remove(file.c_str());
+    jobs.Shutdown();
+    return 0;
+}
@@ -0,0 +1,509 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+// Quadric error metric mesh simplification (Garland and Heckbert 1997). Each
+// vertex accumulates the planes of its triangles (and, along open borders,
+// planes perpendicular to them) in a 4x4 quadric whose value at a point is the
+// summed squared distance to those planes. Edges are collapsed cheapest first,
+// moving one endpoint onto the other, so the result only references input
+// vertices and keeps their attributes. Vertices shared by several attribute
+// copies (UV or normal seams) and non-manifold borders are never moved.
+class MeshSimplifier
+{
+    public:
+    // Writes at most indexCount indices to destination and returns how many.
+    // Stops at targetIndexCount or when the next collapse would move the
+    // surface by more than targetError (in model units), judged by the quadric
+    // (a weighted mean squared distance to the original planes). resultError
+    // gets the larger of that and the measured distance from every removed
+    // vertex to the triangles around the vertex it collapsed into.
+    static int Simplify(const float *positions, size_t stride, int vertexCount, const int *indices, int indexCount,
+                        int targetIndexCount, float targetError, int *destination, float *resultError = nullptr)
+    {
+        if (resultError)
+            *resultError = 0.0f;
+        if (indexCount < 3 || vertexCount <= 0)
+            return 0;
+
+        State state;
+        state.vertexCount = vertexCount;
+        state.positions.resize((size_t)vertexCount * 3);
+        for (int v = 0; v < vertexCount; v++)
+        {
+            const float *p = (const float*)((const char*)positions + (size_t)v * stride);
+            state.positions[v * 3 + 0] = p[0];
+            state.positions[v * 3 + 1] = p[1];
+            state.positions[v * 3 + 2] = p[2];
+        }
+        // Work in a unit box so the error threshold and the flip test do not depend on scale
+        float scale = Normalize(state.positions);
+
+        memcpy(destination, indices, (size_t)indexCount * sizeof(int));
+        int count = RemoveDegenerate(state, destination, indexCount);
+
+        BuildPositionRemap(state);
+        ClassifyVertices(state, destination, count);
+        BuildQuadrics(state, destination, count);
+        state.collapsed.resize(vertexCount);
+        for (int v = 0; v < vertexCount; v++)
+            state.collapsed[v] = v;
+
+        const double errorLimit = (double)(targetError / scale) * (targetError / scale);
+        double maxError = 0.0;
+        while (count > targetIndexCount)
+        {
+            int collapsed = CollapsePass(state, destination, count, targetIndexCount, errorLimit, maxError);
+            count = RemoveDegenerate(state, destination, count);
+            if (collapsed == 0)
+                break;
+        }
+
+        if (resultError)
+            *resultError = (float)sqrt(std::max(maxError, MeasureError(state, destination, count))) * scale;
+        return count;
+    }
+
+    private:
+        enum Kind
+        {
+            KIND_MANIFOLD,      // interior vertex with one attribute copy, free to move
+            KIND_BORDER,        // on an open edge, moves only along it
+            KIND_LOCKED
+        };
+
+        struct Quadric
+        {
+            double a[10];       // upper triangle of the symmetric 4x4 matrix
+            double weight;      // summed plane weights, to turn the sum into a mean
+
+            Quadric() { memset(a, 0, sizeof(a)); weight = 0.0; }
+
+            // Plane nx*x + ny*y + nz*z + d = 0 with a unit normal
+            void AddPlane(double nx, double ny, double nz, double d, double weight)
+            {
+                a[0] += weight * nx * nx; a[1] += weight * nx * ny; a[2] += weight * nx * nz; a[3] += weight * nx * d;
+                a[4] += weight * ny * ny; a[5] += weight * ny * nz; a[6] += weight * ny * d;
+                a[7] += weight * nz * nz; a[8] += weight * nz * d;
+                a[9] += weight * d * d;
+                this->weight += weight;
+            }
+
+            void Add(const Quadric &other)
+            {
+                for (int i = 0; i < 10; i++)
+                    a[i] += other.a[i];
+                weight += other.weight;
+            }
+
+            // Weighted mean squared distance to the planes
+            double Evaluate(const float *p) const
+            {
+                if (weight <= 0.0)
+                    return 0.0;
+                double x = p[0], y = p[1], z = p[2];
+                double value = a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+                             + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+                             + a[7] * z * z + 2 * a[8] * z
+                             + a[9];
+                return value > 0.0 ? value / weight : 0.0;
+            }
+        };
+
+        struct Collapse
+        {
+            double cost;
+            int from;
+            int to;
+        };
+
+        struct State
+        {
+            int vertexCount = 0;
+            std::vector<float> positions;
+            std::vector<int> remap;             // first vertex with the same position
+            std::vector<unsigned char> kind;
+            std::vector<Quadric> quadrics;      // per remapped position
+            std::vector<int> adjacencyStart;    // triangles per remapped position
+            std::vector<int> adjacency;
+            std::vector<Collapse> collapses;
+            std::vector<int> target;            // per vertex, -1 or the vertex it moves onto
+            std::vector<int> collapsed;         // per position, the position it was moved onto
+            std::vector<unsigned char> locked;  // per position, touched this pass
+        };
+
+        static float Normalize(std::vector<float> &positions)
+        {
+            float mins[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, maxs[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+            for (size_t i = 0; i < positions.size(); i += 3)
+                for (int k = 0; k < 3; k++)
+                {
+                    mins[k] = std::min(mins[k], positions[i + k]);
+                    maxs[k] = std::max(maxs[k], positions[i + k]);
+                }
+            float extent = std::max(std::max(maxs[0] - mins[0], maxs[1] - mins[1]), maxs[2] - mins[2]);
+            float scale = extent > 0.0f ? extent : 1.0f;
+            for (size_t i = 0; i < positions.size(); i += 3)
+                for (int k = 0; k < 3; k++)
+                    positions[i + k] = (positions[i + k] - mins[k]) / scale;
+            return scale;
+        }
+
+        static const float *Position(const State &state, int v)
+        {
+            return &state.positions[(size_t)v * 3];
+        }
+
+        // Vertices at the same position share one remapped id (the lowest index)
+        static void BuildPositionRemap(State &state)
+        {
+            std::vector<int> order(state.vertexCount);
+            for (int v = 0; v < state.vertexCount; v++)
+                order[v] = v;
+            std::sort(order.begin(), order.end(), [&state](int a, int b)
+            {
+                int result = memcmp(Position(state, a), Position(state, b), 3 * sizeof(float));
+                return result != 0 ? result < 0 : a < b;
+            });
+            state.remap.resize(state.vertexCount);
+            for (int i = 0; i < state.vertexCount;)
+            {
+                int j = i;
+                while (j < state.vertexCount && memcmp(Position(state, order[i]), Position(state, order[j]), 3 * sizeof(float)) == 0)
+                    j++;
+                for (int k = i; k < j; k++)
+                    state.remap[order[k]] = order[i];
+                i = j;
+            }
+        }
+
+        static bool SamePosition(const State &state, int a, int b)
+        {
+            return state.remap[a] == state.remap[b];
+        }
+
+        static int RemoveDegenerate(const State &state, int *indices, int count)
+        {
+            int write = 0;
+            for (int i = 0; i < count; i += 3)
+            {
+                int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+                bool degenerate = state.remap.empty() ? (a == b || b == c || a == c)
+                                                      : (SamePosition(state, a, b) || SamePosition(state, b, c) || SamePosition(state, a, c));
+                if (degenerate)
+                    continue;
+                indices[write++] = a;
+                indices[write++] = b;
+                indices[write++] = c;
+            }
+            return write;
+        }
+
+        // Triangle lists per remapped position, rebuilt every pass
+        static void BuildAdjacency(State &state, const int *indices, int count)
+        {
+            state.adjacencyStart.assign(state.vertexCount + 1, 0);
+            for (int i = 0; i < count; i++)
+                state.adjacencyStart[state.remap[indices[i]] + 1]++;
+            for (int v = 0; v < state.vertexCount; v++)
+                state.adjacencyStart[v + 1] += state.adjacencyStart[v];
+            state.adjacency.resize(count);
+            std::vector<int> fill(state.adjacencyStart.begin(), state.adjacencyStart.end() - 1);
+            for (int i = 0; i < count; i++)
+                state.adjacency[fill[state.remap[indices[i]]]++] = i / 3;
+        }
+
+        // Counts the triangles with the directed edge a->b (by position)
+        static int CountEdge(const State &state, const int *indices, int a, int b)
+        {
+            int edges = 0;
+            for (int k = state.adjacencyStart[a]; k < state.adjacencyStart[a + 1]; k++)
+            {
+                const int *tri = indices + state.adjacency[k] * 3;
+                for (int e = 0; e < 3; e++)
+                    if (state.remap[tri[e]] == a && state.remap[tri[(e + 1) % 3]] == b)
+                        edges++;
+            }
+            return edges;
+        }
+
+        static bool IsBorderEdge(const State &state, const int *indices, int a, int b)
+        {
+            return CountEdge(state, indices, a, b) + CountEdge(state, indices, b, a) == 1;
+        }
+
+        static void ClassifyVertices(State &state, const int *indices, int count)
+        {
+            BuildAdjacency(state, indices, count);
+            state.kind.assign(state.vertexCount, KIND_MANIFOLD);
+
+            // Attribute seams: more than one referenced vertex at a position
+            std::vector<int> seen(state.vertexCount, -1);
+            for (int i = 0; i < count; i++)
+            {
+                int v = indices[i], p = state.remap[v];
+                if (seen[p] >= 0 && seen[p] != v)
+                    state.kind[p] = KIND_LOCKED;
+                seen[p] = v;
+            }
+
+            for (int p = 0; p < state.vertexCount; p++)
+            {
+                if (state.remap[p] != p || state.kind[p] == KIND_LOCKED)
+                    continue;
+                int borders = 0;
+                for (int k = state.adjacencyStart[p]; k < state.adjacencyStart[p + 1]; k++)
+                {
+                    const int *tri = indices + state.adjacency[k] * 3;
+                    for (int e = 0; e < 3; e++)
+                    {
+                        int a = state.remap[tri[e]], b = state.remap[tri[(e + 1) % 3]];
+                        if (a != p && b != p)
+                            continue;
+                        int total = CountEdge(state, indices, a, b) + CountEdge(state, indices, b, a);
+                        if (total == 1)
+                            borders++;
+                        else if (total > 2)
+                            state.kind[p] = KIND_LOCKED;    // edge shared by more than two triangles
+                    }
+                }
+                if (state.kind[p] == KIND_LOCKED)
+                    continue;
+                if (borders == 2)
+                    state.kind[p] = KIND_BORDER;
+                else if (borders > 0)
+                    state.kind[p] = KIND_LOCKED;
+            }
+        }
+
+        static void BuildQuadrics(State &state, const int *indices, int count)
+        {
+            state.quadrics.assign(state.vertexCount, Quadric());
+            for (int i = 0; i < count; i += 3)
+            {
+                const int p[3] = { state.remap[indices[i]], state.remap[indices[i + 1]], state.remap[indices[i + 2]] };
+                const float *v0 = Position(state, p[0]), *v1 = Position(state, p[1]), *v2 = Position(state, p[2]);
+                double e1[3] = { (double)v1[0] - v0[0], (double)v1[1] - v0[1], (double)v1[2] - v0[2] };
+                double e2[3] = { (double)v2[0] - v0[0], (double)v2[1] - v0[1], (double)v2[2] - v0[2] };
+                double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+                double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                if (length <= 0.0)
+                    continue;
+                n[0] /= length; n[1] /= length; n[2] /= length;
+                double d = -(n[0] * v0[0] + n[1] * v0[1] + n[2] * v0[2]);
+                double area = length * 0.5;
+                for (int k = 0; k < 3; k++)
+                    state.quadrics[p[k]].AddPlane(n[0], n[1], n[2], d, area);
+
+                // Open edges get a heavy plane through them, perpendicular to the triangle
+                for (int e = 0; e < 3; e++)
+                {
+                    int a = p[e], b = p[(e + 1) % 3];
+                    if (!IsBorderEdge(state, indices, a, b))
+                        continue;
+                    const float *va = Position(state, a), *vb = Position(state, b);
+                    double edge[3] = { (double)vb[0] - va[0], (double)vb[1] - va[1], (double)vb[2] - va[2] };
+                    double edgeLength = sqrt(edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]);
+                    if (edgeLength <= 0.0)
+                        continue;
+                    double m[3] = { edge[1] * n[2] - edge[2] * n[1], edge[2] * n[0] - edge[0] * n[2], edge[0] * n[1] - edge[1] * n[0] };
+                    double mLength = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+                    m[0] /= mLength; m[1] /= mLength; m[2] /= mLength;
+                    double md = -(m[0] * va[0] + m[1] * va[1] + m[2] * va[2]);
+                    state.quadrics[a].AddPlane(m[0], m[1], m[2], md, edgeLength * edgeLength * 10.0);
+                    state.quadrics[b].AddPlane(m[0], m[1], m[2], md, edgeLength * edgeLength * 10.0);
+                }
+            }
+        }
+
+        // Moving position 'from' onto 'to' must not turn any remaining triangle over
+        static bool FlipsTriangle(const State &state, const int *indices, int from, int to)
+        {
+            const float *target = Position(state, to);
+            for (int k = state.adjacencyStart[from]; k < state.adjacencyStart[from + 1]; k++)
+            {
+                const int *tri = indices + state.adjacency[k] * 3;
+                int p[3] = { state.remap[tri[0]], state.remap[tri[1]], state.remap[tri[2]] };
+                if (p[0] == to || p[1] == to || p[2] == to)
+                    continue;   // collapses away
+                const float *v[3], *moved[3];
+                for (int e = 0; e < 3; e++)
+                {
+                    v[e] = Position(state, p[e]);
+                    moved[e] = p[e] == from ? target : v[e];
+                }
+                float before[3], after[3];
+                Normal(v, before);
+                Normal(moved, after);
+                float dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+                float lengths = sqrtf((before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) *
+                                      (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]));
+                if (dot <= lengths * 0.25f)
+                    return true;
+            }
+            return false;
+        }
+
+        // Squared distance from every removed position to the final triangles
+        // around the position it ended up on
+        static double MeasureError(State &state, const int *indices, int count)
+        {
+            BuildAdjacency(state, indices, count);
+            double maxError = 0.0;
+            for (int p = 0; p < state.vertexCount; p++)
+            {
+                if (state.remap[p] != p || state.collapsed[p] == p)
+                    continue;
+                int end = state.collapsed[p];
+                while (state.collapsed[end] != end)
+                    end = state.collapsed[end];
+                // Triangles touching the end position's one ring
+                double nearest = DBL_MAX;
+                for (int k = state.adjacencyStart[end]; k < state.adjacencyStart[end + 1]; k++)
+                    for (int corner = 0; corner < 3; corner++)
+                    {
+                        int ring = state.remap[indices[state.adjacency[k] * 3 + corner]];
+                        for (int j = state.adjacencyStart[ring]; j < state.adjacencyStart[ring + 1]; j++)
+                        {
+                            const int *tri = indices + state.adjacency[j] * 3;
+                            nearest = std::min(nearest, PointTriangleDistanceSquared(Position(state, p), Position(state, tri[0]),
+                                                                                     Position(state, tri[1]), Position(state, tri[2])));
+                        }
+                    }
+                if (nearest < DBL_MAX)
+                    maxError = std::max(maxError, nearest);
+            }
+            return maxError;
+        }
+
+        // Closest point by Voronoi region (Ericson, Real-Time Collision Detection 5.1.5)
+        static double PointTriangleDistanceSquared(const float *point, const float *a, const float *b, const float *c)
+        {
+            double ab[3], ac[3], ap[3], bp[3], cp[3];
+            for (int k = 0; k < 3; k++)
+            {
+                ab[k] = (double)b[k] - a[k]; ac[k] = (double)c[k] - a[k];
+                ap[k] = (double)point[k] - a[k]; bp[k] = (double)point[k] - b[k]; cp[k] = (double)point[k] - c[k];
+            }
+            auto dot = [](const double *x, const double *y) { return x[0] * y[0] + x[1] * y[1] + x[2] * y[2]; };
+            double d1 = dot(ab, ap), d2 = dot(ac, ap), d3 = dot(ab, bp), d4 = dot(ac, bp), d5 = dot(ab, cp), d6 = dot(ac, cp);
+            double v = 0.0, w = 0.0;
+            double va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+            if (d1 <= 0.0 && d2 <= 0.0)
+                v = w = 0.0;                                            // vertex a
+            else if (d3 >= 0.0 && d4 <= d3)
+                v = 1.0, w = 0.0;                                       // vertex b
+            else if (d6 >= 0.0 && d5 <= d6)
+                v = 0.0, w = 1.0;                                       // vertex c
+            else if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+                v = d1 / (d1 - d3), w = 0.0;                            // edge ab
+            else if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+                v = 0.0, w = d2 / (d2 - d6);                            // edge ac
+            else if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0)
+            {
+                w = (d4 - d3) / ((d4 - d3) + (d5 - d6));                // edge bc
+                v = 1.0 - w;
+            }
+            else
+            {
+                double denominator = 1.0 / (va + vb + vc);
+                v = vb * denominator;
+                w = vc * denominator;
+            }
+            double distance = 0.0;
+            for (int k = 0; k < 3; k++)
+            {
+                double delta = ap[k] - ab[k] * v - ac[k] * w;
+                distance += delta * delta;
+            }
+            return distance;
+        }
+
+        static void Normal(const float *const *v, float *n)
+        {
+            float e1[3] = { v[1][0] - v[0][0], v[1][1] - v[0][1], v[1][2] - v[0][2] };
+            float e2[3] = { v[2][0] - v[0][0], v[2][1] - v[0][1], v[2][2] - v[0][2] };
+            n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+            n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+            n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+        }
+
+        static bool CanCollapse(const State &state, const int *indices, int from, int to)
+        {
+            if (state.kind[from] == KIND_MANIFOLD)
+                return true;
+            if (state.kind[from] == KIND_BORDER)
+                return IsBorderEdge(state, indices, from, to) && state.kind[to] != KIND_MANIFOLD;
+            return false;
+        }
+
+        // One round of collapses over edges sorted by cost. Positions next to a
+        // collapse are locked until the next pass so the adjacency stays valid.
+        static int CollapsePass(State &state, int *indices, int count, int targetCount, double errorLimit, double &maxError)
+        {
+            BuildAdjacency(state, indices, count);
+            state.collapses.clear();
+            for (int i = 0; i < count; i++)
+            {
+                int a = indices[i], b = indices[i - i % 3 + (i % 3 + 1) % 3];
+                int pa = state.remap[a], pb = state.remap[b];
+                // Each edge once: an interior edge also comes the other way from the
+                // neighbour triangle, a border edge has no neighbour to bring it
+                if (pa == pb || (pa > pb && CountEdge(state, indices, pb, pa) > 0))
+                    continue;
+                Quadric q = state.quadrics[pa];
+                q.Add(state.quadrics[pb]);
+                bool ab = CanCollapse(state, indices, pa, pb), ba = CanCollapse(state, indices, pb, pa);
+                double costAB = ab ? q.Evaluate(Position(state, pb)) : DBL_MAX;
+                double costBA = ba ? q.Evaluate(Position(state, pa)) : DBL_MAX;
+                if (!ab && !ba)
+                    continue;
+                if (costAB <= costBA)
+                    state.collapses.push_back({ costAB, a, b });
+                else
+                    state.collapses.push_back({ costBA, b, a });
+            }
+            std::sort(state.collapses.begin(), state.collapses.end(), [](const Collapse &x, const Collapse &y) { return x.cost < y.cost; });
+
+            state.locked.assign(state.vertexCount, 0);
+            state.target.assign(state.vertexCount, -1);
+            int collapsed = 0;
+            int remaining = count / 3;
+            for (const Collapse &collapse : state.collapses)
+            {
+                if (collapse.cost > errorLimit || remaining * 3 <= targetCount)
+                    break;
+                int from = state.remap[collapse.from], to = state.remap[collapse.to];
+                if (state.locked[from] || state.locked[to])
+                    continue;
+                if (FlipsTriangle(state, indices, from, to))
+                    continue;
+
+                // 'from' has a single attribute copy, so every triangle around it uses collapse.from
+                state.target[collapse.from] = collapse.to;
+                state.collapsed[from] = to;
+                state.quadrics[to].Add(state.quadrics[from]);
+                maxError = std::max(maxError, collapse.cost);
+                for (int k = state.adjacencyStart[from]; k < state.adjacencyStart[from + 1]; k++)
+                {
+                    const int *tri = indices + state.adjacency[k] * 3;
+                    bool removed = false;
+                    for (int e = 0; e < 3; e++)
+                    {
+                        state.locked[state.remap[tri[e]]] = 1;
+                        removed |= state.remap[tri[e]] == to;
+                    }
+                    remaining -= removed ? 1 : 0;
+                }
+                collapsed++;
+            }
+
+            for (int i = 0; i < count; i++)
+                if (state.target[indices[i]] >= 0)
+                    indices[i] = state.target[indices[i]];
+            return collapsed;
+        }
+};
@@ -98,12 +98,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -125,6 +127,52 @@ typedef unsigned char validate_uint32[sizeof(stbi__uint32)==4 ? 1 : -1];
    #define stbi_lrot(x,y)  (((x) << (y)) | ((x) >> (-(y) & 31)))
 #endif
 
+#ifndef STBI_MALLOC
+// Allocation hooks for stbi_load_from_memory_into: while a target buffer is set
+// on this thread, the first live allocation of exactly the output size is
+// served from it, so the decoder writes the final pixels in place.
+static STBI_THREAD_LOCAL unsigned char *stbi__target_buffer;
+static STBI_THREAD_LOCAL size_t stbi__target_size;
+static STBI_THREAD_LOCAL int stbi__target_used;
+
+static void *stbi__target_malloc(size_t size)
+{
+   if (stbi__target_buffer && !stbi__target_used && size == stbi__target_size) {
+      stbi__target_used = 1;
+      return stbi__target_buffer;
+   }
+   return malloc(size);
+}
+
+static void stbi__target_free(void *p)
+{
+   if (p && p == stbi__target_buffer)
+      stbi__target_used = 0;
+   else
+      free(p);
+}
+
+static void *stbi__target_realloc(void *p, size_t newsz)
+{
+   if (p == NULL)
+      return stbi__target_malloc(newsz);
+   if (p == stbi__target_buffer) {
+      // the buffer is being used as scratch and has to grow; move it out
+      void *q = malloc(newsz);
+      if (q) {
+         memcpy(q, p, newsz < stbi__target_size ? newsz : stbi__target_size);
+         stbi__target_used = 0;
+      }
+      return q;
+   }
+   return realloc(p, newsz);
+}
+
+#define STBI_MALLOC(sz)           stbi__target_malloc(sz)
+#define STBI_REALLOC(p,newsz)     stbi__target_realloc(p,newsz)
+#define STBI_FREE(p)              stbi__target_free(p)
+#endif
+
 #if defined(STBI_MALLOC) && defined(STBI_FREE) && (defined(STBI_REALLOC) || defined(STBI_REALLOC_SIZED))
 // ok
 #elif !defined(STBI_MALLOC) && !defined(STBI_FREE) && !defined(STBI_REALLOC) && !defined(STBI_REALLOC_SIZED)
@@ -205,7 +253,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    int info3 = stbi__cpuid3();
@@ -216,7 +264,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    // If we're even attempting to compile this on GCC/Clang, that means
@@ -878,6 +926,34 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF stbi_uc *stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *out, size_t out_size, int *x, int *y, int *comp, int req_comp)
+{
+   int w, h, n;
+   stbi_uc *result;
+   size_t size;
+   if (!stbi_info_from_memory(buffer, len, &w, &h, &n))
+      return NULL;
+   size = (size_t)w * h * (req_comp ? req_comp : n);
+   if (out == NULL || size > out_size)
+      return stbi__errpuc("outofmem", "Output buffer too small");
+
+   stbi__target_buffer = out;
+   stbi__target_size = size;
+   stbi__target_used = 0;
+   result = stbi_load_from_memory(buffer, len, x, y, comp, req_comp);
+   stbi__target_buffer = NULL;
+   stbi__target_used = 0;
+
+   if (result == NULL)
+      return NULL;
+   if (result != out) {
+      // the decoder picked a different buffer for its output; fall back to a copy
+      memcpy(out, result, size);
+      free(result);
+   }
+   return out;
+}
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -3579,7 +3655,8 @@ typedef struct
 {
    stbi_uc *zbuffer, *zbuffer_end;
    int num_bits;
-   stbi__uint32 code_buffer;
+   int num_pad;                // zero bytes fed in past the end of the input
+   stbi__uint64 code_buffer;   // 64 bits so one refill covers several codes
 
    char *zout;
    char *zout_start;
@@ -3601,21 +3678,34 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
 
 static void stbi__fill_bits(stbi__zbuf *z)
 {
+   if (z->code_buffer >= ((stbi__uint64) 1 << z->num_bits)) {
+     z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
+     return;
+   }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || defined(_M_IX86) || defined(_M_X64)
+   // fast path: top the buffer up to 56+ bits with a single unaligned load
+   if (z->zbuffer_end - z->zbuffer >= 8) {
+      stbi__uint64 v;
+      int n = (63 - z->num_bits) >> 3;
+      memcpy(&v, z->zbuffer, 8);
+      z->code_buffer |= (v & (((stbi__uint64) 1 << (n * 8)) - 1)) << z->num_bits;
+      z->zbuffer += n;
+      z->num_bits += n * 8;
+      return;
+   }
+#endif
    do {
-      if (z->code_buffer >= (1U << z->num_bits)) {
-        z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
-        return;
-      }
-      z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
+      if (stbi__zeof(z)) z->num_pad++;
+      z->code_buffer |= (stbi__uint64) stbi__zget8(z) << z->num_bits;
       z->num_bits += 8;
-   } while (z->num_bits <= 24);
+   } while (z->num_bits <= 48);
 }
 
 stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
 {
    unsigned int k;
    if (z->num_bits < n) stbi__fill_bits(z);
-   k = z->code_buffer & ((1 << n) - 1);
+   k = (unsigned int) (z->code_buffer & ((1 << n) - 1));
    z->code_buffer >>= n;
    z->num_bits -= n;
    return k;
@@ -3626,7 +3716,7 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse((int) (a->code_buffer & 0xffff), 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -3649,7 +3739,7 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
       }
       stbi__fill_bits(a);
    }
-   b = z->fast[a->code_buffer & STBI__ZFAST_MASK];
+   b = z->fast[(int) (a->code_buffer & STBI__ZFAST_MASK)];
    if (b) {
       s = b >> 9;
       a->code_buffer >>= s;
@@ -3731,6 +3821,13 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
             stbi_uc v = *p;
             if (len) { do *zout++ = v; while (--len); }
          } else {
+            // chunks of 8 never overlap their own source when dist >= 8
+            if (dist >= 8) {
+               while (len >= 8) {
+                  memcpy(zout, p, 8);
+                  zout += 8; p += 8; len -= 8;
+               }
+            }
             if (len) { do *zout++ = *p++; while (--len); }
          }
       }
@@ -3795,12 +3892,21 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
       stbi__zreceive(a, a->num_bits & 7); // discard
    // drain the bit-packed data into header
    k = 0;
-   while (a->num_bits > 0) {
+   while (a->num_bits > 0 && k < 4) {
       header[k++] = (stbi_uc) (a->code_buffer & 255); // suppress MSVC run-time check
       a->code_buffer >>= 8;
       a->num_bits -= 8;
    }
    if (a->num_bits < 0) return stbi__err("zlib corrupt","Corrupt PNG");
+   if (a->num_bits > 0) {
+      // the wide bit buffer read ahead into the stored data; hand those bytes back
+      int back = (a->num_bits >> 3) - a->num_pad;
+      if (back < 0) return stbi__err("zlib corrupt","Corrupt PNG");
+      a->zbuffer -= back;
+      a->num_pad = 0;
+      a->code_buffer = 0;
+      a->num_bits = 0;
+   }
    // now fill header the normal way
    while (k < 4)
       header[k++] = stbi__zget8(a);
@@ -3865,6 +3971,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
    if (parse_header)
       if (!stbi__parse_zlib_header(a)) return 0;
    a->num_bits = 0;
+   a->num_pad = 0;
    a->code_buffer = 0;
    do {
       final = stbi__zreceive(a,1);
@@ -4048,6 +4155,104 @@ static int stbi__paeth(int a, int b, int c)
 
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#ifdef STBI_SSE2
+stbi_inline static __m128i stbi__png_load_pixel(const stbi_uc *p, int bpp)
+{
+   stbi__uint32 v;
+   if (bpp == 4)
+      memcpy(&v, p, 4);
+   else
+      v = p[0] | (p[1] << 8) | (p[2] << 16);
+   return _mm_cvtsi32_si128((int) v);
+}
+
+stbi_inline static void stbi__png_store_pixel(stbi_uc *p, __m128i v, int bpp)
+{
+   stbi__uint32 x = (stbi__uint32) _mm_cvtsi128_si32(v);
+   if (bpp == 4) {
+      memcpy(p, &x, 4);
+   } else {
+      p[0] = (stbi_uc) x;
+      p[1] = (stbi_uc) (x >> 8);
+      p[2] = (stbi_uc) (x >> 16);
+   }
+}
+
+// SSE2 unfiltering of one 8-bit row, 'cur' pointing past the first pixel. Up has
+// no dependency between bytes and runs 16 at a time; sub, avg and paeth depend
+// on the pixel to the left, so they keep one whole 3 or 4 byte pixel per step
+// in a register. Returns 0 for the cases left to the scalar code.
+static int stbi__unfilter_row_sse2(int filter, stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk, int bpp)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i one = _mm_set1_epi8(1);
+   __m128i a, b, c, x;
+   int k = 0;
+
+   if (filter == STBI__F_up) {
+      for (; k + 16 <= nk; k += 16) {
+         __m128i r = _mm_loadu_si128((const __m128i *) (raw + k));
+         __m128i p = _mm_loadu_si128((const __m128i *) (prior + k));
+         _mm_storeu_si128((__m128i *) (cur + k), _mm_add_epi8(r, p));
+      }
+      for (; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      return 1;
+   }
+   if (bpp != 3 && bpp != 4)
+      return 0;
+
+   a = stbi__png_load_pixel(cur - bpp, bpp);
+   switch (filter) {
+      case STBI__F_sub:
+      case STBI__F_paeth_first: // paeth(a,0,0) is always a
+         for (; k < nk; k += bpp) {
+            a = _mm_add_epi8(stbi__png_load_pixel(raw + k, bpp), a);
+            stbi__png_store_pixel(cur + k, a, bpp);
+         }
+         return 1;
+      case STBI__F_avg:
+      case STBI__F_avg_first:
+         b = zero;
+         for (; k < nk; k += bpp) {
+            // _mm_avg_epu8 rounds up, the filter rounds down
+            if (filter == STBI__F_avg)
+               b = stbi__png_load_pixel(prior + k, bpp);
+            x = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+            a = _mm_add_epi8(stbi__png_load_pixel(raw + k, bpp), x);
+            stbi__png_store_pixel(cur + k, a, bpp);
+         }
+         return 1;
+      case STBI__F_paeth:
+         c = _mm_unpacklo_epi8(stbi__png_load_pixel(prior - bpp, bpp), zero);
+         a = _mm_unpacklo_epi8(a, zero);
+         for (; k < nk; k += bpp) {
+            __m128i pa, pb, pc, smallest, nearest, pick_a, pick_b;
+            b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior + k, bpp), zero);
+            // p = a + b - c, so |p-a| = |b-c|, |p-b| = |a-c| and |p-c| = |(b-c) + (a-c)|
+            pa = _mm_sub_epi16(b, c);
+            pb = _mm_sub_epi16(a, c);
+            pc = _mm_add_epi16(pa, pb);
+            pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+            pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+            pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+            smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            // ties go to a, then b, then c
+            pick_a = _mm_cmpeq_epi16(smallest, pa);
+            pick_b = _mm_andnot_si128(pick_a, _mm_cmpeq_epi16(smallest, pb));
+            nearest = _mm_or_si128(_mm_and_si128(pick_a, a), _mm_and_si128(pick_b, b));
+            nearest = _mm_or_si128(nearest, _mm_andnot_si128(_mm_or_si128(pick_a, pick_b), c));
+            x = _mm_add_epi8(stbi__png_load_pixel(raw + k, bpp), _mm_packus_epi16(nearest, zero));
+            stbi__png_store_pixel(cur + k, x, bpp);
+            a = _mm_unpacklo_epi8(x, zero);
+            c = b;
+         }
+         return 1;
+   }
+   return 0;
+}
+#endif
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
@@ -4130,6 +4335,13 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // this is a little gross, so that we don't switch per-pixel or per-component
       if (depth < 8 || img_n == out_n) {
          int nk = (width - 1)*filter_bytes;
+         #ifdef STBI_SSE2
+         if (depth == 8 && filter != STBI__F_none && stbi__sse2_available() &&
+             stbi__unfilter_row_sse2(filter, cur, raw, prior, nk, filter_bytes)) {
+            raw += nk;
+            continue;
+         }
+         #endif
          #define STBI__CASE(f) \
              case f:     \
                 for (k=0; k < nk; ++k)
@@ -0,0 +1,709 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <string>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include "utils.hpp"
+#include "math.hpp"
+#include "jobs.hpp"
+#include "glstate.hpp"
+#include "render.hpp"
+
+// Heightmap terrain with CDLOD (continuous distance-dependent level of detail).
+// The world is cut into square tiles of tileSize x tileSize height samples
+// (plus one shared edge row), streamed in around the camera from disk or a
+// generator on worker threads. Each tile is a quadtree whose leaves cover
+// patchSize samples; every frame the tree is walked against distance ranges
+// that double per level and the frustum, and the chosen nodes are drawn with
+// one shared patchSize x patchSize grid Surface. The vertex shader reads the
+// heights from a float texture and morphs each vertex towards the next coarser
+// grid as it nears the end of its range, so levels meet without cracks or pops.
+
+#define TERRAIN_MAX_LEVELS      12
+
+struct TerrainSettings
+{
+    int   tileSize = 256;           // samples per tile side, power of two (stored with one extra edge row)
+    int   patchSize = 32;           // grid cells per drawn node, power of two <= tileSize
+    float spacing = 1.0f;           // world units between samples
+    float heightScale = 64.0f;      // world height of a source value of 1.0
+    float lodDistance = 96.0f;      // range of the finest level; each level doubles it
+    float morphRatio = 0.3f;        // fraction of each range spent morphing into the next level
+    int   loadRadius = 2;           // tiles kept loaded around the camera tile
+    int   maxUploadsPerFrame = 2;   // tiles moved to the GPU per Update()
+};
+
+struct TerrainStats
+{
+    int    residentTiles = 0;
+    int    pendingTiles = 0;
+    int    loadedTiles = 0;         // since Init
+    int    evictedTiles = 0;
+    int    drawnNodes = 0;
+    int    culledNodes = 0;
+    int    triangles = 0;
+    int    nodesPerLevel[TERRAIN_MAX_LEVELS] = {};
+    size_t cpuBytes = 0;            // heights and min/max trees
+    size_t gpuBytes = 0;            // height textures
+};
+
+// Fills samples x samples heights in 0..1, row by row along +Z. Called on a
+// worker thread; returns false if the tile does not exist.
+typedef std::function<bool(int tileX, int tileZ, int samples, float *heights)> TerrainSource;
+
+// Reads an 8 or 16 bit grey image as heights in 0..1. The image must be at
+// least (samples - 1) wide and high; a missing last row or column repeats the
+// edge, so plain power of two images can be used (with a seam in the normals).
+inline bool LoadHeightmap(const std::string &file_name, int samples, float *heights)
+{
+    MappedFile file(file_name.c_str());
+    if (!file.IsOpen())
+        return false;
+
+    int w = 0, h = 0, components = 0;
+    stbi_set_flip_vertically_on_load_thread(0);
+    stbi_us *data = stbi_load_16_from_memory(file.Data(), (int)file.Size(), &w, &h, &components, 1);
+    if (data == nullptr)
+    {
+        Log(2, "TERRAIN: Failed to load heightmap %s (%s)", file_name.c_str(), stbi_failure_reason());
+        return false;
+    }
+    if (w < samples - 1 || h < samples - 1)
+    {
+        Log(2, "TERRAIN: Heightmap %s is %dx%d, expected %dx%d", file_name.c_str(), w, h, samples, samples);
+        stbi_image_free(data);
+        return false;
+    }
+    for (int z = 0; z < samples; z++)
+    {
+        const stbi_us *row = data + (size_t)std::min(z, h - 1) * w;
+        for (int x = 0; x < samples; x++)
+            heights[(size_t)z * samples + x] = row[std::min(x, w - 1)] / 65535.0f;
+    }
+    stbi_image_free(data);
+    return true;
+}
+
+// Vertex shader for Terrain::Render. A fragment shader paired with it gets the
+// world position, normal and a texture coordinate of one unit per sample.
+inline const char *terrainVertexShader = R"(
+#version 300 es
+precision highp float;
+layout (location = 0) in vec3 aPos;
+uniform mat4 viewProjection;
+uniform vec3 cameraPosition;
+uniform vec4 node;          // world x, z of the node corner, world size, grid cells
+uniform vec2 morph;         // distance where morphing starts and ends
+uniform vec3 tile;          // world x, z of the tile corner, spacing
+uniform highp sampler2D heights;
+out vec3 WorldPos;
+out vec3 Normal;
+out vec2 TexCoord;
+
+float Height(ivec2 texel)
+{
+    ivec2 last = textureSize(heights, 0) - 1;
+    return texelFetch(heights, clamp(texel, ivec2(0), last), 0).r;
+}
+
+ivec2 Texel(vec2 world)
+{
+    return ivec2(floor((world - tile.xy) / tile.z + 0.5));
+}
+
+void main()
+{
+    vec2 grid = aPos.xz;
+    vec2 world = node.xy + grid * node.z;
+    float height = Height(Texel(world));
+    float k = clamp((distance(cameraPosition, vec3(world.x, height, world.y)) - morph.x) / (morph.y - morph.x), 0.0, 1.0);
+
+    // Odd vertices slide onto the even ones, giving the parent level's grid at k = 1
+    grid -= fract(grid * node.w * 0.5) * 2.0 / node.w * k;
+    world = node.xy + grid * node.z;
+    ivec2 texel = Texel(world);
+    height = Height(texel);
+
+    float dx = Height(texel + ivec2(1, 0)) - Height(texel - ivec2(1, 0));
+    float dz = Height(texel + ivec2(0, 1)) - Height(texel - ivec2(0, 1));
+    Normal = normalize(vec3(-dx, 2.0 * tile.z, -dz));
+    WorldPos = vec3(world.x, height, world.y);
+    TexCoord = (world - tile.xy) / tile.z;
+    gl_Position = viewProjection * vec4(WorldPos, 1.0);
+})";
+
+inline const char *terrainFragmentShader = R"(
+#version 300 es
+precision mediump float;
+in vec3 WorldPos;
+in vec3 Normal;
+in vec2 TexCoord;
+out vec4 FragColor;
+uniform vec3 lightDirection;
+void main()
+{
+    vec3 n = normalize(Normal);
+    vec3 grass = vec3(0.32, 0.45, 0.22);
+    vec3 rock = vec3(0.45, 0.42, 0.38);
+    vec3 color = mix(rock, grass, smoothstep(0.7, 0.85, n.y));
+    float light = 0.25 + 0.75 * max(dot(n, normalize(lightDirection)), 0.0);
+    FragColor = vec4(color * light, 1.0);
+})";
+
+class Terrain
+{
+    public:
+    Terrain()
+    {
+        m_jobs = nullptr;
+        m_patch = nullptr;
+        m_levels = 0;
+        m_samples = 0;
+        m_initialized = false;
+    }
+    ~Terrain()
+    {
+        Release();
+    }
+    Terrain(const Terrain&) = delete;
+    Terrain &operator=(const Terrain&) = delete;
+
+    // GL thread. jobs may be nullptr, in which case tiles load inside Update().
+    bool Init(const TerrainSettings &settings, const TerrainSource &source, JobSystem *jobs = nullptr)
+    {
+        Release();
+        if (settings.tileSize < 2 || (settings.tileSize & (settings.tileSize - 1)) != 0 ||
+            settings.patchSize < 2 || (settings.patchSize & (settings.patchSize - 1)) != 0 ||
+            settings.patchSize > settings.tileSize)
+        {
+            Log(2, "TERRAIN: tile size %d and patch size %d must be powers of two with patch <= tile",
+                settings.tileSize, settings.patchSize);
+            return false;
+        }
+
+        m_settings = settings;
+        m_source = source;
+        m_jobs = jobs;
+        m_samples = settings.tileSize + 1;
+        m_levels = 1;
+        while ((settings.patchSize << m_levels) <= settings.tileSize && m_levels < TERRAIN_MAX_LEVELS)
+            m_levels++;
+        m_stats = TerrainStats();
+
+        // Ranges double per level; the coarsest level covers everything left
+        float nodeSize = settings.patchSize * settings.spacing;
+        // Each range must reach past the previous one by a node diagonal, or neighbours can skip a level
+        if (settings.lodDistance < nodeSize * 3.0f)
+            Log(1, "TERRAIN: lod distance %.1f is under three leaf nodes (%.1f); neighbouring levels may crack",
+                settings.lodDistance, nodeSize * 3.0f);
+        float previous = 0.0f;
+        for (int level = 0; level < m_levels; level++)
+        {
+            float range = level == m_levels - 1 ? FLT_MAX : settings.lodDistance * (float)(1 << level);
+            m_ranges[level] = range;
+            m_morphEnd[level] = level == m_levels - 1 ? FLT_MAX : range;
+            m_morphStart[level] = level == m_levels - 1 ? FLT_MAX * 0.5f : range - (range - previous) * settings.morphRatio;
+            previous = range;
+        }
+
+        m_patch = new Surface(FVF_XYZ | FVF_TEX1 | FVF_FCOLOR | FVF_NORMAL);
+        const int cells = settings.patchSize;
+        Surface::GenerateLattice(*m_patch, cells, cells, nullptr, [cells](int x, int z, Vertex &v)
+        {
+            v = Vertex((float)x / cells, 0.0f, (float)z / cells, 0.0f, 1.0f, 0.0f, Color(), (float)x / cells, (float)z / cells);
+        });
+        m_patch->Build(true);
+
+        if (!m_shader.create(terrainVertexShader, terrainFragmentShader))
+            return false;
+        m_shader.LoadDefaults();
+        m_initialized = true;
+        Log(0, "TERRAIN: %d levels, tiles of %dx%d samples (%.0f world units), %dx%d grid per node",
+            m_levels, settings.tileSize, settings.tileSize, GetTileWorldSize(), cells, cells);
+        return true;
+    }
+
+    // Loads from name_pattern formatted with the tile x and z, e.g. "terrain/tile_%d_%d.png"
+    bool Init(const TerrainSettings &settings, const std::string &name_pattern, JobSystem *jobs = nullptr)
+    {
+        return Init(settings, [name_pattern](int x, int z, int samples, float *heights)
+        {
+            const char *name = TextFormat(name_pattern.c_str(), x, z);
+            return FileExists(name) && LoadHeightmap(name, samples, heights);
+        }, jobs);
+    }
+
+    // Waits for loads in flight and frees every tile, the patch and the shader; GL thread
+    void Release()
+    {
+        if (m_jobs)
+            m_jobs->Wait(m_loads);
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_ready.clear();
+        }
+        m_pending.clear();
+        for (auto &entry : m_tiles)
+            FreeTile(*entry.second);
+        m_tiles.clear();
+        m_selected.clear();
+        delete m_patch;
+        m_patch = nullptr;
+        m_shader.Release();
+        m_initialized = false;
+    }
+
+    // Streams tiles around the camera: queues missing ones nearest first, uploads
+    // finished ones within the per frame budget and drops those out of range
+    void Update(const Vec3 &cameraPosition)
+    {
+        if (!m_initialized)
+            return;
+        PROFILE_SCOPE("Terrain::Update");
+        const int radius = m_settings.loadRadius;
+        const float tileWorld = GetTileWorldSize();
+        const int cx = (int)floorf(cameraPosition.x / tileWorld);
+        const int cz = (int)floorf(cameraPosition.z / tileWorld);
+
+        // Tiles one ring beyond the radius are kept so moving along a border does not thrash
+        for (auto it = m_tiles.begin(); it != m_tiles.end();)
+        {
+            Tile &tile = *it->second;
+            if (std::abs(tile.x - cx) > radius + 1 || std::abs(tile.z - cz) > radius + 1)
+            {
+                FreeTile(tile);
+                it = m_tiles.erase(it);
+                m_stats.evictedTiles++;
+            }
+            else
+                ++it;
+        }
+        for (auto it = m_pending.begin(); it != m_pending.end();)
+        {
+            if (std::abs(it->second->x - cx) > radius + 1 || std::abs(it->second->z - cz) > radius + 1)
+            {
+                it->second->cancelled = true;
+                it = m_pending.erase(it);
+            }
+            else
+                ++it;
+        }
+
+        m_missing.clear();
+        for (int z = cz - radius; z <= cz + radius; z++)
+            for (int x = cx - radius; x <= cx + radius; x++)
+            {
+                long long key = GetKey(x, z);
+                if (m_tiles.find(key) == m_tiles.end() && m_pending.find(key) == m_pending.end())
+                    m_missing.push_back({ (x - cx) * (x - cx) + (z - cz) * (z - cz), x, z });
+            }
+        std::sort(m_missing.begin(), m_missing.end(), [](const Missing &a, const Missing &b) { return a.distance < b.distance; });
+        for (const Missing &missing : m_missing)
+            RequestTile(missing.x, missing.z);
+
+        UploadReady();
+        m_stats.residentTiles = (int)m_tiles.size();
+        m_stats.pendingTiles = (int)m_pending.size();
+    }
+
+    // Picks the nodes to draw for this view and fills the node statistics; Render() calls it
+    void Select(const Mat4 &viewProjection, const Vec3 &cameraPosition)
+    {
+        PROFILE_SCOPE("Terrain::Select");
+        m_frustum.buildViewFrustum(viewProjection);
+        m_camera = cameraPosition;
+        m_selected.clear();
+        m_stats.drawnNodes = 0;
+        m_stats.culledNodes = 0;
+        m_stats.triangles = 0;
+        for (int level = 0; level < TERRAIN_MAX_LEVELS; level++)
+            m_stats.nodesPerLevel[level] = 0;
+
+        for (auto &entry : m_tiles)
+        {
+            Tile &tile = *entry.second;
+            if (!tile.valid)
+                continue;
+            SelectNode(tile, m_levels - 1, 0, 0);
+        }
+        // Nearest first so the depth test rejects more of what is behind
+        std::sort(m_selected.begin(), m_selected.end(), [](const Node &a, const Node &b) { return a.distance < b.distance; });
+    }
+
+    // Draws the selected nodes with the built in shader, or with one made from
+    // terrainVertexShader and a custom fragment shader
+    void Render(const Mat4 &viewProjection, const Vec3 &cameraPosition, Shader *shader = nullptr)
+    {
+        if (!m_initialized)
+            return;
+        PROFILE_SCOPE("Terrain::Render");
+        Select(viewProjection, cameraPosition);
+        if (m_selected.empty())
+            return;
+
+        Shader &program = shader ? *shader : m_shader;
+        program.Bind();
+        program.setMatrix4("viewProjection", viewProjection);
+        program.setFloat3("cameraPosition", cameraPosition.x, cameraPosition.y, cameraPosition.z);
+        program.setInt("heights", 0);
+        if (!shader)
+            program.setFloat3("lightDirection", 0.4f, 0.8f, 0.3f);
+
+        const Tile *bound = nullptr;
+        for (const Node &node : m_selected)
+        {
+            if (node.tile != bound)
+            {
+                bound = node.tile;
+                GLState::BindTextureUnit(0, GL_TEXTURE_2D, bound->texture);
+                program.setFloat3("tile", bound->x * GetTileWorldSize(), bound->z * GetTileWorldSize(), m_settings.spacing);
+            }
+            program.setFloat4("node", node.x, node.z, node.size, (float)m_settings.patchSize);
+            program.setFloat2("morph", m_morphStart[node.level], m_morphEnd[node.level]);
+            m_patch->Render();
+        }
+    }
+
+    // Bilinear height at a world position, 0 where no tile is loaded
+    float GetHeight(float x, float z) const
+    {
+        const float tileWorld = GetTileWorldSize();
+        int tx = (int)floorf(x / tileWorld), tz = (int)floorf(z / tileWorld);
+        auto it = m_tiles.find(GetKey(tx, tz));
+        if (it == m_tiles.end() || !it->second->valid)
+            return 0.0f;
+        const Tile &tile = *it->second;
+        float fx = (x - tx * tileWorld) / m_settings.spacing;
+        float fz = (z - tz * tileWorld) / m_settings.spacing;
+        int ix = std::min(std::max((int)fx, 0), m_samples - 2);
+        int iz = std::min(std::max((int)fz, 0), m_samples - 2);
+        fx -= ix;
+        fz -= iz;
+        const float *row = tile.heights.data() + (size_t)iz * m_samples + ix;
+        float top = row[0] + (row[1] - row[0]) * fx;
+        float bottom = row[m_samples] + (row[m_samples + 1] - row[m_samples]) * fx;
+        return top + (bottom - top) * fz;
+    }
+
+    bool IsTileLoaded(int tileX, int tileZ) const
+    {
+        return m_tiles.find(GetKey(tileX, tileZ)) != m_tiles.end();
+    }
+
+    float GetTileWorldSize() const
+    {
+        return m_settings.tileSize * m_settings.spacing;
+    }
+
+    int GetLevelCount() const { return m_levels; }
+    const TerrainStats &GetStats() const { return m_stats; }
+    const TerrainSettings &GetSettings() const { return m_settings; }
+
+    void LogStats() const
+    {
+        Log(0, "TERRAIN: %d tiles resident, %d loading (%d loaded, %d evicted)  %.2f MB CPU  %.2f MB GPU",
+            m_stats.residentTiles, m_stats.pendingTiles, m_stats.loadedTiles, m_stats.evictedTiles,
+            m_stats.cpuBytes / (1024.0 * 1024.0), m_stats.gpuBytes / (1024.0 * 1024.0));
+        char levels[256];
+        int length = 0;
+        for (int level = 0; level < m_levels && length < (int)sizeof(levels); level++)
+            length += snprintf(levels + length, sizeof(levels) - length, " %d", m_stats.nodesPerLevel[level]);
+        Log(0, "TERRAIN: %d nodes drawn, %d culled, %d triangles, nodes per level:%s",
+            m_stats.drawnNodes, m_stats.culledNodes, m_stats.triangles, length > 0 ? levels : " none");
+    }
+
+    private:
+        struct Tile
+        {
+            int x = 0;
+            int z = 0;
+            bool valid = false;             // false when the source had no data for it
+            UINT texture = 0;
+            std::vector<float> heights;     // world heights, samples x samples
+            std::vector<float> bounds;      // min, max per node, level 0 first
+            int levelOffset[TERRAIN_MAX_LEVELS] = {};
+        };
+
+        struct Request
+        {
+            int x = 0;
+            int z = 0;
+            bool cancelled = false;         // GL thread only
+            std::unique_ptr<Tile> tile;
+        };
+
+        struct Node
+        {
+            const Tile *tile;
+            float x;
+            float z;
+            float size;
+            float distance;
+            int level;
+        };
+
+        struct Missing
+        {
+            int distance;
+            int x;
+            int z;
+        };
+
+        TerrainSettings m_settings;
+        TerrainSource m_source;
+        JobSystem *m_jobs;
+        JobCounter m_loads;
+        Surface *m_patch;
+        Shader m_shader;
+        int m_levels;
+        int m_samples;
+        bool m_initialized;
+        float m_ranges[TERRAIN_MAX_LEVELS];
+        float m_morphStart[TERRAIN_MAX_LEVELS];
+        float m_morphEnd[TERRAIN_MAX_LEVELS];
+
+        std::unordered_map<long long, std::unique_ptr<Tile>> m_tiles;
+        std::unordered_map<long long, std::shared_ptr<Request>> m_pending;
+        std::mutex m_lock;
+        std::deque<std::shared_ptr<Request>> m_ready;
+        std::vector<Missing> m_missing;
+        std::vector<Node> m_selected;
+        Frustum m_frustum;
+        Vec3 m_camera;
+        TerrainStats m_stats;
+
+        static long long GetKey(int x, int z)
+        {
+            return (long long)(((unsigned long long)(unsigned int)x << 32) | (unsigned int)z);
+        }
+
+        void RequestTile(int x, int z)
+        {
+            std::shared_ptr<Request> request = std::make_shared<Request>();
+            request->x = x;
+            request->z = z;
+            m_pending[GetKey(x, z)] = request;
+
+            auto load = [this, request]()
+            {
+                request->tile = LoadTile(request->x, request->z);
+                std::lock_guard<std::mutex> guard(m_lock);
+                m_ready.push_back(request);
+            };
+            if (m_jobs)
+                m_jobs->Run(load, &m_loads);
+            else
+                load();
+        }
+
+        // Worker side: heights and min/max tree, no GL
+        std::unique_ptr<Tile> LoadTile(int x, int z) const
+        {
+            std::unique_ptr<Tile> tile(new Tile());
+            tile->x = x;
+            tile->z = z;
+            tile->heights.resize((size_t)m_samples * m_samples);
+            tile->valid = m_source && m_source(x, z, m_samples, tile->heights.data());
+            if (!tile->valid)
+            {
+                tile->heights.clear();
+                tile->heights.shrink_to_fit();
+                return tile;
+            }
+            for (float &height : tile->heights)
+                height *= m_settings.heightScale;
+
+            int offset = 0;
+            for (int level = 0; level < m_levels; level++)
+            {
+                int nodes = m_settings.tileSize / (m_settings.patchSize << level);
+                tile->levelOffset[level] = offset;
+                offset += nodes * nodes * 2;
+            }
+            tile->bounds.resize(offset);
+
+            // Leaves scan their samples, edges included; parents merge four children
+            const int cells = m_settings.patchSize;
+            const int leaves = m_settings.tileSize / cells;
+            for (int nz = 0; nz < leaves; nz++)
+                for (int nx = 0; nx < leaves; nx++)
+                {
+                    float low = FLT_MAX, high = -FLT_MAX;
+                    for (int sz = nz * cells; sz <= (nz + 1) * cells; sz++)
+                    {
+                        const float *row = tile->heights.data() + (size_t)sz * m_samples;
+                        for (int sx = nx * cells; sx <= (nx + 1) * cells; sx++)
+                        {
+                            low = std::min(low, row[sx]);
+                            high = std::max(high, row[sx]);
+                        }
+                    }
+                    float *bound = &tile->bounds[(nz * leaves + nx) * 2];
+                    bound[0] = low;
+                    bound[1] = high;
+                }
+            for (int level = 1; level < m_levels; level++)
+            {
+                int nodes = m_settings.tileSize / (m_settings.patchSize << level);
+                const float *child = &tile->bounds[tile->levelOffset[level - 1]];
+                float *bound = &tile->bounds[tile->levelOffset[level]];
+                for (int nz = 0; nz < nodes; nz++)
+                    for (int nx = 0; nx < nodes; nx++)
+                    {
+                        float low = FLT_MAX, high = -FLT_MAX;
+                        for (int c = 0; c < 4; c++)
+                        {
+                            const float *b = child + ((nz * 2 + (c >> 1)) * nodes * 2 + nx * 2 + (c & 1)) * 2;
+                            low = std::min(low, b[0]);
+                            high = std::max(high, b[1]);
+                        }
+                        bound[(nz * nodes + nx) * 2] = low;
+                        bound[(nz * nodes + nx) * 2 + 1] = high;
+                    }
+            }
+            return tile;
+        }
+
+        void UploadReady()
+        {
+            for (int uploaded = 0; uploaded < std::max(m_settings.maxUploadsPerFrame, 1);)
+            {
+                std::shared_ptr<Request> request;
+                {
+                    std::lock_guard<std::mutex> guard(m_lock);
+                    if (m_ready.empty())
+                        break;
+                    request = m_ready.front();
+                    m_ready.pop_front();
+                }
+                if (request->cancelled)
+                    continue;
+                m_pending.erase(GetKey(request->x, request->z));
+
+                Tile &tile = *request->tile;
+                if (tile.valid)
+                {
+                    glGenTextures(1, &tile.texture);
+                    GLState::BindTexture(GL_TEXTURE_2D, tile.texture);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                    // Float rows are 4 byte aligned; put back what the other uploads expect
+                    GLint alignment = 4;
+                    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+                    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, m_samples, m_samples, 0, GL_RED, GL_FLOAT, tile.heights.data());
+                    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+                    GLState::BindTexture(GL_TEXTURE_2D, 0);
+
+                    size_t gpuBytes = (size_t)m_samples * m_samples * sizeof(float);
+                    MemoryTracker::SetGPUSize(MEMORY_GPU_TEXTURE, tile.texture, gpuBytes);
+                    MemoryTracker::Add(MEMORY_TERRAIN, GetCPUBytes(tile));
+                    m_stats.cpuBytes += GetCPUBytes(tile);
+                    m_stats.gpuBytes += gpuBytes;
+                    uploaded++;
+                }
+                m_tiles[GetKey(tile.x, tile.z)] = std::move(request->tile);
+                m_stats.loadedTiles++;
+            }
+        }
+
+        void FreeTile(Tile &tile)
+        {
+            if (!tile.valid)
+                return;
+            GLState::DeleteTexture(tile.texture);
+            tile.texture = 0;
+            MemoryTracker::Remove(MEMORY_TERRAIN, GetCPUBytes(tile));
+            m_stats.cpuBytes -= GetCPUBytes(tile);
+            m_stats.gpuBytes -= (size_t)m_samples * m_samples * sizeof(float);
+        }
+
+        static size_t GetCPUBytes(const Tile &tile)
+        {
+            return (tile.heights.size() + tile.bounds.size()) * sizeof(float);
+        }
+
+        void GetNodeBox(const Tile &tile, int level, int nx, int nz, Vec3 &mins, Vec3 &maxs) const
+        {
+            const int nodes = m_settings.tileSize / (m_settings.patchSize << level);
+            const float size = (float)(m_settings.patchSize << level) * m_settings.spacing;
+            const float *bound = &tile.bounds[tile.levelOffset[level] + (nz * nodes + nx) * 2];
+            const float tileWorld = GetTileWorldSize();
+            mins = Vec3(tile.x * tileWorld + nx * size, bound[0], tile.z * tileWorld + nz * size);
+            maxs = Vec3(mins.x + size, bound[1], mins.z + size);
+        }
+
+        static float DistanceSquared(const Vec3 &point, const Vec3 &mins, const Vec3 &maxs)
+        {
+            float dx = std::max(std::max(mins.x - point.x, 0.0f), point.x - maxs.x);
+            float dy = std::max(std::max(mins.y - point.y, 0.0f), point.y - maxs.y);
+            float dz = std::max(std::max(mins.z - point.z, 0.0f), point.z - maxs.z);
+            return dx * dx + dy * dy + dz * dz;
+        }
+
+        bool InRange(const Vec3 &mins, const Vec3 &maxs, int level) const
+        {
+            if (level >= m_levels - 1)
+                return true;
+            return DistanceSquared(m_camera, mins, maxs) <= m_ranges[level] * m_ranges[level];
+        }
+
+        // Returns false when the node is beyond its level's range, leaving it
+        // to the parent to draw that area coarser
+        bool SelectNode(const Tile &tile, int level, int nx, int nz)
+        {
+            Vec3 mins, maxs;
+            GetNodeBox(tile, level, nx, nz, mins, maxs);
+            if (!InRange(mins, maxs, level))
+                return false;
+            if (m_frustum.cullBox(mins, maxs))
+            {
+                m_stats.culledNodes++;
+                return true;
+            }
+            if (level == 0 || !InRange(mins, maxs, level - 1))
+            {
+                AddNode(tile, level, mins, maxs);
+                return true;
+            }
+
+            for (int c = 0; c < 4; c++)
+            {
+                int cx = nx * 2 + (c & 1), cz = nz * 2 + (c >> 1);
+                if (SelectNode(tile, level - 1, cx, cz))
+                    continue;
+                // Too far for its own level: drawn at its own grid fully morphed,
+                // which matches this level's resolution
+                Vec3 childMins, childMaxs;
+                GetNodeBox(tile, level - 1, cx, cz, childMins, childMaxs);
+                if (m_frustum.cullBox(childMins, childMaxs))
+                    m_stats.culledNodes++;
+                else
+                    AddNode(tile, level - 1, childMins, childMaxs);
+            }
+            return true;
+        }
+
+        void AddNode(const Tile &tile, int level, const Vec3 &mins, const Vec3 &maxs)
+        {
+            Node node;
+            node.tile = &tile;
+            node.x = mins.x;
+            node.z = mins.z;
+            node.size = maxs.x - mins.x;
+            node.distance = DistanceSquared(m_camera, mins, maxs);
+            node.level = level;
+            m_selected.push_back(node);
+            m_stats.drawnNodes++;
+            m_stats.nodesPerLevel[level]++;
+            m_stats.triangles += m_settings.patchSize * m_settings.patchSize * 2;
+        }
+};
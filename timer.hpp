@@ -0,0 +1,158 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <math.h>
+#include <time.h>
+#include "utils.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <emmintrin.h>
+    #define TIMER_PAUSE() _mm_pause()
+#else
+    #define TIMER_PAUSE() std::this_thread::yield()
+#endif
+
+// Monotonic clock with nanosecond resolution (CLOCK_MONOTONIC) and a wait
+// that sleeps while the scheduler can be trusted and spins the rest, so frame
+// pacing is accurate to a few microseconds instead of a whole millisecond.
+class Timer
+{
+    public:
+    static long long GetNanoseconds()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+    }
+
+    static double GetSeconds()
+    {
+        return GetNanoseconds() * 1e-9;
+    }
+
+    // Sleeps in 1 ms steps while more than the expected oversleep is left,
+    // then spins. The estimate (mean + one deviation of past 1 ms sleeps)
+    // adapts to the OS timer slack. Each calling thread keeps its own estimate.
+    static void Wait(double seconds)
+    {
+        Estimator &e = GetEstimator();
+        long long end = GetNanoseconds() + (long long)(seconds * 1e9);
+        for (;;)
+        {
+            long long now = GetNanoseconds();
+            if ((double)(end - now) <= e.estimate)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            double observed = (double)(GetNanoseconds() - now);
+
+            // Welford running mean and deviation, restarted now and then so a
+            // change in system load is picked up
+            if (++e.samples > 1000)
+            {
+                e.samples = 1;
+                e.mean = 1e6;
+                e.m2 = 0.0;
+            }
+            double delta = observed - e.mean;
+            e.mean += delta / e.samples;
+            e.m2 += delta * (observed - e.mean);
+            e.estimate = e.mean + sqrt(e.m2 / e.samples);
+        }
+        while (GetNanoseconds() < end)
+            TIMER_PAUSE();
+    }
+
+    private:
+        struct Estimator
+        {
+            double estimate = 2e6;
+            double mean = 1e6;
+            double m2 = 0.0;
+            long samples = 0;
+        };
+
+        // Per thread, so App::Wait is safe from workers too
+        static Estimator &GetEstimator()
+        {
+            static thread_local Estimator estimator;
+            return estimator;
+        }
+};
+
+// Rolling window of frame times, in seconds
+class FrameStats
+{
+    public:
+    explicit FrameStats(int window = 240)
+    {
+        m_times.resize(window > 0 ? window : 1, 0.0);
+        m_count = 0;
+        m_next = 0;
+    }
+
+    void Add(double seconds)
+    {
+        m_times[m_next] = seconds;
+        m_next = (m_next + 1) % (int)m_times.size();
+        if (m_count < (int)m_times.size())
+            m_count++;
+    }
+
+    void Clear()
+    {
+        m_count = 0;
+        m_next = 0;
+    }
+
+    int GetCount() const { return m_count; }
+
+    double GetMin() const
+    {
+        if (m_count == 0) return 0.0;
+        return *std::min_element(m_times.begin(), m_times.begin() + m_count);
+    }
+
+    double GetMax() const
+    {
+        if (m_count == 0) return 0.0;
+        return *std::max_element(m_times.begin(), m_times.begin() + m_count);
+    }
+
+    double GetAverage() const
+    {
+        if (m_count == 0) return 0.0;
+        double total = 0.0;
+        for (int i = 0; i < m_count; i++)
+            total += m_times[i];
+        return total / m_count;
+    }
+
+    // percent in 0..100, e.g. 99 for the frame time 99% of frames stay under
+    double GetPercentile(double percent) const
+    {
+        if (m_count == 0) return 0.0;
+        std::vector<double> sorted(m_times.begin(), m_times.begin() + m_count);
+        int index = (int)ceil(percent / 100.0 * m_count) - 1;
+        index = std::min(std::max(index, 0), m_count - 1);
+        std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+        return sorted[index];
+    }
+
+    double GetP99() const
+    {
+        return GetPercentile(99.0);
+    }
+
+    void LogStats(const char *label = "FRAME") const
+    {
+        Log(0, "TIMER: %s over %d frames: min %.3f ms  avg %.3f ms  p99 %.3f ms  max %.3f ms", label, m_count,
+            GetMin() * 1000.0, GetAverage() * 1000.0, GetP99() * 1000.0, GetMax() * 1000.0);
+    }
+
+    private:
+        std::vector<double> m_times;
+        int m_count;
+        int m_next;
+};
@@ -0,0 +1,431 @@
+// etc2enc - converts PNG/JPG/TGA images to ETC2 compressed KTX 1.1 files.
+//
+//   etc2enc [-srgb] [-nomips] input.png output.ktx
+//
+// RGB images become GL_COMPRESSED_RGB8_ETC2, images with alpha become
+// GL_COMPRESSED_RGBA8_ETC2_EAC. Colour blocks use the ETC1 compatible
+// individual/differential modes, which every ETC2 decoder accepts.
+// Build with "make etc2enc".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <chrono>
+#include "../stb_image.h"
+
+#define GL_RGB                              0x1907
+#define GL_RGBA                             0x1908
+#define GL_COMPRESSED_RGB8_ETC2             0x9274
+#define GL_COMPRESSED_SRGB8_ETC2            0x9275
+#define GL_COMPRESSED_RGBA8_ETC2_EAC        0x9278
+#define GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC 0x9279
+
+static const int etcModifiers[8][4] =
+{
+    {  2,   8,  -2,   -8 },
+    {  5,  17,  -5,  -17 },
+    {  9,  29,  -9,  -29 },
+    { 13,  42, -13,  -42 },
+    { 18,  60, -18,  -60 },
+    { 24,  80, -24,  -80 },
+    { 33, 106, -33, -106 },
+    { 47, 183, -47, -183 }
+};
+
+static const int eacModifiers[16][8] =
+{
+    { -3, -6,  -9, -15, 2, 5, 8, 14 },
+    { -3, -7, -10, -13, 2, 6, 9, 12 },
+    { -2, -5,  -8, -13, 1, 4, 7, 12 },
+    { -2, -4,  -6, -13, 1, 3, 5, 12 },
+    { -3, -6,  -8, -12, 2, 5, 7, 11 },
+    { -3, -7,  -9, -11, 2, 6, 8, 10 },
+    { -4, -7,  -8, -11, 3, 6, 7, 10 },
+    { -3, -5,  -8, -11, 2, 4, 7, 10 },
+    { -2, -6,  -8, -10, 1, 5, 7,  9 },
+    { -2, -5,  -8, -10, 1, 4, 7,  9 },
+    { -2, -4,  -8, -10, 1, 3, 7,  9 },
+    { -2, -5,  -7, -10, 1, 4, 6,  9 },
+    { -3, -4,  -7, -10, 2, 3, 6,  9 },
+    { -1, -2,  -3, -10, 0, 1, 2,  9 },
+    { -4, -6,  -8,  -9, 3, 5, 7,  8 },
+    { -3, -5,  -7,  -9, 2, 4, 6,  8 }
+};
+
+static inline int Clamp255(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+// Pixels of a 4x4 block are numbered down the columns: index = x * 4 + y
+struct Block
+{
+    int rgba[16][4];
+};
+
+struct SubblockFit
+{
+    int table;
+    int indices[8];
+    int error;
+};
+
+// Picks the best modifier table and per pixel indices for one half block
+static SubblockFit FitSubblock(const Block &block, const int *pixels, const int base[3])
+{
+    SubblockFit best;
+    best.error = 0x7FFFFFFF;
+    for (int table = 0; table < 8; table++)
+    {
+        SubblockFit fit;
+        fit.table = table;
+        fit.error = 0;
+        for (int p = 0; p < 8; p++)
+        {
+            const int *c = block.rgba[pixels[p]];
+            int bestError = 0x7FFFFFFF;
+            for (int i = 0; i < 4; i++)
+            {
+                int m = etcModifiers[table][i];
+                int dr = Clamp255(base[0] + m) - c[0];
+                int dg = Clamp255(base[1] + m) - c[1];
+                int db = Clamp255(base[2] + m) - c[2];
+                int e = dr * dr * 2 + dg * dg * 4 + db * db;
+                if (e < bestError)
+                {
+                    bestError = e;
+                    fit.indices[p] = i;
+                }
+            }
+            fit.error += bestError;
+            if (fit.error >= best.error)
+                break;
+        }
+        if (fit.error < best.error)
+            best = fit;
+    }
+    return best;
+}
+
+static void AverageColor(const Block &block, const int *pixels, float avg[3])
+{
+    avg[0] = avg[1] = avg[2] = 0.0f;
+    for (int p = 0; p < 8; p++)
+        for (int k = 0; k < 3; k++)
+            avg[k] += block.rgba[pixels[p]][k];
+    for (int k = 0; k < 3; k++)
+        avg[k] /= 8.0f;
+}
+
+static inline int Quantize(float v, int bits)
+{
+    int max = (1 << bits) - 1;
+    int q = (int)(v * max / 255.0f + 0.5f);
+    return q < 0 ? 0 : (q > max ? max : q);
+}
+
+static inline int Expand4(int v) { return (v << 4) | v; }
+static inline int Expand5(int v) { return (v << 3) | (v >> 2); }
+
+static void WriteBE64(uint64_t bits, unsigned char *out)
+{
+    for (int i = 0; i < 8; i++)
+        out[i] = (unsigned char)(bits >> (56 - 8 * i));
+}
+
+static void EncodeColorBlock(const Block &block, unsigned char *out)
+{
+    static const int sides[2][2][8] =
+    {
+        // flip 0: left/right 2x4 halves
+        { { 0, 1, 2, 3, 4, 5, 6, 7 }, { 8, 9, 10, 11, 12, 13, 14, 15 } },
+        // flip 1: top/bottom 4x2 halves
+        { { 0, 1, 4, 5, 8, 9, 12, 13 }, { 2, 3, 6, 7, 10, 11, 14, 15 } }
+    };
+
+    uint64_t bestBits = 0;
+    int bestError = 0x7FFFFFFF;
+
+    for (int flip = 0; flip < 2; flip++)
+    {
+        float avg[2][3];
+        AverageColor(block, sides[flip][0], avg[0]);
+        AverageColor(block, sides[flip][1], avg[1]);
+
+        for (int diff = 0; diff < 2; diff++)
+        {
+            int q[2][3];
+            int base[2][3];
+            for (int s = 0; s < 2; s++)
+                for (int k = 0; k < 3; k++)
+                    q[s][k] = Quantize(avg[s][k], diff ? 5 : 4);
+
+            if (diff)
+            {
+                bool fits = true;
+                for (int k = 0; k < 3; k++)
+                {
+                    int d = q[1][k] - q[0][k];
+                    if (d < -4 || d > 3) fits = false;
+                }
+                if (!fits)
+                    continue;
+            }
+            for (int s = 0; s < 2; s++)
+                for (int k = 0; k < 3; k++)
+                    base[s][k] = diff ? Expand5(q[s][k]) : Expand4(q[s][k]);
+
+            SubblockFit fit[2];
+            fit[0] = FitSubblock(block, sides[flip][0], base[0]);
+            fit[1] = FitSubblock(block, sides[flip][1], base[1]);
+            int error = fit[0].error + fit[1].error;
+            if (error >= bestError)
+                continue;
+
+            uint64_t bits = 0;
+            if (diff)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    int d = (q[1][k] - q[0][k]) & 7;
+                    bits |= (uint64_t)q[0][k] << (59 - 8 * k);
+                    bits |= (uint64_t)d << (56 - 8 * k);
+                }
+            }
+            else
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    bits |= (uint64_t)q[0][k] << (60 - 8 * k);
+                    bits |= (uint64_t)q[1][k] << (56 - 8 * k);
+                }
+            }
+            bits |= (uint64_t)fit[0].table << 37;
+            bits |= (uint64_t)fit[1].table << 34;
+            bits |= (uint64_t)diff << 33;
+            bits |= (uint64_t)flip << 32;
+
+            for (int s = 0; s < 2; s++)
+            {
+                for (int p = 0; p < 8; p++)
+                {
+                    int pixel = sides[flip][s][p];
+                    int index = fit[s].indices[p];
+                    bits |= (uint64_t)(index >> 1) << (16 + pixel);
+                    bits |= (uint64_t)(index & 1) << pixel;
+                }
+            }
+            bestError = error;
+            bestBits = bits;
+        }
+    }
+    WriteBE64(bestBits, out);
+}
+
+static void EncodeAlphaBlock(const Block &block, unsigned char *out)
+{
+    int lo = 255, hi = 0;
+    for (int p = 0; p < 16; p++)
+    {
+        if (block.rgba[p][3] < lo) lo = block.rgba[p][3];
+        if (block.rgba[p][3] > hi) hi = block.rgba[p][3];
+    }
+
+    uint64_t bestBits = 0;
+    int bestError = 0x7FFFFFFF;
+    int center = (lo + hi + 1) / 2;
+
+    for (int table = 0; table < 16 && bestError > 0; table++)
+    {
+        int span = eacModifiers[table][7] - eacModifiers[table][3];
+        int guess = (hi - lo + span / 2) / span;
+        for (int multiplier = guess - 1; multiplier <= guess + 1; multiplier++)
+        {
+            if (multiplier < 1 || multiplier > 15)
+                continue;
+            for (int base = center - 2; base <= center + 2; base++)
+            {
+                if (base < 0 || base > 255)
+                    continue;
+                uint64_t bits = ((uint64_t)base << 56) | ((uint64_t)multiplier << 52) | ((uint64_t)table << 48);
+                int error = 0;
+                for (int p = 0; p < 16; p++)
+                {
+                    int a = block.rgba[p][3];
+                    int bestIndex = 0, bestDelta = 0x7FFFFFFF;
+                    for (int i = 0; i < 8; i++)
+                    {
+                        int delta = Clamp255(base + eacModifiers[table][i] * multiplier) - a;
+                        delta *= delta;
+                        if (delta < bestDelta)
+                        {
+                            bestDelta = delta;
+                            bestIndex = i;
+                        }
+                    }
+                    error += bestDelta;
+                    bits |= (uint64_t)bestIndex << (45 - 3 * p);
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    bestBits = bits;
+                }
+            }
+        }
+    }
+    WriteBE64(bestBits, out);
+}
+
+// Encodes one level; blocks past the image edge repeat the last row/column
+static std::vector<unsigned char> EncodeLevel(const unsigned char *pixels, int w, int h, bool alpha)
+{
+    int bw = (w + 3) / 4, bh = (h + 3) / 4;
+    int blockSize = alpha ? 16 : 8;
+    std::vector<unsigned char> out((size_t)bw * bh * blockSize);
+
+    for (int by = 0; by < bh; by++)
+    {
+        for (int bx = 0; bx < bw; bx++)
+        {
+            Block block;
+            for (int x = 0; x < 4; x++)
+            {
+                for (int y = 0; y < 4; y++)
+                {
+                    int px = bx * 4 + x < w ? bx * 4 + x : w - 1;
+                    int py = by * 4 + y < h ? by * 4 + y : h - 1;
+                    const unsigned char *p = pixels + ((size_t)py * w + px) * 4;
+                    for (int k = 0; k < 4; k++)
+                        block.rgba[x * 4 + y][k] = p[k];
+                }
+            }
+            unsigned char *dst = &out[((size_t)by * bw + bx) * blockSize];
+            if (alpha)
+            {
+                EncodeAlphaBlock(block, dst);
+                dst += 8;
+            }
+            EncodeColorBlock(block, dst);
+        }
+    }
+    return out;
+}
+
+static std::vector<unsigned char> Downsample(const std::vector<unsigned char> &src, int w, int h, int *nw, int *nh)
+{
+    *nw = w > 1 ? w / 2 : 1;
+    *nh = h > 1 ? h / 2 : 1;
+    std::vector<unsigned char> dst((size_t)*nw * *nh * 4);
+    for (int y = 0; y < *nh; y++)
+    {
+        int y0 = 2 * y, y1 = (2 * y + 1 < h) ? 2 * y + 1 : h - 1;
+        for (int x = 0; x < *nw; x++)
+        {
+            int x0 = 2 * x, x1 = (2 * x + 1 < w) ? 2 * x + 1 : w - 1;
+            for (int k = 0; k < 4; k++)
+            {
+                int sum = src[((size_t)y0 * w + x0) * 4 + k] + src[((size_t)y0 * w + x1) * 4 + k] +
+                          src[((size_t)y1 * w + x0) * 4 + k] + src[((size_t)y1 * w + x1) * 4 + k];
+                dst[((size_t)y * *nw + x) * 4 + k] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+    return dst;
+}
+
+static void Put32(std::vector<unsigned char> &file, uint32_t v)
+{
+    unsigned char bytes[4];
+    memcpy(bytes, &v, 4);
+    file.insert(file.end(), bytes, bytes + 4);
+}
+
+int main(int argc, char **argv)
+{
+    bool srgb = false, mips = true;
+    const char *input = NULL, *output = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-srgb") == 0) srgb = true;
+        else if (strcmp(argv[i], "-nomips") == 0) mips = false;
+        else if (!input) input = argv[i];
+        else if (!output) output = argv[i];
+    }
+    if (!input || !output)
+    {
+        fprintf(stderr, "usage: %s [-srgb] [-nomips] input.png output.ktx\n", argv[0]);
+        return 1;
+    }
+
+    int w, h, components;
+    stbi_set_flip_vertically_on_load(1);   // same orientation as Texture2D::Load
+    unsigned char *data = stbi_load(input, &w, &h, &components, 4);
+    if (!data)
+    {
+        fprintf(stderr, "etc2enc: failed to load %s: %s\n", input, stbi_failure_reason());
+        return 1;
+    }
+    bool alpha = (components == 2 || components == 4);
+    std::vector<unsigned char> level(data, data + (size_t)w * h * 4);
+    stbi_image_free(data);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::vector<unsigned char>> levels;
+    size_t rawBytes = 0;
+    int lw = w, lh = h;
+    while (true)
+    {
+        levels.push_back(EncodeLevel(level.data(), lw, lh, alpha));
+        rawBytes += (size_t)lw * lh * (alpha ? 4 : 3);
+        if (!mips || (lw == 1 && lh == 1))
+            break;
+        level = Downsample(level, lw, lh, &lw, &lh);
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    static const unsigned char identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+    uint32_t format = alpha ? (srgb ? GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC : GL_COMPRESSED_RGBA8_ETC2_EAC)
+                            : (srgb ? GL_COMPRESSED_SRGB8_ETC2 : GL_COMPRESSED_RGB8_ETC2);
+
+    std::vector<unsigned char> file(identifier, identifier + 12);
+    Put32(file, 0x04030201);                // endianness
+    Put32(file, 0);                         // glType (compressed)
+    Put32(file, 1);                         // glTypeSize
+    Put32(file, 0);                         // glFormat (compressed)
+    Put32(file, format);                    // glInternalFormat
+    Put32(file, alpha ? GL_RGBA : GL_RGB);  // glBaseInternalFormat
+    Put32(file, w);
+    Put32(file, h);
+    Put32(file, 0);                         // pixelDepth
+    Put32(file, 0);                         // numberOfArrayElements
+    Put32(file, 1);                         // numberOfFaces
+    Put32(file, (uint32_t)levels.size());
+    Put32(file, 0);                         // bytesOfKeyValueData
+
+    size_t compressedBytes = 0;
+    for (auto &l : levels)
+    {
+        Put32(file, (uint32_t)l.size());
+        file.insert(file.end(), l.begin(), l.end());    // block data is always 4 byte aligned
+        compressedBytes += l.size();
+    }
+
+    FILE *out = fopen(output, "wb");
+    if (!out || fwrite(file.data(), 1, file.size(), out) != file.size())
+    {
+        fprintf(stderr, "etc2enc: failed to write %s\n", output);
+        if (out) fclose(out);
+        return 1;
+    }
+    fclose(out);
+
+    printf("%s -> %s: %dx%d %s, %d levels, %.1f KB uncompressed -> %.1f KB (%.1f:1), %.1f ms\n",
+           input, output, w, h, alpha ? "RGBA8_ETC2_EAC" : "RGB8_ETC2", (int)levels.size(),
+           rawBytes / 1024.0, compressedBytes / 1024.0, (double)rawBytes / compressedBytes, ms);
+    return 0;
+}
@@ -8,6 +8,20 @@
 #include <unistd.h>             // Required for: getch(), chdir() (POSIX), access()
 #include <dirent.h>  
 #include <sys/stat.h>               // Required for: stat() [Used in GetFileModTime()]
+#include <stdlib.h>                 // Required for: realpath()
+#include <limits.h>                 // Required for: PATH_MAX
+#include <fcntl.h>                  // Required for: open() [Used in MappedFile]
+#include <sys/mman.h>               // Required for: mmap(), munmap() [Used in MappedFile]
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <tuple>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <string_view>
+#include <unordered_map>
 #define GETCWD getcwd
 #define CHDIR chdir
 
@@ -42,58 +56,559 @@
 
 
 
-inline	void Log(int severity, const char* fmt, ...)
+// Severities below this are dropped before anything is packed or queued. The
+// caller still evaluates the arguments, so keep costly ones out of hot paths.
+#ifndef LOG_MIN_SEVERITY
+    #define LOG_MIN_SEVERITY 0
+#endif
+
+#define LOG_QUEUE_SIZE      4096        // Records in flight, power of two
+#define LOG_ARGS_SIZE       96          // Bytes for the packed arguments of one record
+#define LOG_TEXT_SIZE       192         // Bytes for copies of string arguments of one record
+#define LOG_LINE_SIZE       1024
+
+// Log() only packs the format pointer and its arguments into a ring buffer
+// slot (string arguments are copied, truncated to LOG_TEXT_SIZE in total);
+// a background thread formats and writes them to the console and the log
+// file. Errors (severity >= 2) wait until they have been written. Formats
+// must be string literals, since they are read later.
+
+struct LogString
+{
+    unsigned short offset;
+};
+
+struct LogRecord
+{
+    std::atomic<unsigned int> sequence;
+    int severity;
+    const char *fmt;
+    void (*format)(const LogRecord &record, char *out, size_t size);
+    time_t time;
+    alignas(8) unsigned char args[LOG_ARGS_SIZE];
+    char text[LOG_TEXT_SIZE];
+};
+
+template <typename T>
+inline T LogPack(T value, LogRecord &, size_t &)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Log arguments must be plain values");
+    return value;
+}
+
+inline LogString LogPack(const char *value, LogRecord &record, size_t &used)
 {
+    if (!value)
+        value = "(null)";
+    size_t length = strlen(value);
+    if (used >= LOG_TEXT_SIZE)
+        return { (unsigned short)(LOG_TEXT_SIZE - 1) };
+    if (length > LOG_TEXT_SIZE - 1 - used)
+        length = LOG_TEXT_SIZE - 1 - used;
+    LogString packed = { (unsigned short)used };
+    memcpy(record.text + used, value, length);
+    record.text[used + length] = 0;
+    used += length + 1;
+    return packed;
+}
+inline LogString LogPack(char *value, LogRecord &record, size_t &used) { return LogPack((const char*)value, record, used); }
+inline LogString LogPack(const unsigned char *value, LogRecord &record, size_t &used) { return LogPack((const char*)value, record, used); }
+inline LogString LogPack(unsigned char *value, LogRecord &record, size_t &used) { return LogPack((const char*)value, record, used); }
+
+template <typename T>
+inline T LogUnpack(const T &value, const LogRecord &) { return value; }
+inline const char *LogUnpack(const LogString &value, const LogRecord &record) { return record.text + value.offset; }
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-security"
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+template <typename Packed>
+inline void LogFormat(const LogRecord &record, char *out, size_t size)
+{
+    const Packed &args = *reinterpret_cast<const Packed*>(record.args);
+    std::apply([&](const auto&... values)
+    {
+        snprintf(out, size, record.fmt, LogUnpack(values, record)...);
+    }, args);
+}
+#pragma GCC diagnostic pop
+
+// Bounded multi-producer queue (sequence number per slot) drained by one thread
+class LogQueue
+{
+    public:
+    static LogQueue &Get()
+    {
+        // Never destroyed, so static destructors can still log; the atexit
+        // handler drains it and switches to writing synchronously.
+        static LogQueue *queue = new LogQueue();
+        return *queue;
+    }
 
-		const char* type;
-		const char* color;
-		switch (severity) 
+    LogRecord &Acquire(unsigned int &position)
+    {
+        position = m_enqueue.load(std::memory_order_relaxed);
+        for (;;)
         {
-			case  0:
-				type = "info";
-				color = CONSOLE_COLOR_GREEN;
-				break;
-			case 1:
-				type = "warning";
-				color = CONSOLE_COLOR_PURPLE;
-				break;
-            case 2:
-				type = "error";
-				color = CONSOLE_COLOR_RED;
-				break;
-			default:
-				break;
-		}
+            LogRecord &record = m_records[position & (LOG_QUEUE_SIZE - 1)];
+            unsigned int sequence = record.sequence.load(std::memory_order_acquire);
+            int diff = (int)(sequence - position);
+            if (diff == 0)
+            {
+                if (m_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    return record;
+            }
+            else if (diff < 0)
+            {
+                // Full: wait for the writer rather than lose the message
+                std::this_thread::yield();
+                position = m_enqueue.load(std::memory_order_relaxed);
+            }
+            else
+                position = m_enqueue.load(std::memory_order_relaxed);
+        }
+    }
 
+    void Publish(LogRecord &record, unsigned int position)
+    {
+        record.sequence.store(position + 1, std::memory_order_release);
+    }
 
-		time_t rawTime;
-		struct tm* timeInfo;
-		char timeBuffer[80];
+    // Returns once everything logged before the call has been written
+    void Flush()
+    {
+        unsigned int target = m_enqueue.load(std::memory_order_acquire);
+        while ((int)(m_dequeue.load(std::memory_order_acquire) - target) < 0)
+        {
+            if (!m_running.load(std::memory_order_acquire))
+                break;
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
 
-		time(&rawTime);
-		timeInfo = localtime(&rawTime);
+    bool IsSynchronous() const
+    {
+        return !m_running.load(std::memory_order_acquire);
+    }
 
-		strftime(timeBuffer, sizeof(timeBuffer), "[%H:%M:%S]", timeInfo);
+    // Formats and writes one record on the calling thread
+    void Write(const LogRecord &record)
+    {
+        static const char *types[] = { "info", "warning", "error", "fatal" };
+        static const char *colors[] = { CONSOLE_COLOR_GREEN, CONSOLE_COLOR_PURPLE, CONSOLE_COLOR_RED, CONSOLE_COLOR_RED };
+        int severity = record.severity < 0 ? 0 : record.severity > 3 ? 3 : record.severity;
 
-		char consoleFormat[1024];
-		snprintf(consoleFormat, 1024, "%s%s %s%s%s: %s\n", CONSOLE_COLOR_CYAN,
-				timeBuffer, color, type, CONSOLE_COLOR_RESET, fmt);
+        char message[LOG_LINE_SIZE];
+        record.format(record, message, sizeof(message));
 
+        std::lock_guard<std::mutex> guard(m_writeLock);
+        if (record.time != m_timeSecond)
+        {
+            struct tm timeInfo;
+            localtime_r(&record.time, &timeInfo);
+            strftime(m_timeText, sizeof(m_timeText), "[%H:%M:%S]", &timeInfo);
+            m_timeSecond = record.time;
+        }
+        if (m_console)
+            fprintf(stdout, "%s%s %s%s%s: %s\n", CONSOLE_COLOR_CYAN, m_timeText, colors[severity], types[severity],
+                    CONSOLE_COLOR_RESET, message);
+        if (m_file)
+            fprintf(m_file, "%s %s: %s\n", m_timeText, types[severity], message);
+    }
 
-		char fileFormat[1024];
-		snprintf(fileFormat, 1024, "%s %s: %s\n", timeBuffer, type, fmt);
+    bool SetFile(const char *fileName)
+    {
+        Flush();
+        std::lock_guard<std::mutex> guard(m_writeLock);
+        if (m_file)
+            fclose(m_file);
+        m_file = fileName ? fopen(fileName, "w") : nullptr;
+        return m_file != nullptr || fileName == nullptr;
+    }
+
+    void SetConsole(bool enabled)
+    {
+        Flush();
+        std::lock_guard<std::mutex> guard(m_writeLock);
+        m_console = enabled;
+    }
+
+    private:
+        LogRecord m_records[LOG_QUEUE_SIZE];
+        alignas(64) std::atomic<unsigned int> m_enqueue;
+        alignas(64) std::atomic<unsigned int> m_dequeue;
+        std::atomic<bool> m_running;
+        std::thread m_thread;
+        std::mutex m_writeLock;
+        FILE *m_file;
+        bool m_console;
+        time_t m_timeSecond;
+        char m_timeText[32];
+
+        LogQueue()
+        {
+            for (unsigned int i = 0; i < LOG_QUEUE_SIZE; i++)
+                m_records[i].sequence.store(i, std::memory_order_relaxed);
+            m_enqueue = 0;
+            m_dequeue = 0;
+            m_file = nullptr;
+            m_console = true;
+            m_timeSecond = -1;
+            m_timeText[0] = 0;
+            m_running = true;
+            m_thread = std::thread(&LogQueue::WriterLoop, this);
+            atexit([]() { LogQueue::Get().Stop(); });
+        }
 
-		va_list argptr;
+        void Stop()
+        {
+            if (!m_running.exchange(false))
+                return;
+            m_thread.join();
+            Drain();
+            std::lock_guard<std::mutex> guard(m_writeLock);
+            fflush(stdout);
+            if (m_file)
+                fflush(m_file);
+        }
+
+        // Writes every published record; returns how many
+        int Drain()
+        {
+            int written = 0;
+            for (;;)
+            {
+                unsigned int position = m_dequeue.load(std::memory_order_relaxed);
+                LogRecord &record = m_records[position & (LOG_QUEUE_SIZE - 1)];
+                if (record.sequence.load(std::memory_order_acquire) != position + 1)
+                    break;
+                Write(record);
+                record.sequence.store(position + LOG_QUEUE_SIZE, std::memory_order_release);
+                m_dequeue.store(position + 1, std::memory_order_release);
+                written++;
+            }
+            return written;
+        }
+
+        void WriterLoop()
+        {
+            while (m_running.load(std::memory_order_acquire))
+            {
+                if (Drain() > 0)
+                {
+                    std::lock_guard<std::mutex> guard(m_writeLock);
+                    fflush(stdout);
+                    if (m_file)
+                        fflush(m_file);
+                }
+                else
+                    std::this_thread::sleep_for(std::chrono::microseconds(500));
+            }
+        }
+};
+
+template <typename... Args>
+inline void Log(int severity, const char *fmt, Args... args)
+{
+    if (severity < LOG_MIN_SEVERITY)
+        return;
+
+    typedef std::tuple<decltype(LogPack(args, std::declval<LogRecord&>(), std::declval<size_t&>()))...> Packed;
+    static_assert(sizeof(Packed) <= LOG_ARGS_SIZE, "Too many Log arguments");
+
+    LogQueue &queue = LogQueue::Get();
+    LogRecord local;
+    unsigned int position = 0;
+    bool synchronous = queue.IsSynchronous();
+    LogRecord &record = synchronous ? local : queue.Acquire(position);
+    record.severity = severity;
+    record.fmt = fmt;
+    record.format = &LogFormat<Packed>;
+    record.time = time(nullptr);
+    size_t used = 0;
+    new (record.args) Packed(LogPack(args, record, used)...);
+    (void)used;
+
+    if (synchronous)
+    {
+        queue.Write(record);
+        return;
+    }
+    queue.Publish(record, position);
+    if (severity >= 2)
+        queue.Flush();
+}
 
-		va_start(argptr, fmt);
-		vprintf(consoleFormat, argptr);
-		va_end(argptr);
+// Blocks until every message logged so far has been written
+inline void LogFlush()
+{
+    LogQueue::Get().Flush();
+}
 
-		char buf[4096];
+// Also write messages (without colors) to a file; nullptr closes it
+inline bool SetLogFile(const char *fileName)
+{
+    return LogQueue::Get().SetFile(fileName);
+}
 
-		va_start(argptr, fmt);
-		vsprintf(buf, fmt, argptr);
-		va_end(argptr);
+inline void SetLogConsole(bool enabled)
+{
+    LogQueue::Get().SetConsole(enabled);
+}
+
+//----------------------------------------------------------------------------------
+// Memory tracking
+//----------------------------------------------------------------------------------
+
+// Build with -DMEMORY_TRACKING=1 in every translation unit (it changes the
+// MemAlloc block layout). Allocations made with MemAlloc then carry a tag, GL
+// objects report their sizes, and totals, high-water marks and budgets are
+// kept per subsystem. At 0 MemAlloc/MemFree are malloc/free and the tracker
+// calls compile away.
+#ifndef MEMORY_TRACKING
+    #define MEMORY_TRACKING 0
+#endif
+
+enum MemoryTag
+{
+    MEMORY_GENERAL = 0,
+    MEMORY_FILE,            // LoadFileData, LoadFileText, GetDirectoryFiles
+    MEMORY_TEXT,            // TextReplace, TextInsert results
+    MEMORY_MESH,            // geometry pool slabs
+    MEMORY_TEXTURE,         // decoded images
+    MEMORY_LOG,             // log queue
+    MEMORY_TERRAIN,         // terrain heights and min/max trees
+    MEMORY_GPU_BUFFER,      // vertex, index and pixel buffers
+    MEMORY_GPU_TEXTURE,
+    MEMORY_GPU_SHADER,      // linked program binaries
+    MEMORY_TAG_COUNT
+};
+
+class MemoryTracker
+{
+    public:
+    static void Add(MemoryTag tag, size_t bytes)
+    {
+        if (!MEMORY_TRACKING)
+            return;
+        Counter &counter = Get().counters[tag];
+        size_t current = counter.current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        counter.count.fetch_add(1, std::memory_order_relaxed);
+        size_t peak = counter.peak.load(std::memory_order_relaxed);
+        while (current > peak && !counter.peak.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+            ;
+        size_t budget = counter.budget.load(std::memory_order_relaxed);
+        if (budget > 0 && current > budget && !counter.over.exchange(true, std::memory_order_relaxed))
+            Log(1, "MEMORY: %s over budget: %zu KB of %zu KB", GetTagName(tag), current / 1024, budget / 1024);
+    }
+
+    static void Remove(MemoryTag tag, size_t bytes)
+    {
+        if (!MEMORY_TRACKING)
+            return;
+        Counter &counter = Get().counters[tag];
+        size_t current = counter.current.fetch_sub(bytes, std::memory_order_relaxed) - bytes;
+        counter.count.fetch_sub(1, std::memory_order_relaxed);
+        if (current <= counter.budget.load(std::memory_order_relaxed))
+            counter.over.store(false, std::memory_order_relaxed);
+    }
+
+    // Records the size of a GL object, replacing what was recorded for it before
+    static void SetGPUSize(MemoryTag tag, unsigned int id, size_t bytes)
+    {
+        if (!MEMORY_TRACKING || id == 0)
+            return;
+        State &state = Get();
+        size_t previous = 0;
+        {
+            std::lock_guard<std::mutex> guard(state.lock);
+            size_t &entry = state.gpuSizes[GPUKey(tag, id)];
+            previous = entry;
+            entry = bytes;
+        }
+        if (previous > 0)
+            Remove(tag, previous);
+        Add(tag, bytes);
+    }
+
+    // Called when the GL object is deleted
+    static void ReleaseGPU(MemoryTag tag, unsigned int id)
+    {
+        if (!MEMORY_TRACKING || id == 0)
+            return;
+        State &state = Get();
+        size_t previous = 0;
+        {
+            std::lock_guard<std::mutex> guard(state.lock);
+            auto it = state.gpuSizes.find(GPUKey(tag, id));
+            if (it == state.gpuSizes.end())
+                return;
+            previous = it->second;
+            state.gpuSizes.erase(it);
+        }
+        Remove(tag, previous);
+    }
+
+    static size_t GetCurrent(MemoryTag tag)
+    {
+        return Get().counters[tag].current.load(std::memory_order_relaxed);
+    }
+
+    // High-water mark since start or the last ResetPeaks()
+    static size_t GetPeak(MemoryTag tag)
+    {
+        return Get().counters[tag].peak.load(std::memory_order_relaxed);
+    }
+
+    // Live allocations (or GL objects) under the tag
+    static long GetCount(MemoryTag tag)
+    {
+        return Get().counters[tag].count.load(std::memory_order_relaxed);
+    }
+
+    static void ResetPeaks()
+    {
+        for (Counter &counter : Get().counters)
+            counter.peak.store(counter.current.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    // 0 removes the budget. Crossing it logs a warning once until usage drops back.
+    static void SetBudget(MemoryTag tag, size_t bytes)
+    {
+        Counter &counter = Get().counters[tag];
+        counter.budget.store(bytes, std::memory_order_relaxed);
+        counter.over.store(false, std::memory_order_relaxed);
+    }
+
+    static bool IsOverBudget(MemoryTag tag)
+    {
+        Counter &counter = Get().counters[tag];
+        size_t budget = counter.budget.load(std::memory_order_relaxed);
+        return budget > 0 && counter.current.load(std::memory_order_relaxed) > budget;
+    }
+
+    static const char *GetTagName(MemoryTag tag)
+    {
+        static const char *names[MEMORY_TAG_COUNT] = { "general", "file", "text", "mesh", "texture", "log",
+                                                       "terrain", "gpu buffer", "gpu texture", "gpu shader" };
+        return (tag >= 0 && tag < MEMORY_TAG_COUNT) ? names[tag] : "unknown";
+    }
+
+    // Logs one line per tag with current, peak and budget
+    static void Dump()
+    {
+        if (!MEMORY_TRACKING)
+        {
+            Log(1, "MEMORY: tracking is off, build with -DMEMORY_TRACKING=1");
+            return;
+        }
+        Log(0, "MEMORY: %-12s %10s %10s %10s %8s", "tag", "KB", "peak KB", "budget KB", "count");
+        for (int i = 0; i < MEMORY_TAG_COUNT; i++)
+        {
+            MemoryTag tag = (MemoryTag)i;
+            Counter &counter = Get().counters[tag];
+            Log(IsOverBudget(tag) ? 1 : 0, "MEMORY: %-12s %10zu %10zu %10zu %8ld", GetTagName(tag), GetCurrent(tag) / 1024,
+                GetPeak(tag) / 1024, counter.budget.load(std::memory_order_relaxed) / 1024, GetCount(tag));
+        }
+    }
+
+    private:
+        struct Counter
+        {
+            std::atomic<size_t> current{0};
+            std::atomic<size_t> peak{0};
+            std::atomic<size_t> budget{0};
+            std::atomic<long> count{0};
+            std::atomic<bool> over{false};
+        };
+
+        struct State
+        {
+            Counter counters[MEMORY_TAG_COUNT];
+            std::mutex lock;
+            std::unordered_map<unsigned long long, size_t> gpuSizes;
+
+            State()
+            {
+                // The log queue is one fixed block, allocated before the tracker
+                if (MEMORY_TRACKING)
+                {
+                    counters[MEMORY_LOG].current = sizeof(LogQueue);
+                    counters[MEMORY_LOG].peak = sizeof(LogQueue);
+                    counters[MEMORY_LOG].count = 1;
+                }
+            }
+        };
+
+        // Never destroyed, like the log queue, so late frees still find it
+        static State &Get()
+        {
+            static State *state = new State();
+            return *state;
+        }
+
+        static unsigned long long GPUKey(MemoryTag tag, unsigned int id)
+        {
+            return ((unsigned long long)tag << 32) | id;
+        }
+};
+
+// Tracked blocks start with this header; 16 bytes keeps malloc's alignment
+struct MemoryHeader
+{
+    size_t size;
+    size_t tag;
+};
+
+inline void *MemAlloc(size_t size, MemoryTag tag = MEMORY_GENERAL)
+{
+#if MEMORY_TRACKING
+    MemoryHeader *header = (MemoryHeader*)malloc(sizeof(MemoryHeader) + size);
+    if (!header)
+        return nullptr;
+    header->size = size;
+    header->tag = tag;
+    MemoryTracker::Add(tag, size);
+    return header + 1;
+#else
+    (void)tag;
+    return malloc(size);
+#endif
+}
+
+// Keeps the tag of the block; a null block takes the given one
+inline void *MemRealloc(void *p, size_t size, MemoryTag tag = MEMORY_GENERAL)
+{
+#if MEMORY_TRACKING
+    if (!p)
+        return MemAlloc(size, tag);
+    MemoryHeader *header = (MemoryHeader*)p - 1;
+    MemoryTag blockTag = (MemoryTag)header->tag;
+    size_t previous = header->size;
+    MemoryHeader *grown = (MemoryHeader*)realloc(header, sizeof(MemoryHeader) + size);
+    if (!grown)
+        return nullptr;
+    grown->size = size;
+    MemoryTracker::Remove(blockTag, previous);
+    MemoryTracker::Add(blockTag, size);
+    return grown + 1;
+#else
+    (void)tag;
+    return realloc(p, size);
+#endif
+}
+
+inline void MemFree(void *p)
+{
+#if MEMORY_TRACKING
+    if (!p)
+        return;
+    MemoryHeader *header = (MemoryHeader*)p - 1;
+    MemoryTracker::Remove((MemoryTag)header->tag, header->size);
+    free(header);
+#else
+    free(p);
+#endif
 }
 
 inline std::vector<std::string> SplitString(const std::string& string, const std::string& delimiters)
@@ -154,7 +669,7 @@ inline unsigned char *LoadFileData(const char *fileName, unsigned int *bytesRead
 
             if (size > 0)
             {
-                data = (unsigned char *)malloc(size*sizeof(unsigned char));
+                data = (unsigned char *)MemAlloc(size*sizeof(unsigned char), MEMORY_FILE);
 
                 unsigned int count = (unsigned int) SDL_RWread(file, data, sizeof(unsigned char), size);
                 *bytesRead = count;
@@ -171,6 +686,98 @@ inline unsigned char *LoadFileData(const char *fileName, unsigned int *bytesRead
     return data;
 }
 
+// Frees what LoadFileData returned
+inline void UnloadFileData(unsigned char *data)
+{
+    MemFree(data);
+}
+
+// Read only view of a whole file mapped into memory; unmapped when destroyed.
+// Loaders parse straight from the page cache instead of a malloc'd copy.
+class MappedFile
+{
+public:
+    MappedFile() {}
+    explicit MappedFile(const char *fileName) { Open(fileName); }
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) : m_data(other.m_data), m_size(other.m_size)
+    {
+        other.m_data = NULL;
+        other.m_size = 0;
+    }
+    MappedFile &operator=(MappedFile &&other)
+    {
+        if (this != &other)
+        {
+            Close();
+            m_data = other.m_data;
+            m_size = other.m_size;
+            other.m_data = NULL;
+            other.m_size = 0;
+        }
+        return *this;
+    }
+
+    bool Open(const char *fileName)
+    {
+        Close();
+        if (fileName == NULL)
+        {
+            Log(1, "FILEIO: File name provided is not valid");
+            return false;
+        }
+
+        int fd = open(fileName, O_RDONLY);
+        if (fd < 0)
+        {
+            Log(1, "FILEIO: [%s] Failed to open file", fileName);
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0)
+        {
+            Log(1, "FILEIO: [%s] Failed to read file", fileName);
+            close(fd);
+            return false;
+        }
+
+        void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+        {
+            Log(1, "FILEIO: [%s] Failed to map file", fileName);
+            return false;
+        }
+        madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+        m_data = (const unsigned char *)data;
+        m_size = (size_t)info.st_size;
+        Log(0, "FILEIO: [%s] File mapped successfully", fileName);
+        return true;
+    }
+
+    void Close()
+    {
+        if (m_data)
+            munmap((void *)m_data, m_size);
+        m_data = NULL;
+        m_size = 0;
+    }
+
+    bool IsOpen() const { return m_data != NULL; }
+    const unsigned char *Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+    const unsigned char *m_data = NULL;
+    size_t m_size = 0;
+};
+
 inline bool SaveFileData(const char *fileName, void *data, unsigned int bytesToWrite)
 {
     bool success = false;
@@ -207,9 +814,9 @@ inline char *LoadFileText(const char *fileName)
           unsigned  int size =(int) SDL_RWsize(textFile);
             if (size > 0)
             {
-                text = (char *)malloc((size + 1)*sizeof(char));
+                text = (char *)MemAlloc((size + 1)*sizeof(char), MEMORY_FILE);
                 unsigned int count = (unsigned int) SDL_RWread(textFile, text, sizeof( char), size);
-                if (count < size) text = (char*)realloc(text, count + 1);
+                if (count < size) text = (char*)MemRealloc(text, count + 1);
                 text[count] = '\0';
 
                  Log(0, "FILEIO: [%s] Text file loaded successfully", fileName);
@@ -225,6 +832,12 @@ inline char *LoadFileText(const char *fileName)
     return text;
 }
 
+// Frees what LoadFileText returned
+inline void UnloadFileText(char *text)
+{
+    MemFree(text);
+}
+
 inline bool SaveFileText(const char *fileName, char *text)
 {
     bool success = false;
@@ -276,13 +889,12 @@ inline const char *TextFormat(const char *text, ...)
 {
 
     #define MAX_TEXTFORMAT_BUFFERS 4        // Maximum number of static buffers for text formatting
-    static char buffers[MAX_TEXTFORMAT_BUFFERS][MAX_TEXT_BUFFER_LENGTH] = { 0 };
-    static int  index = 0;
+    thread_local char buffers[MAX_TEXTFORMAT_BUFFERS][MAX_TEXT_BUFFER_LENGTH] = { 0 };
+    thread_local int  index = 0;
     char *currentBuffer = buffers[index];
-    memset(currentBuffer, 0, MAX_TEXT_BUFFER_LENGTH);   // Clear buffer before using
     va_list args;
     va_start(args, text);
-    vsprintf(currentBuffer, text, args);
+    vsnprintf(currentBuffer, MAX_TEXT_BUFFER_LENGTH, text, args);
     va_end(args);
     index += 1;     // Move to next buffer for next function call
     if (index >= MAX_TEXTFORMAT_BUFFERS) index = 0;
@@ -339,7 +951,7 @@ inline bool TextIsEqual(const char *text1, const char *text2)
 
 inline const char *TextSubtext(const char *text, int position, int length)
 {
-    static char buffer[MAX_TEXT_BUFFER_LENGTH] = { 0 };
+    thread_local char buffer[MAX_TEXT_BUFFER_LENGTH] = { 0 };
 
     int textLength = TextLength(text);
 
@@ -350,6 +962,7 @@ inline const char *TextSubtext(const char *text, int position, int length)
     }
 
     if (length >= textLength) length = textLength;
+    if (length >= MAX_TEXT_BUFFER_LENGTH) length = MAX_TEXT_BUFFER_LENGTH - 1;
 
     for (int c = 0 ; c < length ; c++)
     {
@@ -362,6 +975,7 @@ inline const char *TextSubtext(const char *text, int position, int length)
     return buffer;
 }
 
+// Result must be freed with MemFree
 inline char *TextReplace(char *text, const char *replace, const char *by)
 {
     // Sanity checks and initialization
@@ -386,7 +1000,7 @@ inline char *TextReplace(char *text, const char *replace, const char *by)
     for (count = 0; (temp = strstr(insertPoint, replace)); count++) insertPoint = temp + replaceLen;
 
     // Allocate returning string and point temp to it
-    temp = result =(char*) malloc(TextLength(text) + (byLen - replaceLen)*count + 1);
+    temp = result =(char*) MemAlloc(TextLength(text) + (byLen - replaceLen)*count + 1, MEMORY_TEXT);
 
     if (!result) return NULL;   // Memory could not be allocated
 
@@ -410,16 +1024,17 @@ inline char *TextReplace(char *text, const char *replace, const char *by)
 }
 
 
+// Result must be freed with MemFree
 inline char *TextInsert(const char *text, const char *insert, int position)
 {
     int textLen = TextLength(text);
     int insertLen =  TextLength(insert);
 
-    char *result = (char *)malloc(textLen + insertLen + 1);
+    char *result = (char *)MemAlloc(textLen + insertLen + 1, MEMORY_TEXT);
 
     for (int i = 0; i < position; i++) result[i] = text[i];
-    for (int i = position; i < insertLen + position; i++) result[i] = insert[i];
-    for (int i = (insertLen + position); i < (textLen + insertLen); i++) result[i] = text[i];
+    for (int i = position; i < insertLen + position; i++) result[i] = insert[i - position];
+    for (int i = (insertLen + position); i < (textLen + insertLen); i++) result[i] = text[i - insertLen];
 
     result[textLen + insertLen] = '\0';     // Make sure text string is valid!
 
@@ -429,7 +1044,7 @@ inline char *TextInsert(const char *text, const char *insert, int position)
 
 inline const char *TextJoin(const char **textList, int count, const char *delimiter)
 {
-    static char text[MAX_TEXT_BUFFER_LENGTH] = { 0 };
+    thread_local char text[MAX_TEXT_BUFFER_LENGTH] = { 0 };
     memset(text, 0, MAX_TEXT_BUFFER_LENGTH);
     char *textPtr = text;
 
@@ -463,8 +1078,8 @@ inline const char *TextJoin(const char **textList, int count, const char *delimi
 
 inline const char **TextSplit(const char *text, char delimiter, int *count)
 {
-    static const char *result[MAX_TEXTSPLIT_COUNT] = { NULL };
-    static char buffer[MAX_TEXT_BUFFER_LENGTH] = { 0 };
+    thread_local const char *result[MAX_TEXTSPLIT_COUNT] = { NULL };
+    thread_local char buffer[MAX_TEXT_BUFFER_LENGTH] = { 0 };
     memset(buffer, 0, MAX_TEXT_BUFFER_LENGTH);
 
     result[0] = buffer;
@@ -515,7 +1130,7 @@ inline int TextFindIndex(const char *text, const char *find)
 
 inline const char *TextToUpper(const char *text)
 {
-    static char buffer[MAX_TEXT_BUFFER_LENGTH] = { 0 };
+    thread_local char buffer[MAX_TEXT_BUFFER_LENGTH] = { 0 };
 
     for (int i = 0; i < MAX_TEXT_BUFFER_LENGTH; i++)
     {
@@ -532,7 +1147,7 @@ inline const char *TextToUpper(const char *text)
 
 inline const char *TextToLower(const char *text)
 {
-    static char buffer[MAX_TEXT_BUFFER_LENGTH] = { 0 };
+    thread_local char buffer[MAX_TEXT_BUFFER_LENGTH] = { 0 };
 
     for (int i = 0; i < MAX_TEXT_BUFFER_LENGTH; i++)
     {
@@ -549,7 +1164,7 @@ inline const char *TextToLower(const char *text)
 
 inline const char *TextToPascal(const char *text)
 {
-    static char buffer[MAX_TEXT_BUFFER_LENGTH] = { 0 };
+    thread_local char buffer[MAX_TEXT_BUFFER_LENGTH] = { 0 };
 
     buffer[0] = (char)toupper(text[0]);
 
@@ -570,6 +1185,167 @@ inline const char *TextToPascal(const char *text)
     return buffer;
 }
 
+//----------------------------------------------------------------------------------
+// Text views: the same operations without hidden buffers. Results are views
+// into the input, into a buffer the caller passes (truncated to fit, always
+// terminated), or into a per thread arena. Safe to call from any thread.
+//----------------------------------------------------------------------------------
+
+#define TEXT_ARENA_SIZE     (64*1024)       // Per thread; TextFormatView results live until it wraps
+
+// Carves 'size' bytes from the calling thread's ring arena
+inline char *TextArenaAlloc(size_t size)
+{
+    thread_local char arena[TEXT_ARENA_SIZE];
+    thread_local size_t offset = 0;
+    if (size > TEXT_ARENA_SIZE) size = TEXT_ARENA_SIZE;
+    if (offset + size > TEXT_ARENA_SIZE) offset = 0;
+    char *result = arena + offset;
+    offset += size;
+    return result;
+}
+
+// snprintf that returns the number of bytes written, not the would-be length
+inline int TextFormatTo(char *out, size_t size, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+inline int TextFormatTo(char *out, size_t size, const char *fmt, ...)
+{
+    if (size == 0) return 0;
+    va_list args;
+    va_start(args, fmt);
+    int length = vsnprintf(out, size, fmt, args);
+    va_end(args);
+    if (length < 0) { out[0] = '\0'; return 0; }
+    return (size_t)length < size ? length : (int)size - 1;
+}
+
+// Formats into the thread arena; the view stays valid for the next
+// TEXT_ARENA_SIZE bytes formatted on this thread
+inline std::string_view TextFormatView(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+inline std::string_view TextFormatView(const char *fmt, ...)
+{
+    char stack[256];
+    va_list args;
+    va_start(args, fmt);
+    int length = vsnprintf(stack, sizeof(stack), fmt, args);
+    va_end(args);
+    if (length < 0) return std::string_view();
+
+    size_t size = (size_t)length + 1 < TEXT_ARENA_SIZE ? (size_t)length + 1 : TEXT_ARENA_SIZE;
+    char *out = TextArenaAlloc(size);
+    if ((size_t)length < sizeof(stack))
+        memcpy(out, stack, size);
+    else
+    {
+        va_start(args, fmt);
+        vsnprintf(out, size, fmt, args);
+        va_end(args);
+    }
+    return std::string_view(out, size - 1);
+}
+
+inline std::string_view TextSubtextView(std::string_view text, int position, int length)
+{
+    if (position < 0) position = 0;
+    if (length < 0 || (size_t)position >= text.size()) return std::string_view();
+    return text.substr(position, length);
+}
+
+inline bool TextEqualIgnoreCase(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++)
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) return false;
+    return true;
+}
+
+inline std::string_view TextToUpper(std::string_view text, char *out, size_t size)
+{
+    if (size == 0) return std::string_view();
+    size_t length = text.size() < size - 1 ? text.size() : size - 1;
+    for (size_t i = 0; i < length; i++) out[i] = (char)toupper((unsigned char)text[i]);
+    out[length] = '\0';
+    return std::string_view(out, length);
+}
+
+inline std::string_view TextToLower(std::string_view text, char *out, size_t size)
+{
+    if (size == 0) return std::string_view();
+    size_t length = text.size() < size - 1 ? text.size() : size - 1;
+    for (size_t i = 0; i < length; i++) out[i] = (char)tolower((unsigned char)text[i]);
+    out[length] = '\0';
+    return std::string_view(out, length);
+}
+
+// Views of the pieces between delimiters; returns how many were stored (at most maxParts)
+inline int TextSplit(std::string_view text, char delimiter, std::string_view *parts, int maxParts)
+{
+    int count = 0;
+    size_t start = 0;
+    while (count < maxParts)
+    {
+        size_t end = text.find(delimiter, start);
+        if (end == std::string_view::npos)
+        {
+            parts[count++] = text.substr(start);
+            break;
+        }
+        parts[count++] = text.substr(start, end - start);
+        start = end + 1;
+    }
+    return count;
+}
+
+inline std::string_view TextJoin(const std::string_view *parts, int count, std::string_view delimiter, char *out, size_t size)
+{
+    if (size == 0) return std::string_view();
+    size_t length = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0)
+        {
+            size_t n = delimiter.size() < size - 1 - length ? delimiter.size() : size - 1 - length;
+            memcpy(out + length, delimiter.data(), n);
+            length += n;
+        }
+        size_t n = parts[i].size() < size - 1 - length ? parts[i].size() : size - 1 - length;
+        memcpy(out + length, parts[i].data(), n);
+        length += n;
+    }
+    out[length] = '\0';
+    return std::string_view(out, length);
+}
+
+inline std::string_view GetFileNameView(std::string_view filePath)
+{
+    size_t slash = filePath.find_last_of("\\/");
+    return slash == std::string_view::npos ? filePath : filePath.substr(slash + 1);
+}
+
+// Like GetFileNameWithoutExt, cut at the first '.'
+inline std::string_view GetFileNameWithoutExtView(std::string_view filePath)
+{
+    std::string_view fileName = GetFileNameView(filePath);
+    return fileName.substr(0, fileName.find('.'));
+}
+
+// Without the dot; empty when there is none
+inline std::string_view GetFileExtensionView(std::string_view fileName)
+{
+    size_t dot = fileName.rfind('.');
+    if (dot == std::string_view::npos || dot == 0) return std::string_view();
+    return fileName.substr(dot + 1);
+}
+
+// Everything before the last separator ("" for a bare file name, "/" for
+// files in the root). Unlike GetDirectoryPath no "./" is prepended.
+inline std::string_view GetDirectoryPathView(std::string_view filePath)
+{
+    size_t slash = filePath.find_last_of("\\/");
+    if (slash == std::string_view::npos) return std::string_view();
+    if (slash == 0) return filePath.substr(0, 1);
+    return filePath.substr(0, slash);
+}
+
 //----------------------------------------------------------------------------------
 // Files management functions
 //----------------------------------------------------------------------------------
@@ -581,6 +1357,15 @@ inline bool FileExists(const char *fileName)
     return result;
 }
 
+inline long GetFileModTime(const char *fileName)
+{
+    struct stat result = { 0 };
+
+    if (stat(fileName, &result) == 0) return (long)result.st_mtime;
+
+    return 0;
+}
+
 inline bool DirectoryExists(const char *dirPath)
 {
     bool result = false;
@@ -621,10 +1406,10 @@ inline const char *GetFileNameWithoutExt(const char *filePath)
 {
     #define MAX_FILENAMEWITHOUTEXT_LENGTH   128
 
-    static char fileName[MAX_FILENAMEWITHOUTEXT_LENGTH];
+    thread_local char fileName[MAX_FILENAMEWITHOUTEXT_LENGTH];
     memset(fileName, 0, MAX_FILENAMEWITHOUTEXT_LENGTH);
 
-    if (filePath != NULL) strcpy(fileName, GetFileName(filePath));   // Get filename with extension
+    if (filePath != NULL) strncpy(fileName, GetFileName(filePath), MAX_FILENAMEWITHOUTEXT_LENGTH - 1);   // Get filename with extension
 
     int len = (int)strlen(fileName);
 
@@ -646,7 +1431,7 @@ inline const char *GetFileNameWithoutExt(const char *filePath)
 inline const char *GetDirectoryPath(const char *filePath)
 {
     const char *lastSlash = NULL;
-    static char dirPath[MAX_FILEPATH_LENGTH];
+    thread_local char dirPath[MAX_FILEPATH_LENGTH];
     memset(dirPath, 0, MAX_FILEPATH_LENGTH);
 
     // In case provided path does not contain a root drive letter (C:\, D:\) nor leading path separator (\, /),
@@ -682,7 +1467,7 @@ inline const char *GetDirectoryPath(const char *filePath)
 
 inline const char *GetPrevDirectoryPath(const char *dirPath)
 {
-    static char prevDirPath[MAX_FILEPATH_LENGTH];
+    thread_local char prevDirPath[MAX_FILEPATH_LENGTH];
     memset(prevDirPath, 0, MAX_FILEPATH_LENGTH);
     int pathLen = (int)strlen(dirPath);
 
@@ -705,7 +1490,7 @@ inline const char *GetPrevDirectoryPath(const char *dirPath)
 
 inline const char *GetWorkingDirectory(void)
 {
-    static char currentDir[MAX_FILEPATH_LENGTH];
+    thread_local char currentDir[MAX_FILEPATH_LENGTH];
     memset(currentDir, 0, MAX_FILEPATH_LENGTH);
 
     char *ptr = GETCWD(currentDir, MAX_FILEPATH_LENGTH - 1);
@@ -715,6 +1500,19 @@ inline const char *GetWorkingDirectory(void)
 
 
 
+// Resolves relative parts and links so one file always maps to the same path
+inline std::string GetCanonicalPath(const char *filePath)
+{
+    if (filePath == NULL) return std::string();
+
+    char resolved[PATH_MAX];
+    if (realpath(filePath, resolved) != NULL) return std::string(resolved);
+
+    return std::string(filePath);
+}
+
+
+
 static char **dirFilesPath = NULL;          // Store directory files paths as strings
 static int dirFilesCount = 0;               // Count directory files strings
 
@@ -723,9 +1521,9 @@ inline void ClearDirectoryFiles(void)
 {
     if (dirFilesCount > 0)
     {
-        for (int i = 0; i < MAX_DIRECTORY_FILES; i++) free(dirFilesPath[i]);
+        for (int i = 0; i < MAX_DIRECTORY_FILES; i++) MemFree(dirFilesPath[i]);
 
-        free(dirFilesPath);
+        MemFree(dirFilesPath);
     }
 
     dirFilesCount = 0;
@@ -738,9 +1536,9 @@ inline char **GetDirectoryFiles(const char *dirPath, int *fileCount)
     ClearDirectoryFiles();
 
     // Memory allocation for MAX_DIRECTORY_FILES
-    dirFilesPath = (char **)malloc(sizeof(char *)*MAX_DIRECTORY_FILES);
+    dirFilesPath = (char **)MemAlloc(sizeof(char *)*MAX_DIRECTORY_FILES, MEMORY_FILE);
 
-    for (int i = 0; i < MAX_DIRECTORY_FILES; i++) dirFilesPath[i] = (char *)malloc(sizeof(char)*MAX_FILEPATH_LENGTH);
+    for (int i = 0; i < MAX_DIRECTORY_FILES; i++) dirFilesPath[i] = (char *)MemAlloc(sizeof(char)*MAX_FILEPATH_LENGTH, MEMORY_FILE);
 
     int counter = 0;
     struct dirent *entity;
@@ -777,29 +1575,20 @@ inline bool ChangeDirectory(const char *dir)
 }
 
 
+// ext is a ';' separated list such as ".png;.jpg", compared ignoring case
 inline bool IsFileExtension(const char *fileName, const char *ext)
 {
-    bool result = false;
-    const char *fileExt = GetFileExtension(fileName);
+    std::string_view fileExt = GetFileExtensionView(fileName);
+    if (fileExt.empty()) return false;
 
-    if (fileExt != NULL)
+    std::string_view checkExts[MAX_TEXTSPLIT_COUNT];
+    int extCount = TextSplit(ext, ';', checkExts, MAX_TEXTSPLIT_COUNT);
+    for (int i = 0; i < extCount; i++)
     {
-
-        int extCount = 0;
-        const char **checkExts = TextSplit(ext, ';', &extCount);
-
-        char fileExtLower[16] = { 0 };
-        strcpy(fileExtLower, TextToLower(fileExt));
-
-        for (int i = 0; i < extCount; i++)
-        {
-            if (TextIsEqual(fileExtLower, TextToLower(checkExts[i] + 1)))
-            {
-                result = true;
-                break;
-            }
-        }
+        std::string_view check = checkExts[i];
+        if (!check.empty() && check[0] == '.') check.remove_prefix(1);
+        if (TextEqualIgnoreCase(fileExt, check)) return true;
     }
 
-    return result;
+    return false;
 }